@@ -24,6 +24,10 @@
  * =======================================================================
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE /* recvmmsg() and sendmmsg() */
+#endif
+
 #include "../../common/header/common.h"
 
 #include <unistd.h>
@@ -43,6 +47,10 @@
 #include <errno.h>
 #include <arpa/inet.h>
 #include <net/if.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
 
 netadr_t net_local_adr;
 
@@ -68,6 +76,55 @@ int ip6_sockets[2];
 int ipx_sockets[2];
 char *multicast_interface = NULL;
 
+/* The server receives and sends up to NET_BATCH
+   packets per system call, if net_mmsg is set. */
+#if defined(__linux__)
+#define NET_MMSG
+#endif
+
+#define NET_BATCH 32
+
+#ifdef NET_MMSG
+typedef struct
+{
+	struct mmsghdr hdrs[NET_BATCH];
+	struct iovec iovs[NET_BATCH];
+	struct sockaddr_storage addrs[NET_BATCH];
+	byte data[NET_BATCH][MAX_MSGLEN];
+	int socket; /* of the queued packets to send */
+	int get, count;
+} netbatch_t;
+
+static netbatch_t *net_recvbatch;
+static netbatch_t *net_sendbatch;
+static qboolean net_sendbatching;
+#endif
+
+static cvar_t *net_mmsg;
+
+/* The dedicated server sleeps in epoll_wait() on its
+   sockets, stdin and a timerfd, which wakes it up with
+   microsecond precision. */
+#if defined(__linux__)
+#define NET_EPOLL
+
+enum
+{
+	NET_POLL_STDIN,
+	NET_POLL_IP,
+	NET_POLL_IP6,
+	NET_POLL_IPX,
+	NET_POLL_FDS
+};
+
+static int net_epoll = -1;
+static int net_timer = -1;
+static int net_pollfds[NET_POLL_FDS] = {-1, -1, -1, -1};
+static qboolean net_pollfailed;
+
+static void NET_ClosePoll(void);
+#endif
+
 static int NET_Socket(const char *net_interface, int port, netsrc_t type, int family);
 static const char *NET_ErrorString(void);
 
@@ -191,6 +248,7 @@ SockadrToNetadr(struct sockaddr_storage *s, netadr_t *a)
 void
 NET_Init()
 {
+	net_mmsg = Cvar_Get("net_mmsg", "1", CVAR_ARCHIVE);
 }
 
 qboolean
@@ -515,6 +573,136 @@ NET_SendLoopPacket(netsrc_t sock, int length, const void *data, netadr_t to)
 	loop->msgs[i].datalen = length;
 }
 
+#ifdef NET_MMSG
+static netbatch_t *
+NET_AllocBatch(netbatch_t **batch)
+{
+	if (!*batch)
+	{
+		*batch = calloc(1, sizeof(netbatch_t));
+		YQ2_COM_CHECK_OOM(*batch, "calloc()", sizeof(netbatch_t))
+	}
+
+	return *batch;
+}
+
+/*
+ * Reads as many packets as fit into the batch with
+ * one call, from the first socket that has some.
+ */
+static void
+NET_FillRecvBatch(netbatch_t *batch, netsrc_t sock)
+{
+	int protocol, i, ret;
+
+	batch->get = batch->count = 0;
+
+	for (protocol = 0; protocol < 3; protocol++)
+	{
+		int net_socket;
+
+		if (protocol == 0)
+		{
+			net_socket = ip_sockets[sock];
+		}
+		else if (protocol == 1)
+		{
+			net_socket = ip6_sockets[sock];
+		}
+		else
+		{
+			net_socket = ipx_sockets[sock];
+		}
+
+		if (!net_socket)
+		{
+			continue;
+		}
+
+		for (i = 0; i < NET_BATCH; i++)
+		{
+			struct msghdr *hdr;
+
+			batch->iovs[i].iov_base = batch->data[i];
+			batch->iovs[i].iov_len = sizeof(batch->data[i]);
+
+			hdr = &batch->hdrs[i].msg_hdr;
+			memset(hdr, 0, sizeof(*hdr));
+			hdr->msg_name = &batch->addrs[i];
+			hdr->msg_namelen = sizeof(batch->addrs[i]);
+			hdr->msg_iov = &batch->iovs[i];
+			hdr->msg_iovlen = 1;
+
+			memset(&batch->addrs[i], 0, sizeof(batch->addrs[i]));
+		}
+
+		ret = recvmmsg(net_socket, batch->hdrs, NET_BATCH, MSG_DONTWAIT, NULL);
+
+		if (ret == -1)
+		{
+			if ((errno == EWOULDBLOCK) || (errno == ECONNREFUSED))
+			{
+				continue;
+			}
+
+			Com_Printf("%s: %s\n", NET_ErrorString(), __func__);
+			continue;
+		}
+
+		if (ret > 0)
+		{
+			batch->count = ret;
+			return;
+		}
+	}
+}
+
+static qboolean
+NET_GetBatchedPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
+{
+	netbatch_t *batch;
+
+	batch = NET_AllocBatch(&net_recvbatch);
+
+	if (!batch)
+	{
+		return false;
+	}
+
+	while (1)
+	{
+		const struct mmsghdr *msg;
+
+		if (batch->get >= batch->count)
+		{
+			NET_FillRecvBatch(batch, sock);
+
+			if (!batch->count)
+			{
+				return false;
+			}
+		}
+
+		msg = &batch->hdrs[batch->get];
+		SockadrToNetadr(&batch->addrs[batch->get], net_from);
+
+		if ((msg->msg_hdr.msg_flags & MSG_TRUNC) ||
+			(msg->msg_len >= net_message->maxsize))
+		{
+			Com_Printf("Oversize packet from %s\n", NET_AdrToString(*net_from));
+			batch->get++;
+			continue;
+		}
+
+		memcpy(net_message->data, batch->data[batch->get], msg->msg_len);
+		net_message->cursize = msg->msg_len;
+		batch->get++;
+
+		return true;
+	}
+}
+#endif
+
 qboolean
 NET_GetPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 {
@@ -530,6 +718,13 @@ NET_GetPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 		return true;
 	}
 
+#ifdef NET_MMSG
+	if ((sock == NS_SERVER) && net_mmsg && net_mmsg->value)
+	{
+		return NET_GetBatchedPacket(sock, net_from, net_message);
+	}
+#endif
+
 	for (protocol = 0; protocol < 3; protocol++)
 	{
 		if (protocol == 0)
@@ -584,6 +779,125 @@ NET_GetPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 	return false;
 }
 
+#ifdef NET_MMSG
+static void
+NET_FlushSendBatch(void)
+{
+	netbatch_t *batch;
+	int sent;
+
+	batch = net_sendbatch;
+
+	if (!batch)
+	{
+		return;
+	}
+
+	sent = 0;
+
+	while (sent < batch->count)
+	{
+		int ret;
+
+		ret = sendmmsg(batch->socket, batch->hdrs + sent,
+				batch->count - sent, 0);
+
+		if (ret > 0)
+		{
+			sent += ret;
+			continue;
+		}
+
+		/* report and skip the packet that failed */
+		if (ret == -1)
+		{
+			netadr_t to;
+
+			SockadrToNetadr(&batch->addrs[sent], &to);
+			Com_Printf("%s ERROR: %s to %s\n", NET_ErrorString(),
+					__func__, NET_AdrToString(to));
+		}
+
+		sent++;
+	}
+
+	batch->count = 0;
+}
+
+/*
+ * Queues the packet if a send batch is open. It's
+ * sent at the latest by NET_EndSendBatch().
+ */
+static qboolean
+NET_QueuePacket(int net_socket, int length, const void *data,
+		const struct sockaddr_storage *addr, int addr_size)
+{
+	struct msghdr *hdr;
+	netbatch_t *batch;
+	int i;
+
+	if (!net_sendbatching)
+	{
+		return false;
+	}
+
+	batch = NET_AllocBatch(&net_sendbatch);
+
+	if (!batch || (length > sizeof(batch->data[0])))
+	{
+		return false;
+	}
+
+	if ((batch->count == NET_BATCH) ||
+		(batch->count && (batch->socket != net_socket)))
+	{
+		NET_FlushSendBatch();
+	}
+
+	i = batch->count++;
+	batch->socket = net_socket;
+
+	memcpy(batch->data[i], data, length);
+	memcpy(&batch->addrs[i], addr, addr_size);
+
+	batch->iovs[i].iov_base = batch->data[i];
+	batch->iovs[i].iov_len = length;
+
+	hdr = &batch->hdrs[i].msg_hdr;
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->msg_name = &batch->addrs[i];
+	hdr->msg_namelen = addr_size;
+	hdr->msg_iov = &batch->iovs[i];
+	hdr->msg_iovlen = 1;
+
+	return true;
+}
+#endif
+
+/*
+ * While a send batch is open, packets of the server to
+ * other hosts are queued and sent with one system call.
+ */
+void
+NET_BeginSendBatch(netsrc_t sock)
+{
+#ifdef NET_MMSG
+	net_sendbatching = (sock == NS_SERVER) && net_mmsg && net_mmsg->value;
+#endif
+}
+
+void
+NET_EndSendBatch(netsrc_t sock)
+{
+#ifdef NET_MMSG
+	if (sock == NS_SERVER)
+	{
+		NET_FlushSendBatch();
+		net_sendbatching = false;
+	}
+#endif
+}
+
 void
 NET_SendPacket(netsrc_t sock, int length, const void *data, netadr_t to)
 {
@@ -724,6 +1038,14 @@ NET_SendPacket(netsrc_t sock, int length, const void *data, netadr_t to)
 		}
 	}
 
+#ifdef NET_MMSG
+	if ((sock == NS_SERVER) &&
+		NET_QueuePacket(net_socket, length, data, &addr, addr_size))
+	{
+		return;
+	}
+#endif
+
 	ret = sendto(net_socket,
 			data,
 			length,
@@ -781,6 +1103,21 @@ NET_Config(qboolean multiplayer)
 	{
 		int i;
 
+#ifdef NET_MMSG
+		/* queued packets and read ones of the old sockets */
+		NET_FlushSendBatch();
+
+		if (net_recvbatch)
+		{
+			net_recvbatch->get = net_recvbatch->count = 0;
+		}
+#endif
+
+#ifdef NET_EPOLL
+		/* the closed sockets vanish from the epoll set */
+		NET_ClosePoll();
+#endif
+
 		/* shut down any existing sockets */
 		for (i = 0; i < 2; i++)
 		{
@@ -996,34 +1333,210 @@ NET_ErrorString(void)
 	return strerror(code);
 }
 
+#ifdef NET_EPOLL
+static void
+NET_ClosePoll(void)
+{
+	int i;
+
+	if (net_epoll != -1)
+	{
+		close(net_epoll);
+		net_epoll = -1;
+	}
+
+	if (net_timer != -1)
+	{
+		close(net_timer);
+		net_timer = -1;
+	}
+
+	for (i = 0; i < NET_POLL_FDS; i++)
+	{
+		net_pollfds[i] = -1;
+	}
+}
+
+static qboolean
+NET_OpenPoll(void)
+{
+	struct epoll_event ev = {0};
+
+	if (net_epoll != -1)
+	{
+		return true;
+	}
+
+	if (net_pollfailed)
+	{
+		return false;
+	}
+
+	net_epoll = epoll_create1(EPOLL_CLOEXEC);
+	net_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	ev.events = EPOLLIN;
+	ev.data.fd = net_timer;
+
+	if ((net_epoll == -1) || (net_timer == -1) ||
+		(epoll_ctl(net_epoll, EPOLL_CTL_ADD, net_timer, &ev) == -1))
+	{
+		Com_Printf("%s: %s, falling back to select()\n", __func__,
+				NET_ErrorString());
+
+		NET_ClosePoll();
+		net_pollfailed = true;
+
+		return false;
+	}
+
+	return true;
+}
+
 /*
- * sleeps msec or until net socket is ready
+ * Adds and removes the sockets and stdin, so that only
+ * the wanted ones are in the epoll set.
+ */
+static void
+NET_UpdatePoll(qboolean network)
+{
+	extern qboolean stdin_active;
+	int want[NET_POLL_FDS];
+	int i;
+
+	/* 0 means no socket, but is stdin */
+	want[NET_POLL_STDIN] = stdin_active ? 0 : -1;
+	want[NET_POLL_IP] = (network && ip_sockets[NS_SERVER]) ?
+		ip_sockets[NS_SERVER] : -1;
+	want[NET_POLL_IP6] = (network && ip6_sockets[NS_SERVER]) ?
+		ip6_sockets[NS_SERVER] : -1;
+	want[NET_POLL_IPX] = (network && ipx_sockets[NS_SERVER]) ?
+		ipx_sockets[NS_SERVER] : -1;
+
+	for (i = 0; i < NET_POLL_FDS; i++)
+	{
+		struct epoll_event ev = {0};
+
+		if (net_pollfds[i] == want[i])
+		{
+			continue;
+		}
+
+		if (net_pollfds[i] != -1)
+		{
+			epoll_ctl(net_epoll, EPOLL_CTL_DEL, net_pollfds[i], &ev);
+			net_pollfds[i] = -1;
+		}
+
+		if (want[i] != -1)
+		{
+			ev.events = EPOLLIN;
+			ev.data.fd = want[i];
+
+			if (epoll_ctl(net_epoll, EPOLL_CTL_ADD, want[i], &ev) == 0)
+			{
+				net_pollfds[i] = want[i];
+			}
+		}
+	}
+}
+
+static qboolean
+NET_PollSleep(int usec, qboolean network)
+{
+	struct epoll_event events[NET_POLL_FDS + 1];
+	struct itimerspec its = {0};
+	uint64_t expirations;
+
+	if (!NET_OpenPoll())
+	{
+		return false;
+	}
+
+	NET_UpdatePoll(network);
+
+	its.it_value.tv_sec = usec / 1000000;
+	its.it_value.tv_nsec = (usec % 1000000) * 1000;
+
+	if (timerfd_settime(net_timer, 0, &its, NULL) == -1)
+	{
+		return false;
+	}
+
+	/* signals end the sleep early, like they did select() */
+	epoll_wait(net_epoll, events, ARRLEN(events), -1);
+
+	/* don't let an expiration wake up the next sleep */
+	if (read(net_timer, &expirations, sizeof(expirations)) == -1)
+	{
+		/* EAGAIN, woken up by something else */
+	}
+
+	return true;
+}
+#endif
+
+/*
+ * Sleeps usec or until stdin or, if network is set, a
+ * server socket is ready.
  */
 void
-NET_Sleep(int msec)
+NET_SleepUsec(int usec, qboolean network)
 {
 	struct timeval timeout;
 	fd_set fdset;
 	extern qboolean stdin_active;
+	int maxfd;
 
-	if ((!ip_sockets[NS_SERVER] &&
-		 !ip6_sockets[NS_SERVER]) || (dedicated && !dedicated->value))
+	if (usec <= 0)
 	{
-		return; /* we're not a server, just run full speed */
+		return;
 	}
 
+#ifdef NET_EPOLL
+	if (NET_PollSleep(usec, network))
+	{
+		return;
+	}
+#endif
+
 	FD_ZERO(&fdset);
+	maxfd = 0;
 
 	if (stdin_active)
 	{
 		FD_SET(0, &fdset); /* stdin is processed too */
 	}
 
-	FD_SET(ip_sockets[NS_SERVER], &fdset); /* IPv4 network socket */
-	FD_SET(ip6_sockets[NS_SERVER], &fdset); /* IPv6 network socket */
-	timeout.tv_sec = msec / 1000;
-	timeout.tv_usec = (msec % 1000) * 1000;
-	select(MAX(ip_sockets[NS_SERVER],
-					ip6_sockets[NS_SERVER]) + 1, &fdset, NULL, NULL, &timeout);
+	if (network && ip_sockets[NS_SERVER])
+	{
+		FD_SET(ip_sockets[NS_SERVER], &fdset); /* IPv4 network socket */
+		maxfd = MAX(maxfd, ip_sockets[NS_SERVER]);
+	}
+
+	if (network && ip6_sockets[NS_SERVER])
+	{
+		FD_SET(ip6_sockets[NS_SERVER], &fdset); /* IPv6 network socket */
+		maxfd = MAX(maxfd, ip6_sockets[NS_SERVER]);
+	}
+
+	timeout.tv_sec = usec / 1000000;
+	timeout.tv_usec = usec % 1000000;
+	select(maxfd + 1, &fdset, NULL, NULL, &timeout);
+}
+
+/*
+ * sleeps msec or until net socket is ready
+ */
+void
+NET_Sleep(int msec)
+{
+	if ((!ip_sockets[NS_SERVER] &&
+		 !ip6_sockets[NS_SERVER]) || (dedicated && !dedicated->value))
+	{
+		return; /* we're not a server, just run full speed */
+	}
+
+	NET_SleepUsec(msec * 1000, true);
 }
 
@@ -1263,6 +1263,68 @@ NET_Sleep(int msec)
 	select(i + 1, &fdset, NULL, NULL, &timeout);
 }
 
+/*
+ * Sleeps usec or until, if network is set, a server
+ * socket is ready. The console isn't watched here.
+ */
+void
+NET_SleepUsec(int usec, qboolean network)
+{
+	struct timeval timeout;
+	fd_set fdset;
+	int i;
+
+	if (usec <= 0)
+	{
+		return;
+	}
+
+	FD_ZERO(&fdset);
+
+	if (network && ip6_sockets[NS_SERVER])
+	{
+		FD_SET(ip6_sockets[NS_SERVER], &fdset); /* network socket */
+	}
+
+	if (network && ip_sockets[NS_SERVER])
+	{
+		FD_SET(ip_sockets[NS_SERVER], &fdset); /* network socket */
+	}
+
+	if (network && ipx_sockets[NS_SERVER])
+	{
+		FD_SET(ipx_sockets[NS_SERVER], &fdset); /* network socket */
+	}
+
+	/* select() fails without any socket */
+	if (!fdset.fd_count)
+	{
+		Sys_Nanosleep(usec * 1000);
+		return;
+	}
+
+	timeout.tv_sec = usec / 1000000;
+	timeout.tv_usec = usec % 1000000;
+	i = Q_max(ip_sockets[NS_SERVER], ip6_sockets[NS_SERVER]);
+	i = Q_max(i, ipx_sockets[NS_SERVER]);
+	select(i + 1, &fdset, NULL, NULL, &timeout);
+}
+
+/* =================================================================== */
+
+/*
+ * Packets are always sent one by one on Windows
+ */
+void
+NET_BeginSendBatch(netsrc_t sock)
+{
+}
+
+void
+NET_EndSendBatch(netsrc_t sock)
+{
+}
+
 /* =================================================================== */
 
 void
@@ -304,6 +304,12 @@ CL_Disconnect(void)
 					cl.timedemo_frames, time / 1000.0,
 					cl.timedemo_frames * 1000.0 / time);
 		}
+
+		/* the software renderer times its phases */
+		if (Cmd_Exists("sw_benchmark"))
+		{
+			Cbuf_AddText("sw_benchmark\n");
+		}
 	}
 
 	VectorClear(cl.refdef.blend);
@@ -222,6 +222,7 @@ typedef struct surfcache_s
 	unsigned	height;            /* DEBUG only needed for debug */
 	float	mipscale;
 	struct image_s	*image;
+	int	batch;                     /* span batch it was last used in */
 	byte	data[4];               /* width * height elements */
 } surfcache_t;
 
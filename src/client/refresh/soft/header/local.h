@@ -306,12 +306,28 @@ extern float	d_sdivzstepu, d_tdivzstepu;
 extern float	d_sdivzstepv, d_tdivzstepv;
 extern float	d_sdivzorigin, d_tdivzorigin;
 
-void D_DrawSpansPow2(const espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zistepv);
+/* texture and gradients of a surface, passed to the span drawers */
+typedef struct
+{
+	pixel_t	*cacheblock;
+	int	cachewidth;
+	float	sdivzstepu, tdivzstepu;
+	float	sdivzstepv, tdivzstepv;
+	float	sdivzorigin, tdivzorigin;
+	float	ziorigin, zistepu, zistepv;
+	int	sadjust, tadjust;
+	int	bbextents, bbextentt;
+} spangrad_t;
+
+void D_DrawSpansPow2(const espan_t *pspan, const espan_t *pend, const spangrad_t *grad);
 void D_DrawZSpans(const espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zistepv);
-void TurbulentPow2(espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zistepv);
-void NonTurbulentPow2(espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zistepv);
+void TurbulentPow2(const espan_t *pspan, const espan_t *pend, const spangrad_t *grad);
+void NonTurbulentPow2(const espan_t *pspan, const espan_t *pend, const spangrad_t *grad);
 
 surfcache_t *D_CacheSurface(const entity_t *currententity, msurface_t *surface, int miplevel);
+void D_SCBatchBegin(void);
+void D_SCBatchEnd(void);
+qboolean D_SCBatchFull(const msurface_t *surface, int miplevel);
 
 extern int	d_vrectx, d_vrecty, d_vrectright_particle, d_vrectbottom_particle;
 
@@ -375,6 +391,7 @@ extern cvar_t	*sw_surfcacheoverride;
 extern cvar_t	*sw_waterwarp;
 extern cvar_t	*sw_gunzposition;
 extern cvar_t	*sw_colorlight;
+extern cvar_t	*sw_framehash;
 
 //=============================================================================
 
@@ -481,6 +498,39 @@ void R_AliasProjectAndClipTestFinalVert(finalvert_t *fv);
 void R_PrintAliasStats(void);
 void R_PrintTimes(void);
 void R_PrintDSpeeds(void);
+
+/* phases of a frame timed for sw_benchmark */
+typedef enum
+{
+	BENCH_OTHER,
+	BENCH_BSP,
+	BENCH_EDGES,
+	BENCH_SPANS,
+	BENCH_SURFCACHE,
+	BENCH_ALIAS,
+	BENCH_PARTICLES,
+	BENCH_COPYFRAME,
+	BENCH_NUMPHASES
+} benchphase_t;
+
+void R_BenchFrameBegin(void);
+void R_BenchFrameEnd(void);
+void R_BenchBegin(benchphase_t phase);
+void R_BenchEnd(void);
+void R_BenchHash(const unsigned *pixels, int count);
+void R_BenchClear(void);
+void R_Benchmark_f(void);
+
+void R_PaletteToColor(unsigned *dst, const byte *src, int count,
+	const unsigned *palette);
+
+/* worker pool for sw_threads */
+typedef void (*r_job_t)(int item, void *data);
+
+void R_InitWorkers(void);
+void R_ShutdownWorkers(void);
+int R_NumWorkers(void);
+void R_RunWorkers(r_job_t job, void *data, int count);
 void R_SetupFrame(void);
 
 extern  surfcache_t	*sc_base;
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Expansion of the 8 bit frame to 32 bit colors. The SIMD versions
+ * are picked at runtime and give exactly the same result as the
+ * plain C loop.
+ *
+ * =======================================================================
+ */
+
+#ifdef USE_SDL3
+#include <SDL3/SDL.h>
+#else
+#include <SDL2/SDL.h>
+#endif
+
+#include "header/local.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define COPY_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define COPY_TARGET(x) __attribute__((target(x)))
+#else
+#define COPY_TARGET(x)
+#endif
+
+typedef void (*palettetocolor_t)(unsigned *dst, const byte *src, int count,
+	const unsigned *palette);
+
+static palettetocolor_t palette_to_color;
+
+static void
+R_PaletteToColorC(unsigned *dst, const byte *src, int count,
+	const unsigned *palette)
+{
+	const byte *src_max;
+
+	src_max = src + count;
+
+	while (src < src_max)
+	{
+		*dst = palette[*src];
+
+		src++;
+		dst++;
+	}
+}
+
+#ifdef COPY_X86
+
+/*
+ * No gather before AVX2, but building the colors in a
+ * register still saves most of the single stores.
+ */
+COPY_TARGET("sse4.1") static void
+R_PaletteToColorSSE41(unsigned *dst, const byte *src, int count,
+	const unsigned *palette)
+{
+	int i;
+
+	for (i = 0; i + 16 <= count; i += 16)
+	{
+		__m128i idx, px;
+
+		idx = _mm_loadu_si128((const __m128i *)(src + i));
+
+		px = _mm_cvtsi32_si128(palette[_mm_extract_epi8(idx, 0)]);
+		px = _mm_insert_epi32(px, palette[_mm_extract_epi8(idx, 1)], 1);
+		px = _mm_insert_epi32(px, palette[_mm_extract_epi8(idx, 2)], 2);
+		px = _mm_insert_epi32(px, palette[_mm_extract_epi8(idx, 3)], 3);
+		_mm_storeu_si128((__m128i *)(dst + i), px);
+
+		px = _mm_cvtsi32_si128(palette[_mm_extract_epi8(idx, 4)]);
+		px = _mm_insert_epi32(px, palette[_mm_extract_epi8(idx, 5)], 1);
+		px = _mm_insert_epi32(px, palette[_mm_extract_epi8(idx, 6)], 2);
+		px = _mm_insert_epi32(px, palette[_mm_extract_epi8(idx, 7)], 3);
+		_mm_storeu_si128((__m128i *)(dst + i + 4), px);
+
+		px = _mm_cvtsi32_si128(palette[_mm_extract_epi8(idx, 8)]);
+		px = _mm_insert_epi32(px, palette[_mm_extract_epi8(idx, 9)], 1);
+		px = _mm_insert_epi32(px, palette[_mm_extract_epi8(idx, 10)], 2);
+		px = _mm_insert_epi32(px, palette[_mm_extract_epi8(idx, 11)], 3);
+		_mm_storeu_si128((__m128i *)(dst + i + 8), px);
+
+		px = _mm_cvtsi32_si128(palette[_mm_extract_epi8(idx, 12)]);
+		px = _mm_insert_epi32(px, palette[_mm_extract_epi8(idx, 13)], 1);
+		px = _mm_insert_epi32(px, palette[_mm_extract_epi8(idx, 14)], 2);
+		px = _mm_insert_epi32(px, palette[_mm_extract_epi8(idx, 15)], 3);
+		_mm_storeu_si128((__m128i *)(dst + i + 12), px);
+	}
+
+	R_PaletteToColorC(dst + i, src + i, count - i, palette);
+}
+
+COPY_TARGET("avx2") static void
+R_PaletteToColorAVX2(unsigned *dst, const byte *src, int count,
+	const unsigned *palette)
+{
+	int i;
+
+	for (i = 0; i + 16 <= count; i += 16)
+	{
+		__m128i idx;
+		__m256i lo, hi;
+
+		idx = _mm_loadu_si128((const __m128i *)(src + i));
+
+		lo = _mm256_i32gather_epi32((const int *)palette,
+			_mm256_cvtepu8_epi32(idx), 4);
+		hi = _mm256_i32gather_epi32((const int *)palette,
+			_mm256_cvtepu8_epi32(_mm_srli_si128(idx, 8)), 4);
+
+		_mm256_storeu_si256((__m256i *)(dst + i), lo);
+		_mm256_storeu_si256((__m256i *)(dst + i + 8), hi);
+	}
+
+	R_PaletteToColorC(dst + i, src + i, count - i, palette);
+}
+
+#endif
+
+static void
+R_PaletteToColorSelect(void)
+{
+#ifdef COPY_X86
+	if (SDL_HasAVX2())
+	{
+		palette_to_color = R_PaletteToColorAVX2;
+		return;
+	}
+
+	if (SDL_HasSSE41())
+	{
+		palette_to_color = R_PaletteToColorSSE41;
+		return;
+	}
+#endif
+
+	palette_to_color = R_PaletteToColorC;
+}
+
+/*
+ * Writes the colors of count 8 bit pixels to dst.
+ */
+void
+R_PaletteToColor(unsigned *dst, const byte *src, int count,
+	const unsigned *palette)
+{
+	if (!palette_to_color)
+	{
+		R_PaletteToColorSelect();
+	}
+
+	palette_to_color(dst, src, count, palette);
+}
@@ -51,7 +51,6 @@ static edge_t	edge_tail;
 static edge_t	edge_aftertail;
 static edge_t	edge_sentinel;
 static float	fv;
-static int	miplevel;
 
 float	scale_for_mip;
 
@@ -719,11 +718,38 @@ SURFACE FILLING
 =========================================================================
 */
 
-static msurface_t		*pface;
-static surfcache_t		*pcurrentcache;
 static vec3_t			transformed_modelorg;
 static vec3_t			world_transformed_modelorg;
 
+/* how the spans of a surface are filled */
+typedef enum
+{
+	DRAW_FLAT,
+	DRAW_POW2,
+	DRAW_TURB,
+	DRAW_NONTURB
+} drawtype_t;
+
+typedef struct
+{
+	drawtype_t	type;
+	pixel_t		color;
+	const espan_t	*spans;
+	spangrad_t	grad;
+} drawitem_t;
+
+/*
+ * Surfaces waiting for the span workers with sw_threads. The
+ * workers split the screen in horizontal bands, so each span
+ * is drawn by exactly one of them.
+ */
+#define MAX_DRAWITEMS 1024
+
+static drawitem_t	drawitems[MAX_DRAWITEMS];
+static int		numdrawitems;
+static int		numdrawbands;
+static int		drawbandheight;
+
 /*
 =============
 D_MipLevelForScale
@@ -752,17 +778,17 @@ D_MipLevelForScale (float scale)
 
 /*
 ==============
-D_FlatFillSurface
+D_FlatFillSpans
 
 Simple single color fill with no texture mapping
 ==============
 */
 static void
-D_FlatFillSurface (surf_t *surf, pixel_t color)
+D_FlatFillSpans (const espan_t *pspan, const espan_t *pend, pixel_t color)
 {
-	espan_t	*span;
+	const espan_t	*span;
 
-	for (span=surf->spans ; span ; span=span->pnext)
+	for (span=pspan ; span != pend ; span=span->pnext)
 	{
 		pixel_t   *pdest;
 
@@ -778,7 +804,8 @@ D_CalcGradients
 ==============
 */
 static void
-D_CalcGradients (msurface_t *pface, float d_ziorigin, float d_zistepu, float d_zistepv)
+D_CalcGradients (const msurface_t *pface, int miplevel, const surf_t *s,
+	spangrad_t *grad)
 {
 	float		mipscale;
 	vec3_t		p_temp1;
@@ -791,25 +818,29 @@ D_CalcGradients (msurface_t *pface, float d_ziorigin, float d_zistepu, float d_z
 	TransformVector(pface->texinfo->vecs[1], p_taxis);
 
 	t = xscaleinv * mipscale;
-	d_sdivzstepu = p_saxis[0] * t;
-	d_tdivzstepu = p_taxis[0] * t;
+	grad->sdivzstepu = p_saxis[0] * t;
+	grad->tdivzstepu = p_taxis[0] * t;
 
 	t = yscaleinv * mipscale;
-	d_sdivzstepv = -p_saxis[1] * t;
-	d_tdivzstepv = -p_taxis[1] * t;
+	grad->sdivzstepv = -p_saxis[1] * t;
+	grad->tdivzstepv = -p_taxis[1] * t;
+
+	grad->sdivzorigin = p_saxis[2] * mipscale - xcenter * grad->sdivzstepu -
+			ycenter * grad->sdivzstepv;
+	grad->tdivzorigin = p_taxis[2] * mipscale - xcenter * grad->tdivzstepu -
+			ycenter * grad->tdivzstepv;
 
-	d_sdivzorigin = p_saxis[2] * mipscale - xcenter * d_sdivzstepu -
-			ycenter * d_sdivzstepv;
-	d_tdivzorigin = p_taxis[2] * mipscale - xcenter * d_tdivzstepu -
-			ycenter * d_tdivzstepv;
+	grad->ziorigin = s->d_ziorigin;
+	grad->zistepu = s->d_zistepu;
+	grad->zistepv = s->d_zistepv;
 
 	VectorScale (transformed_modelorg, mipscale, p_temp1);
 
 	t = SHIFT16XYZ_MULT * mipscale;
-	sadjust = ((int)(DotProduct(p_temp1, p_saxis) * SHIFT16XYZ_MULT + 0.5)) -
+	grad->sadjust = ((int)(DotProduct(p_temp1, p_saxis) * SHIFT16XYZ_MULT + 0.5)) -
 			((pface->texturemins[0] << SHIFT16XYZ) >> miplevel)
 			+ pface->texinfo->vecs[0][3]*t;
-	tadjust = ((int)(DotProduct(p_temp1, p_taxis) * SHIFT16XYZ_MULT + 0.5)) -
+	grad->tadjust = ((int)(DotProduct(p_temp1, p_taxis) * SHIFT16XYZ_MULT + 0.5)) -
 			((pface->texturemins[1] << SHIFT16XYZ) >> miplevel)
 			+ pface->texinfo->vecs[1][3]*t;
 
@@ -819,17 +850,96 @@ D_CalcGradients (msurface_t *pface, float d_ziorigin, float d_zistepu, float d_z
 		float sscroll, tscroll;
 
 		R_FlowingScroll(&r_newrefdef, pface->texinfo->flags, &sscroll, &tscroll);
-		sadjust += SHIFT16XYZ_MULT * 2 * sscroll;
-		tadjust += SHIFT16XYZ_MULT * 2 * tscroll;
+		grad->sadjust += SHIFT16XYZ_MULT * 2 * sscroll;
+		grad->tadjust += SHIFT16XYZ_MULT * 2 * tscroll;
 	}
 
 	//
 	// -1 (-epsilon) so we never wander off the edge of the texture
 	//
-	bbextents = ((pface->extents[0] << SHIFT16XYZ) >> miplevel) - 1;
-	bbextentt = ((pface->extents[1] << SHIFT16XYZ) >> miplevel) - 1;
+	grad->bbextents = ((pface->extents[0] << SHIFT16XYZ) >> miplevel) - 1;
+	grad->bbextentt = ((pface->extents[1] << SHIFT16XYZ) >> miplevel) - 1;
+}
+
+/*
+==============
+D_DrawItem
+
+Fills the spans from pspan up to pend of a surface
+==============
+*/
+static void
+D_DrawItem (const drawitem_t *item, const espan_t *pspan, const espan_t *pend)
+{
+	switch (item->type)
+	{
+		case DRAW_FLAT:
+			D_FlatFillSpans (pspan, pend, item->color);
+			break;
+		case DRAW_POW2:
+			D_DrawSpansPow2 (pspan, pend, &item->grad);
+			break;
+		case DRAW_TURB:
+			TurbulentPow2 (pspan, pend, &item->grad);
+			break;
+		case DRAW_NONTURB:
+			NonTurbulentPow2 (pspan, pend, &item->grad);
+			break;
+	}
 }
 
+/*
+==============
+D_DrawBand
+
+Worker job, fills all spans of the batch inside of a band
+==============
+*/
+static void
+D_DrawBand (int band, void *data)
+{
+	int	top, bottom, i;
+
+	top = r_refdef.vrect.y + band * drawbandheight;
+	bottom = top + drawbandheight;
+
+	for (i = 0; i < numdrawitems; i++)
+	{
+		const drawitem_t	*item = &drawitems[i];
+		const espan_t	*pspan, *pend;
+
+		// span lists are linked from the bottom scan line up
+		pspan = item->spans;
+		while (pspan && pspan->v >= bottom)
+			pspan = pspan->pnext;
+
+		pend = pspan;
+		while (pend && pend->v >= top)
+			pend = pend->pnext;
+
+		if (pspan != pend)
+			D_DrawItem (item, pspan, pend);
+	}
+}
+
+/*
+==============
+D_FlushDrawItems
+
+Lets the workers draw all waiting surfaces
+==============
+*/
+static void
+D_FlushDrawItems (void)
+{
+	if (!numdrawitems)
+		return;
+
+	R_RunWorkers (D_DrawBand, NULL, numdrawbands);
+
+	numdrawitems = 0;
+	D_SCBatchBegin ();
+}
 
 /*
 ==============
@@ -838,13 +948,16 @@ D_BackgroundSurf
 The grey background filler seen when there is a hole in the map
 ==============
 */
-static void
-D_BackgroundSurf (surf_t *s)
+static qboolean
+D_BackgroundSurf (surf_t *s, drawitem_t *item)
 {
-	D_FlatFillSurface (s, (int)sw_clearcolor->value & 0xFF);
+	item->type = DRAW_FLAT;
+	item->color = (int)sw_clearcolor->value & 0xFF;
 	// set up a gradient for the background surface that places it
 	// effectively at infinity distance from the viewpoint
 	D_DrawZSpans (s->spans, -0.9, 0, 0);
+
+	return true;
 }
 
 /*
@@ -852,13 +965,14 @@ D_BackgroundSurf (surf_t *s)
 D_TurbulentSurf
 =================
 */
-static void
-D_TurbulentSurf(surf_t *s)
+static qboolean
+D_TurbulentSurf(surf_t *s, drawitem_t *item)
 {
+	msurface_t *pface;
+
 	pface = s->msurf;
-	miplevel = 0;
-	cacheblock = pface->texinfo->image->pixels[0];
-	cachewidth = 64;
+	item->grad.cacheblock = pface->texinfo->image->pixels[0];
+	item->grad.cachewidth = 64;
 
 	if (s->insubmodel)
 	{
@@ -876,14 +990,14 @@ D_TurbulentSurf(surf_t *s)
 						// make entity passed in
 	}
 
-	D_CalcGradients (pface, s->d_ziorigin, s->d_zistepu, s->d_zistepv);
+	D_CalcGradients (pface, 0, s, &item->grad);
 
 	//============
 	// textures that aren't warping are just flowing. Use NonTurbulentPow2 instead
 	if (!(pface->texinfo->flags & SURF_WARP))
-		NonTurbulentPow2 (s->spans, s->d_ziorigin, s->d_zistepu, s->d_zistepv);
+		item->type = DRAW_NONTURB;
 	else
-		TurbulentPow2 (s->spans, s->d_ziorigin, s->d_zistepu, s->d_zistepv);
+		item->type = DRAW_TURB;
 	//============
 
 	D_DrawZSpans (s->spans, s->d_ziorigin, s->d_zistepu, s->d_zistepv);
@@ -902,6 +1016,8 @@ D_TurbulentSurf(surf_t *s)
 		VectorCopy(base_vright, vright);
 		R_TransformFrustum(modelorg, vright, vup, vpn);
 	}
+
+	return true;
 }
 
 /*
@@ -909,23 +1025,25 @@ D_TurbulentSurf(surf_t *s)
 D_SkySurf
 ==============
 */
-static void
-D_SkySurf (surf_t *s)
+static qboolean
+D_SkySurf (surf_t *s, drawitem_t *item)
 {
+	msurface_t *pface;
+
 	pface = s->msurf;
-	miplevel = 0;
 	if (!pface->texinfo->image)
-		return;
-	cacheblock = pface->texinfo->image->pixels[0];
-	cachewidth = 256;
-
-	D_CalcGradients (pface, s->d_ziorigin, s->d_zistepu, s->d_zistepv);
+		return false;
+	item->type = DRAW_POW2;
+	item->grad.cacheblock = pface->texinfo->image->pixels[0];
+	item->grad.cachewidth = 256;
 
-	D_DrawSpansPow2 (s->spans, s->d_ziorigin, s->d_zistepu, s->d_zistepv);
+	D_CalcGradients (pface, 0, s, &item->grad);
 
 	// set up a gradient for the background surface that places it
 	// effectively at infinity distance from the viewpoint
 	D_DrawZSpans (s->spans, -0.9, 0, 0);
+
+	return true;
 }
 
 /*
@@ -935,10 +1053,13 @@ D_SolidSurf
 Normal surface cached, texture mapped surface
 ==============
 */
-static void
-D_SolidSurf (entity_t *currententity, surf_t *s)
+static qboolean
+D_SolidSurf (entity_t *currententity, surf_t *s, drawitem_t *item)
 {
 	float len1, len2, mipadjust;
+	msurface_t *pface;
+	surfcache_t *pcurrentcache;
+	int miplevel;
 
 	if (s->insubmodel)
 	{
@@ -965,15 +1086,17 @@ D_SolidSurf (entity_t *currententity, surf_t *s)
 	}
 	miplevel = D_MipLevelForScale(s->nearzi * scale_for_mip * mipadjust);
 
-	// FIXME: make this passed in to D_CacheSurface
-	pcurrentcache = D_CacheSurface (currententity, pface, miplevel);
+	// the waiting surfaces must be drawn before their cache is reused
+	if (numdrawitems && D_SCBatchFull(pface, miplevel))
+		D_FlushDrawItems ();
 
-	cacheblock = (pixel_t *)pcurrentcache->data;
-	cachewidth = pcurrentcache->width;
+	pcurrentcache = D_CacheSurface (currententity, pface, miplevel);
 
-	D_CalcGradients (pface, s->d_ziorigin, s->d_zistepu, s->d_zistepv);
+	item->type = DRAW_POW2;
+	item->grad.cacheblock = (pixel_t *)pcurrentcache->data;
+	item->grad.cachewidth = pcurrentcache->width;
 
-	D_DrawSpansPow2 (s->spans, s->d_ziorigin, s->d_zistepu, s->d_zistepv);
+	D_CalcGradients (pface, miplevel, s, &item->grad);
 
 	D_DrawZSpans (s->spans, s->d_ziorigin, s->d_zistepu, s->d_zistepv);
 
@@ -991,6 +1114,8 @@ D_SolidSurf (entity_t *currententity, surf_t *s)
 		VectorCopy(base_vright, vright);
 		R_TransformFrustum(modelorg, vright, vup, vpn);
 	}
+
+	return true;
 }
 
 /*
@@ -1013,7 +1138,7 @@ D_DrawflatSurfaces (const surf_t *surface)
 
 		// make a stable color for each surface by taking the low
 		// bits of the msurface pointer
-		D_FlatFillSurface (s, color & 0xFF);
+		D_FlatFillSpans (s->spans, NULL, color & 0xFF);
 		D_DrawZSpans (s->spans, s->d_ziorigin, s->d_zistepu, s->d_zistepv);
 
 		color ++;
@@ -1026,11 +1151,16 @@ D_DrawSurfaces
 
 Rasterize all the span lists.  Guaranteed zero overdraw.
 May be called more than once a frame if the surf list overflows (higher res)
+
+The z spans and surface caches are done in order on the main thread,
+with sw_threads the texture spans are batched up for the workers.
 ==============
 */
 static void
 D_DrawSurfaces(entity_t *currententity, const surf_t *surface)
 {
+	R_BenchBegin(BENCH_SPANS);
+
 	VectorSubtract(r_origin, vec3_origin, modelorg);
 	TransformVector(modelorg, transformed_modelorg);
 	VectorCopy(transformed_modelorg, world_transformed_modelorg);
@@ -1038,22 +1168,58 @@ D_DrawSurfaces(entity_t *currententity, const surf_t *surface)
 	if (!sw_drawflat->value)
 	{
 		surf_t *s;
+		int workers;
+
+		workers = R_NumWorkers();
+		if (workers)
+		{
+			numdrawbands = Q_min((workers + 1) * 4, r_refdef.vrect.height);
+			numdrawbands = Q_max(numdrawbands, 1);
+			drawbandheight = (r_refdef.vrect.height + numdrawbands - 1) /
+				numdrawbands;
+
+			D_SCBatchBegin();
+		}
 
 		for (s = &surfaces[1] ; s<surface ; s++)
 		{
+			drawitem_t item;
+			qboolean draw = false;
+
 			if (!s->spans)
 				continue;
 
 			r_drawnpolycount++;
 
+			item.spans = s->spans;
+
 			if (! (s->flags & (SURF_DRAWSKY|SURF_DRAWBACKGROUND|SURF_DRAWTURB) ) )
-				D_SolidSurf (currententity, s);
+				draw = D_SolidSurf (currententity, s, &item);
 			else if (s->flags & SURF_DRAWSKY)
-				D_SkySurf (s);
+				draw = D_SkySurf (s, &item);
 			else if (s->flags & SURF_DRAWBACKGROUND)
-				D_BackgroundSurf (s);
+				draw = D_BackgroundSurf (s, &item);
 			else if (s->flags & SURF_DRAWTURB)
-				D_TurbulentSurf (s);
+				draw = D_TurbulentSurf (s, &item);
+
+			if (!draw)
+				continue;
+
+			if (!workers)
+			{
+				D_DrawItem (&item, item.spans, NULL);
+				continue;
+			}
+
+			drawitems[numdrawitems++] = item;
+			if (numdrawitems == MAX_DRAWITEMS)
+				D_FlushDrawItems ();
+		}
+
+		if (workers)
+		{
+			D_FlushDrawItems ();
+			D_SCBatchEnd ();
 		}
 	}
 	else
@@ -1061,4 +1227,6 @@ D_DrawSurfaces(entity_t *currententity, const surf_t *surface)
 
 	VectorSubtract(r_origin, vec3_origin, modelorg);
 	R_TransformFrustum(modelorg, vright, vup, vpn);
+
+	R_BenchEnd();
 }
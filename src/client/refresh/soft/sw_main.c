@@ -138,6 +138,8 @@ cvar_t	*sw_custom_particles;
 cvar_t	*sw_texture_filtering;
 cvar_t	*sw_gunzposition;
 static cvar_t	*sw_partialrefresh;
+static cvar_t	*sw_headless;
+cvar_t	*sw_framehash;
 
 // sw_vars.c
 
@@ -362,10 +364,13 @@ R_RegisterVariables(void)
 
 	sw_colorlight = ri.Cvar_Get("sw_colorlight", "0", CVAR_ARCHIVE);
 	sw_dspeeds = ri.Cvar_Get("sw_dspeeds", "0", 0);
+	sw_headless = ri.Cvar_Get("sw_headless", "0", 0);
+	sw_framehash = ri.Cvar_Get("sw_framehash", "0", 0);
 
 	ri.Cmd_AddCommand("modellist", Mod_Modellist_f);
 	ri.Cmd_AddCommand("screenshot", R_ScreenShot_f);
 	ri.Cmd_AddCommand("imagelist", R_ImageList_f);
+	ri.Cmd_AddCommand("sw_benchmark", R_Benchmark_f);
 
 	r_mode->modified = true; // force us to do mode specific stuff later
 	vid_gamma->modified = true; // force us to rebuild the gamma table later
@@ -378,6 +383,7 @@ R_UnRegister(void)
 	ri.Cmd_RemoveCommand( "screenshot" );
 	ri.Cmd_RemoveCommand( "modellist" );
 	ri.Cmd_RemoveCommand( "imagelist" );
+	ri.Cmd_RemoveCommand( "sw_benchmark" );
 }
 
 static void RE_ShutdownContext(void);
@@ -395,6 +401,7 @@ static qboolean
 RE_Init(void)
 {
 	R_RegisterVariables ();
+	R_InitWorkers ();
 	R_VertBufferInit();
 	R_InitImages ();
 	Mod_Init ();
@@ -435,6 +442,9 @@ RE_Shutdown
 static void
 RE_Shutdown(void)
 {
+	// stop the span workers before freeing their buffers
+	R_ShutdownWorkers ();
+
 	// free z buffer
 	if (d_pzbuffer)
 	{
@@ -741,7 +751,9 @@ R_DrawEntitiesOnList(qboolean translucent)
 					break;
 
 				case mod_alias:
+					R_BenchBegin(BENCH_ALIAS);
 					R_DrawAliasModel(currententity, currentmodel);
+					R_BenchEnd();
 					break;
 
 				case mod_brush:
@@ -795,7 +807,9 @@ R_DrawEntitiesOnList(qboolean translucent)
 					break;
 
 				case mod_alias:
+					R_BenchBegin(BENCH_ALIAS);
 					R_DrawAliasModel(currententity, currentmodel);
+					R_BenchEnd();
 					break;
 
 				case mod_brush:
@@ -1123,6 +1137,7 @@ R_EdgeDrawing(entity_t *currententity)
 
 	// Build the Global Edget Table
 	// Also populate the surface stack and count # surfaces to render (surf_max is the max)
+	R_BenchBegin(BENCH_BSP);
 	R_DrawWorld();
 
 	if (sw_dspeeds->value)
@@ -1132,6 +1147,7 @@ R_EdgeDrawing(entity_t *currententity)
 	}
 
 	R_DrawBEntitiesOnList();
+	R_BenchEnd();
 
 	if (sw_dspeeds->value)
 	{
@@ -1141,7 +1157,9 @@ R_EdgeDrawing(entity_t *currententity)
 
 	// Use the Global Edge Table to maintin the Active Edge Table: Draw the world as scanlines
 	// Write the Z-Buffer (but no read)
+	R_BenchBegin(BENCH_EDGES);
 	R_ScanEdges(currententity, surface_p);
+	R_BenchEnd();
 }
 
 //=======================================================================
@@ -1347,7 +1365,9 @@ RE_RenderFrame(const refdef_t *fd)
 	}
 
 	// Duh !
+	R_BenchBegin(BENCH_PARTICLES);
 	R_DrawParticles();
+	R_BenchEnd();
 
 	if (sw_dspeeds->value)
 	{
@@ -1433,6 +1453,8 @@ static rserr_t	SWimp_SetMode(int *pwidth, int *pheight, int mode, int fullscreen
 static void
 RE_BeginFrame(float camera_separation)
 {
+	R_BenchFrameBegin();
+
 	/* pallete without changes */
 	palette_changed = false;
 	/* run without speed optimization */
@@ -1705,6 +1727,46 @@ static SDL_Window	*window = NULL;
 static SDL_Texture	*texture = NULL;
 static SDL_Renderer	*renderer = NULL;
 
+/* Used instead of the texture with sw_headless, the
+   frames are converted but never shown. */
+static Uint32	*headless_pixels = NULL;
+
+/*
+ * Returns the pixels of the rows in rect (all if NULL)
+ * of the texture or the headless frame.
+ */
+static qboolean
+RE_LockFrame(const SDL_Rect *rect, Uint32 **pixels, int *pitch)
+{
+	if (headless_pixels)
+	{
+		*pixels = headless_pixels + (rect ? rect->y * vid_buffer_width : 0);
+		*pitch = vid_buffer_width * sizeof(Uint32);
+		return true;
+	}
+
+#ifdef USE_SDL3
+	if (!SDL_LockTexture(texture, rect, (void**)pixels, pitch))
+#else
+	if (SDL_LockTexture(texture, rect, (void**)pixels, pitch))
+#endif
+	{
+		Com_Printf("Can't lock texture: %s\n", SDL_GetError());
+		return false;
+	}
+
+	return true;
+}
+
+static void
+RE_UnlockFrame(void)
+{
+	if (!headless_pixels)
+	{
+		SDL_UnlockTexture(texture);
+	}
+}
+
 /*
 ===============
 RE_RegisterSkin
@@ -1770,19 +1832,14 @@ RE_Draw_StretchRawColor(int x, int y, int w, int h, int cols, int rows,
 	}
 
 	/* Full screen update should be faster */
-#ifdef USE_SDL3
-	if (!SDL_LockTexture(texture, NULL, (void**)&pixels, &pitch))
-#else
-	if (SDL_LockTexture(texture, NULL, (void**)&pixels, &pitch))
-#endif
+	if (!RE_LockFrame(NULL, &pixels, &pitch))
 	{
-		Com_Printf("Can't lock texture: %s\n", SDL_GetError());
 		return;
 	}
 
 	if ((pitch / sizeof(Uint32)) != vid_buffer_width)
 	{
-		SDL_UnlockTexture(texture);
+		RE_UnlockFrame();
 		Com_Printf("Different pitch in texture %d != %d\n",
 			pitch, vid_buffer_width);
 		return;
@@ -1805,7 +1862,7 @@ RE_Draw_StretchRawColor(int x, int y, int w, int h, int cols, int rows,
 #endif
 	}
 
-	SDL_UnlockTexture(texture);
+	RE_UnlockFrame();
 
 	texture_high_color = true;
 }
@@ -1901,6 +1958,30 @@ RE_InitContext(void *win)
 	snprintf(title, sizeof(title), "Yamagi Quake II %s - Soft Render", YQ2VERSION);
 	SDL_SetWindowTitle(window, title);
 
+	if (sw_headless->value)
+	{
+		/* no renderer or texture, e.g. for benchmarks
+		   without a GPU */
+		vid_buffer_height = vid.height;
+		vid_buffer_width = vid.width;
+
+		headless_pixels = malloc(vid_buffer_width * vid_buffer_height *
+			sizeof(Uint32));
+
+		if (!headless_pixels)
+		{
+			Com_Printf("Can't allocate headless frame\n");
+			return false;
+		}
+
+		Com_Printf("Rendering headless, nothing is shown.\n");
+
+		R_InitGraphics(vid_buffer_width, vid_buffer_height);
+		SWimp_CreateRender(vid_buffer_width, vid_buffer_height);
+
+		return true;
+	}
+
 	if (r_vsync->value)
 	{
 #ifdef USE_SDL3
@@ -1993,6 +2074,13 @@ RE_InitContext(void *win)
  */
 void RE_GetDrawableSize(int* width, int* height)
 {
+	if (headless_pixels)
+	{
+		*width = vid_buffer_width;
+		*height = vid_buffer_height;
+		return;
+	}
+
 #ifdef USE_SDL3
 	SDL_GetCurrentRenderOutputSize(renderer, width, height);
 #else
@@ -2110,6 +2198,12 @@ RE_ShutdownContext(void)
 	}
 	r_warpbuffer = NULL;
 
+	if (headless_pixels)
+	{
+		free(headless_pixels);
+	}
+	headless_pixels = NULL;
+
 	if (texture)
 	{
 		SDL_DestroyTexture(texture);
@@ -2133,54 +2227,115 @@ static void
 RE_CopyFrame(Uint32 *pixels, int pitch, SDL_Rect *rect)
 {
 	const unsigned *sdl_palette;
+	const byte *src;
 
 	sdl_palette = (unsigned *)sw_state.currentpalette;
+	src = vid_buffer + rect->y * vid_buffer_width;
 
 	/* no gaps between images rows */
 	if (pitch == vid_buffer_width)
 	{
-		const byte *src_max;
-		Uint32 *dst;
-		byte *src;
-
-		dst = pixels;
-		src = vid_buffer + rect->y * vid_buffer_width;
-		src_max = src + rect->h * vid_buffer_width;
+		R_PaletteToColor(pixels, src, rect->h * vid_buffer_width,
+			sdl_palette);
+	}
+	else
+	{
+		int y;
 
-		while (src < src_max)
+		for (y = 0; y < rect->h; y++)
 		{
-			*dst = sdl_palette[*src];
-
-			src++;
-			dst++;
+			R_PaletteToColor(pixels + y * pitch, src + y * vid_buffer_width,
+				vid_buffer_width, sdl_palette);
 		}
 	}
-	else
+
+	if ((r_anisotropic->value > 0) && !fastmoving)
 	{
-		int y, buffer_pos;
-		Uint32 *dst;
+		SmoothColorImage((unsigned *)pixels, rect->h * vid_buffer_width,
+			r_anisotropic->value);
+	}
+}
 
-		buffer_pos = rect->y * vid_buffer_width;
-		dst = pixels;
+/* rows compared at once to find the changed parts of a frame */
+#define COPY_BAND_ROWS 16
 
-		for (y = rect->y; y < rect->y + rect->h; y++)
-		{
-			int x;
+static qboolean
+RE_BandChanged(int vmin, int vmax)
+{
+	size_t offset;
+
+	offset = (size_t)vmin * vid_buffer_width;
+
+	return memcmp(swap_frames[0] + offset, swap_frames[1] + offset,
+		(size_t)(vmax - vmin) * vid_buffer_width) != 0;
+}
+
+/*
+ * Copies the rows vmin up to vmax to the texture.
+ */
+static void
+RE_CopyRect(int vmin, int vmax)
+{
+	int pitch;
+	Uint32 *pixels;
+	SDL_Rect rect;
+
+	/* set section to update */
+	rect.x = 0;
+	rect.y = vmin;
+	rect.w = vid_buffer_width;
+	rect.h = vmax - vmin;
+
+	if (!RE_LockFrame(&rect, &pixels, &pitch))
+	{
+		return;
+	}
+
+	RE_CopyFrame(pixels, pitch / sizeof(Uint32), &rect);
+	RE_UnlockFrame();
+}
 
-			for (x = 0; x < vid_buffer_width; x++)
+/*
+ * Copies the rows vmin up to vmax to the texture. With
+ * partial set bands of rows without changes since the last
+ * frame are skipped, the texture still holds them. The
+ * smoothing filter runs over all copied pixels at once, so
+ * it always gets the whole range.
+ */
+static void
+RE_CopyRows(int vmin, int vmax, qboolean partial)
+{
+	int y, start;
+
+	if (!partial || ((r_anisotropic->value > 0) && !fastmoving))
+	{
+		RE_CopyRect(vmin, vmax);
+		return;
+	}
+
+	/* each band is compared once, runs of changed bands
+	   are copied at once */
+	start = -1;
+
+	for (y = vmin; y < vmax; y += COPY_BAND_ROWS)
+	{
+		if (RE_BandChanged(y, Q_min(y + COPY_BAND_ROWS, vmax)))
+		{
+			if (start < 0)
 			{
-				dst[x] = sdl_palette[vid_buffer[buffer_pos]];
-				buffer_pos ++;
+				start = y;
 			}
-
-			dst += pitch;
+		}
+		else if (start >= 0)
+		{
+			RE_CopyRect(start, y);
+			start = -1;
 		}
 	}
 
-	if ((r_anisotropic->value > 0) && !fastmoving)
+	if (start >= 0)
 	{
-		SmoothColorImage((unsigned *)pixels, rect->h * vid_buffer_width,
-			r_anisotropic->value);
+		RE_CopyRect(start, vmax);
 	}
 }
 
@@ -2233,19 +2388,14 @@ RE_CleanFrame(void)
 	memset(swap_buffers, 0,
 		vid_buffer_height * vid_buffer_width * sizeof(pixel_t) * 2);
 
-#ifdef USE_SDL3
-	if (!SDL_LockTexture(texture, NULL, (void**)&pixels, &pitch))
-#else
-	if (SDL_LockTexture(texture, NULL, (void**)&pixels, &pitch))
-#endif
+	if (!RE_LockFrame(NULL, &pixels, &pitch))
 	{
-		Com_Printf("Can't lock texture: %s\n", SDL_GetError());
 		return;
 	}
 
 	// only cleanup texture without flush texture to screen
 	memset(pixels, 0, pitch * vid_buffer_height);
-	SDL_UnlockTexture(texture);
+	RE_UnlockFrame();
 
 	// All changes flushed
 	VID_NoDamageBuffer();
@@ -2254,10 +2404,6 @@ RE_CleanFrame(void)
 static void
 RE_FlushFrame(int vmin, int vmax)
 {
-	int pitch;
-	Uint32 *pixels;
-	SDL_Rect rect;
-
 	if (vmin >= vmax)
 	{
 		/* Looks like we already updated everything */
@@ -2283,34 +2429,22 @@ RE_FlushFrame(int vmin, int vmax)
 			vmax = vid_buffer_height;
 		}
 
-		/* set section to update */
-		rect.x = 0;
-		rect.y = vmin;
-		rect.w = vid_buffer_width;
-		rect.h = vmax - vmin;
-
-#ifdef USE_SDL3
-		if (!SDL_LockTexture(texture, &rect, (void**)&pixels, &pitch))
-#else
-		if (SDL_LockTexture(texture, &rect, (void**)&pixels, &pitch))
-#endif
-		{
-			Com_Printf("Can't lock texture: %s\n", SDL_GetError());
-			return;
-		}
-
-		RE_CopyFrame(pixels, pitch / sizeof(Uint32), &rect);
-
-		SDL_UnlockTexture(texture);
+		R_BenchBegin(BENCH_COPYFRAME);
+		RE_CopyRows(vmin, vmax,
+			sw_partialrefresh->value && !palette_changed);
+		R_BenchEnd();
 	}
 
+	if (!headless_pixels)
+	{
 #ifdef USE_SDL3
-	SDL_RenderTexture(renderer, texture, NULL, NULL);
+		SDL_RenderTexture(renderer, texture, NULL, NULL);
 #else
-	SDL_RenderCopy(renderer, texture, NULL, NULL);
+		SDL_RenderCopy(renderer, texture, NULL, NULL);
 #endif
 
-	SDL_RenderPresent(renderer);
+		SDL_RenderPresent(renderer);
+	}
 
 	// replace use next buffer
 	swap_current ++;
@@ -2320,6 +2454,21 @@ RE_FlushFrame(int vmin, int vmax)
 	VID_NoDamageBuffer();
 }
 
+/*
+ * Ends the timing of the frame and adds the headless
+ * frame to the frame hash.
+ */
+static void
+RE_FinishFrame(void)
+{
+	R_BenchFrameEnd();
+
+	if (headless_pixels && sw_framehash->value)
+	{
+		R_BenchHash(headless_pixels, vid_buffer_width * vid_buffer_height);
+	}
+}
+
 /*
 ** RE_EndFrame
 **
@@ -2370,6 +2519,7 @@ RE_EndFrame(void)
 		// no differences found
 		if (vmin >= vmax)
 		{
+			RE_FinishFrame();
 			return;
 		}
 
@@ -2382,6 +2532,7 @@ RE_EndFrame(void)
 	}
 
 	RE_FlushFrame(vmin, vmax);
+	RE_FinishFrame();
 }
 
 /*
@@ -133,6 +133,455 @@ R_PrintAliasStats(void)
 	Com_Printf("%3i polygon model drawn\n", r_amodels_drawn);
 }
 
+/*
+ * Time spent in the phases of the frames since the map
+ * was loaded. The time of nested phases isn't counted
+ * for the outer ones, e.g. building surfaces isn't part
+ * of the spans.
+ */
+static const char *bench_names[BENCH_NUMPHASES] = {
+	"other", "bsp", "edges", "spans", "surface cache",
+	"alias models", "particles", "copy frame"
+};
+
+static Uint64 bench_time[BENCH_NUMPHASES];
+static benchphase_t bench_stack[8];
+static int bench_depth;
+static int bench_overflow; /* phases nested too deep to push */
+static Uint64 bench_last;
+static int bench_frames;
+static int bench_hashed; /* frames added to the hash */
+static Uint64 bench_hash;
+
+static void
+R_BenchSwitch(void)
+{
+	Uint64 now;
+
+	now = SDL_GetPerformanceCounter();
+
+	if (bench_depth > 0)
+	{
+		bench_time[bench_stack[bench_depth - 1]] += now - bench_last;
+	}
+
+	bench_last = now;
+}
+
+void
+R_BenchBegin(benchphase_t phase)
+{
+	if (!bench_depth)
+	{
+		/* outside of a frame */
+		return;
+	}
+
+	if (bench_overflow || (bench_depth >= ARRLEN(bench_stack)))
+	{
+		/* counted for the innermost phase pushed */
+		bench_overflow++;
+		return;
+	}
+
+	R_BenchSwitch();
+	bench_stack[bench_depth++] = phase;
+}
+
+void
+R_BenchEnd(void)
+{
+	if (bench_overflow)
+	{
+		bench_overflow--;
+		return;
+	}
+
+	if (bench_depth < 2)
+	{
+		return;
+	}
+
+	R_BenchSwitch();
+	bench_depth--;
+}
+
+void
+R_BenchFrameBegin(void)
+{
+	bench_depth = 0;
+	bench_overflow = 0;
+	bench_stack[bench_depth++] = BENCH_OTHER;
+	bench_last = SDL_GetPerformanceCounter();
+}
+
+void
+R_BenchFrameEnd(void)
+{
+	if (!bench_depth)
+	{
+		return;
+	}
+
+	R_BenchSwitch();
+	bench_depth = 0;
+	bench_overflow = 0;
+	bench_frames++;
+}
+
+/*
+ * Adds the final image of a frame to the frame hash and
+ * prints its own hash with sw_framehash 2.
+ */
+void
+R_BenchHash(const unsigned *pixels, int count)
+{
+	Uint64 hash;
+	int i;
+
+	/* FNV-1a over 32 bit words */
+	hash = 14695981039346656037ULL;
+
+	for (i = 0; i < count; i++)
+	{
+		hash = (hash ^ pixels[i]) * 1099511628211ULL;
+	}
+
+	bench_hash = (bench_hash ^ hash) * 1099511628211ULL;
+	bench_hashed++;
+
+	if (sw_framehash->value > 1)
+	{
+		Com_Printf("frame %d: %016llx\n", bench_frames,
+			(unsigned long long)hash);
+	}
+}
+
+void
+R_BenchClear(void)
+{
+	memset(bench_time, 0, sizeof(bench_time));
+	bench_frames = 0;
+	bench_hashed = 0;
+	bench_hash = 14695981039346656037ULL;
+}
+
+/*
+ * Prints the time per frame of each phase and resets
+ * them. Run at the end of each timedemo.
+ */
+void
+R_Benchmark_f(void)
+{
+	double freq, total;
+	int i;
+
+	if (!bench_frames)
+	{
+		Com_Printf("No frames rendered.\n");
+		return;
+	}
+
+	freq = SDL_GetPerformanceFrequency() / 1000.0;
+	total = 0;
+
+	Com_Printf("%d frames at %dx%d, ms per frame:\n",
+		bench_frames, vid_buffer_width, vid_buffer_height);
+
+	for (i = 0; i < BENCH_NUMPHASES; i++)
+	{
+		double ms;
+
+		ms = bench_time[i] / freq / bench_frames;
+		total += ms;
+
+		Com_Printf("  %-14s %8.3f\n", bench_names[i], ms);
+	}
+
+	Com_Printf("  %-14s %8.3f\n", "total", total);
+
+	/* only headless frames are hashed */
+	if (sw_framehash->value && bench_hashed)
+	{
+		Com_Printf("frame hash: %016llx\n", (unsigned long long)bench_hash);
+	}
+
+	R_BenchClear();
+}
+
+/*
+ * Worker pool for sw_threads. Jobs are split in items, which
+ * are picked up by the workers and the main thread until all
+ * are done.
+ */
+
+#define R_MAX_WORKERS 16
+
+static cvar_t *sw_threads;
+
+static SDL_Thread *workers[R_MAX_WORKERS];
+static int numworkers;
+
+#ifdef USE_SDL3
+static SDL_Mutex *work_lock;
+static SDL_Condition *work_start;
+static SDL_Condition *work_done;
+#else
+static SDL_mutex *work_lock;
+static SDL_cond *work_start;
+static SDL_cond *work_done;
+#endif
+
+static r_job_t work_job;
+static void *work_data;
+static int work_count;
+static int work_next;
+static int work_pending;
+static int work_generation;
+static qboolean work_quit;
+
+static void
+R_BroadcastCond(void *cond)
+{
+#ifdef USE_SDL3
+	SDL_BroadcastCondition(cond);
+#else
+	SDL_CondBroadcast(cond);
+#endif
+}
+
+static void
+R_WaitCond(void *cond)
+{
+#ifdef USE_SDL3
+	SDL_WaitCondition(cond, work_lock);
+#else
+	SDL_CondWait(cond, work_lock);
+#endif
+}
+
+/*
+ * Runs items of the current job until none is left.
+ * Must be called with work_lock held.
+ */
+static void
+R_WorkersDrain(void)
+{
+	while (work_next < work_count)
+	{
+		int item;
+
+		item = work_next++;
+
+		SDL_UnlockMutex(work_lock);
+		work_job(item, work_data);
+		SDL_LockMutex(work_lock);
+
+		if (!--work_pending)
+		{
+			R_BroadcastCond(work_done);
+		}
+	}
+}
+
+static int
+R_WorkerThread(void *arg)
+{
+	int generation;
+
+	SDL_LockMutex(work_lock);
+	generation = work_generation;
+
+	while (1)
+	{
+		while (!work_quit && (generation == work_generation))
+		{
+			R_WaitCond(work_start);
+		}
+
+		if (work_quit)
+		{
+			break;
+		}
+
+		generation = work_generation;
+		R_WorkersDrain();
+	}
+
+	SDL_UnlockMutex(work_lock);
+
+	return 0;
+}
+
+static void
+R_WorkersStop(void)
+{
+	int i;
+
+	if (!numworkers)
+	{
+		return;
+	}
+
+	SDL_LockMutex(work_lock);
+	work_quit = true;
+	R_BroadcastCond(work_start);
+	SDL_UnlockMutex(work_lock);
+
+	for (i = 0; i < numworkers; i++)
+	{
+		SDL_WaitThread(workers[i], NULL);
+	}
+
+	numworkers = 0;
+	work_quit = false;
+}
+
+static void
+R_WorkersStart(int count)
+{
+	int i;
+
+	count = Q_min(count, R_MAX_WORKERS);
+
+	if ((count <= 0) || !work_lock)
+	{
+		return;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		workers[i] = SDL_CreateThread(R_WorkerThread, "sw_worker", NULL);
+		if (!workers[i])
+		{
+			Com_Printf("%s: Couldn't create worker %d: %s\n",
+				__func__, i, SDL_GetError());
+			break;
+		}
+
+		numworkers++;
+	}
+
+	if (numworkers)
+	{
+		Com_Printf("Started %d render worker threads\n", numworkers);
+	}
+}
+
+void
+R_InitWorkers(void)
+{
+	sw_threads = ri.Cvar_Get("sw_threads", "0", CVAR_ARCHIVE);
+	sw_threads->modified = true;
+
+	work_lock = SDL_CreateMutex();
+#ifdef USE_SDL3
+	work_start = SDL_CreateCondition();
+	work_done = SDL_CreateCondition();
+#else
+	work_start = SDL_CreateCond();
+	work_done = SDL_CreateCond();
+#endif
+
+	if (!work_lock || !work_start || !work_done)
+	{
+		Com_Printf("%s: Couldn't create locks: %s\n", __func__, SDL_GetError());
+		R_ShutdownWorkers();
+	}
+}
+
+void
+R_ShutdownWorkers(void)
+{
+	R_WorkersStop();
+
+	if (work_done)
+	{
+#ifdef USE_SDL3
+		SDL_DestroyCondition(work_done);
+#else
+		SDL_DestroyCond(work_done);
+#endif
+		work_done = NULL;
+	}
+
+	if (work_start)
+	{
+#ifdef USE_SDL3
+		SDL_DestroyCondition(work_start);
+#else
+		SDL_DestroyCond(work_start);
+#endif
+		work_start = NULL;
+	}
+
+	if (work_lock)
+	{
+		SDL_DestroyMutex(work_lock);
+		work_lock = NULL;
+	}
+}
+
+/*
+ * Returns the number of worker threads, zero if jobs
+ * are run by the main thread only. (Re)starts the
+ * workers after sw_threads was changed.
+ */
+int
+R_NumWorkers(void)
+{
+	if (sw_threads && sw_threads->modified)
+	{
+		sw_threads->modified = false;
+
+		R_WorkersStop();
+		R_WorkersStart((int)sw_threads->value);
+	}
+
+	return numworkers;
+}
+
+/*
+ * Calls job for the items 0 to count - 1 and returns
+ * once all of them are done. The main thread takes
+ * part in the work. Items must not depend on each
+ * other and must not call into non thread safe code.
+ */
+void
+R_RunWorkers(r_job_t job, void *data, int count)
+{
+	int i;
+
+	if (numworkers && (count > 1))
+	{
+		SDL_LockMutex(work_lock);
+
+		work_job = job;
+		work_data = data;
+		work_count = count;
+		work_next = 0;
+		work_pending = count;
+		work_generation++;
+		R_BroadcastCond(work_start);
+
+		R_WorkersDrain();
+
+		while (work_pending)
+		{
+			R_WaitCond(work_done);
+		}
+
+		SDL_UnlockMutex(work_lock);
+
+		return;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		job(i, data);
+	}
+}
+
 /*
 ================
 TransformVector
@@ -458,6 +458,9 @@ RE_BeginRegistration(const char *model)
 	registration_sequence++;
 	r_oldviewcluster = -1; /* force markleafs */
 
+	/* benchmark the new map only */
+	R_BenchClear();
+
 	Com_sprintf(fullname, sizeof(fullname), "maps/%s.bsp", model);
 
 	D_FlushCaches ();
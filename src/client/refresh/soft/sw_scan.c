@@ -183,23 +183,23 @@ TurbulentPow2
 =============
 */
 void
-TurbulentPow2(espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zistepv)
+TurbulentPow2(const espan_t *pspan, const espan_t *pend, const spangrad_t *grad)
 {
 	float sdivzpow2stepu, tdivzpow2stepu, zipow2stepu;
 	int spanstep_shift, spanstep_value;
 	const pixel_t *r_turb_pbase;
 	const int *r_turb_turb;
 
-	spanstep_shift = D_DrawSpanGetStep(d_zistepu, d_zistepv);
+	spanstep_shift = D_DrawSpanGetStep(grad->zistepu, grad->zistepv);
 	spanstep_value = (1 << spanstep_shift);
 
 	r_turb_turb = sintable + ((int)(r_newrefdef.time*SPEED)&(CYCLE-1));
 
-	r_turb_pbase = (byte *)cacheblock;
+	r_turb_pbase = grad->cacheblock;
 
-	sdivzpow2stepu = d_sdivzstepu * spanstep_value;
-	tdivzpow2stepu = d_tdivzstepu * spanstep_value;
-	zipow2stepu = d_zistepu * spanstep_value;
+	sdivzpow2stepu = grad->sdivzstepu * spanstep_value;
+	tdivzpow2stepu = grad->tdivzstepu * spanstep_value;
+	zipow2stepu = grad->zistepu * spanstep_value;
 
 	do
 	{
@@ -215,20 +215,20 @@ TurbulentPow2(espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zistepv
 		du = (float)pspan->u;
 		dv = (float)pspan->v;
 
-		sdivz = d_sdivzorigin + dv*d_sdivzstepv + du*d_sdivzstepu;
-		tdivz = d_tdivzorigin + dv*d_tdivzstepv + du*d_tdivzstepu;
-		zi = d_ziorigin + dv*d_zistepv + du*d_zistepu;
+		sdivz = grad->sdivzorigin + dv*grad->sdivzstepv + du*grad->sdivzstepu;
+		tdivz = grad->tdivzorigin + dv*grad->tdivzstepv + du*grad->tdivzstepu;
+		zi = grad->ziorigin + dv*grad->zistepv + du*grad->zistepu;
 		z = (float)SHIFT16XYZ_MULT / zi;	// prescale to 16.16 fixed-point
 
-		r_turb_s = (int)(sdivz * z) + sadjust;
-		if (r_turb_s > bbextents)
-			r_turb_s = bbextents;
+		r_turb_s = (int)(sdivz * z) + grad->sadjust;
+		if (r_turb_s > grad->bbextents)
+			r_turb_s = grad->bbextents;
 		else if (r_turb_s < 0)
 			r_turb_s = 0;
 
-		r_turb_t = (int)(tdivz * z) + tadjust;
-		if (r_turb_t > bbextentt)
-			r_turb_t = bbextentt;
+		r_turb_t = (int)(tdivz * z) + grad->tadjust;
+		if (r_turb_t > grad->bbextentt)
+			r_turb_t = grad->bbextentt;
 		else if (r_turb_t < 0)
 			r_turb_t = 0;
 
@@ -258,18 +258,18 @@ TurbulentPow2(espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zistepv
 				zi += zipow2stepu;
 				z = (float)SHIFT16XYZ_MULT / zi;	// prescale to 16.16 fixed-point
 
-				snext = (int)(sdivz * z) + sadjust;
-				if (snext > bbextents)
-					snext = bbextents;
+				snext = (int)(sdivz * z) + grad->sadjust;
+				if (snext > grad->bbextents)
+					snext = grad->bbextents;
 				else if (snext < spanstep_value)
 					// prevent round-off error on <0 steps from
 					//  from causing overstepping & running off the
 					//  edge of the texture
 					snext = spanstep_value;
 
-				tnext = (int)(tdivz * z) + tadjust;
-				if (tnext > bbextentt)
-					tnext = bbextentt;
+				tnext = (int)(tdivz * z) + grad->tadjust;
+				if (tnext > grad->bbextentt)
+					tnext = grad->bbextentt;
 				else if (tnext < spanstep_value)
 					// guard against round-off error on <0 steps
 					tnext = spanstep_value;
@@ -286,22 +286,22 @@ TurbulentPow2(espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zistepv
 				// span by division, biasing steps low so we don't run off the
 				// texture
 				spancountminus1 = (float)(r_turb_spancount - 1);
-				sdivz += d_sdivzstepu * spancountminus1;
-				tdivz += d_tdivzstepu * spancountminus1;
-				zi += d_zistepu * spancountminus1;
+				sdivz += grad->sdivzstepu * spancountminus1;
+				tdivz += grad->tdivzstepu * spancountminus1;
+				zi += grad->zistepu * spancountminus1;
 				z = (float)SHIFT16XYZ_MULT / zi;	// prescale to 16.16 fixed-point
-				snext = (int)(sdivz * z) + sadjust;
-				if (snext > bbextents)
-					snext = bbextents;
+				snext = (int)(sdivz * z) + grad->sadjust;
+				if (snext > grad->bbextents)
+					snext = grad->bbextents;
 				else if (snext < spanstep_value)
 					// prevent round-off error on <0 steps from
 					//  from causing overstepping & running off the
 					//  edge of the texture
 					snext = spanstep_value;
 
-				tnext = (int)(tdivz * z) + tadjust;
-				if (tnext > bbextentt)
-					tnext = bbextentt;
+				tnext = (int)(tdivz * z) + grad->tadjust;
+				if (tnext > grad->bbextentt)
+					tnext = grad->bbextentt;
 				else if (tnext < spanstep_value)
 					// guard against round-off error on <0 steps
 					tnext = spanstep_value;
@@ -327,7 +327,7 @@ TurbulentPow2(espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zistepv
 
 		} while (count > 0);
 
-	} while ((pspan = pspan->pnext) != NULL);
+	} while ((pspan = pspan->pnext) != pend);
 }
 
 //====================
@@ -338,23 +338,23 @@ NonTurbulentPow2 - this is for drawing scrolling textures. they're warping water
 =============
 */
 void
-NonTurbulentPow2 (espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zistepv)
+NonTurbulentPow2 (const espan_t *pspan, const espan_t *pend, const spangrad_t *grad)
 {
 	float sdivzpow2stepu, tdivzpow2stepu, zipow2stepu;
 	int spanstep_shift, spanstep_value;
 	const pixel_t *r_turb_pbase;
 	const int *r_turb_turb;
 
-	spanstep_shift = D_DrawSpanGetStep(d_zistepu, d_zistepv);
+	spanstep_shift = D_DrawSpanGetStep(grad->zistepu, grad->zistepv);
 	spanstep_value = (1 << spanstep_shift);
 
 	r_turb_turb = blanktable;
 
-	r_turb_pbase = (byte *)cacheblock;
+	r_turb_pbase = grad->cacheblock;
 
-	sdivzpow2stepu = d_sdivzstepu * spanstep_value;
-	tdivzpow2stepu = d_tdivzstepu * spanstep_value;
-	zipow2stepu = d_zistepu * spanstep_value;
+	sdivzpow2stepu = grad->sdivzstepu * spanstep_value;
+	tdivzpow2stepu = grad->tdivzstepu * spanstep_value;
+	zipow2stepu = grad->zistepu * spanstep_value;
 
 	do
 	{
@@ -370,20 +370,20 @@ NonTurbulentPow2 (espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zis
 		du = (float)pspan->u;
 		dv = (float)pspan->v;
 
-		sdivz = d_sdivzorigin + dv*d_sdivzstepv + du*d_sdivzstepu;
-		tdivz = d_tdivzorigin + dv*d_tdivzstepv + du*d_tdivzstepu;
-		zi = d_ziorigin + dv*d_zistepv + du*d_zistepu;
+		sdivz = grad->sdivzorigin + dv*grad->sdivzstepv + du*grad->sdivzstepu;
+		tdivz = grad->tdivzorigin + dv*grad->tdivzstepv + du*grad->tdivzstepu;
+		zi = grad->ziorigin + dv*grad->zistepv + du*grad->zistepu;
 		z = (float)SHIFT16XYZ_MULT / zi;	// prescale to 16.16 fixed-point
 
-		r_turb_s = (int)(sdivz * z) + sadjust;
-		if (r_turb_s > bbextents)
-			r_turb_s = bbextents;
+		r_turb_s = (int)(sdivz * z) + grad->sadjust;
+		if (r_turb_s > grad->bbextents)
+			r_turb_s = grad->bbextents;
 		else if (r_turb_s < 0)
 			r_turb_s = 0;
 
-		r_turb_t = (int)(tdivz * z) + tadjust;
-		if (r_turb_t > bbextentt)
-			r_turb_t = bbextentt;
+		r_turb_t = (int)(tdivz * z) + grad->tadjust;
+		if (r_turb_t > grad->bbextentt)
+			r_turb_t = grad->bbextentt;
 		else if (r_turb_t < 0)
 			r_turb_t = 0;
 
@@ -413,18 +413,18 @@ NonTurbulentPow2 (espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zis
 				zi += zipow2stepu;
 				z = (float)SHIFT16XYZ_MULT / zi;	// prescale to 16.16 fixed-point
 
-				snext = (int)(sdivz * z) + sadjust;
-				if (snext > bbextents)
-					snext = bbextents;
+				snext = (int)(sdivz * z) + grad->sadjust;
+				if (snext > grad->bbextents)
+					snext = grad->bbextents;
 				else if (snext < spanstep_value)
 					// prevent round-off error on <0 steps from
 					//  from causing overstepping & running off the
 					//  edge of the texture
 					snext = spanstep_value;
 
-				tnext = (int)(tdivz * z) + tadjust;
-				if (tnext > bbextentt)
-					tnext = bbextentt;
+				tnext = (int)(tdivz * z) + grad->tadjust;
+				if (tnext > grad->bbextentt)
+					tnext = grad->bbextentt;
 				else if (tnext < spanstep_value)
 					// guard against round-off error on <0 steps
 					tnext = spanstep_value;
@@ -441,22 +441,22 @@ NonTurbulentPow2 (espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zis
 				// span by division, biasing steps low so we don't run off the
 				// texture
 				spancountminus1 = (float)(r_turb_spancount - 1);
-				sdivz += d_sdivzstepu * spancountminus1;
-				tdivz += d_tdivzstepu * spancountminus1;
-				zi += d_zistepu * spancountminus1;
+				sdivz += grad->sdivzstepu * spancountminus1;
+				tdivz += grad->tdivzstepu * spancountminus1;
+				zi += grad->zistepu * spancountminus1;
 				z = (float)SHIFT16XYZ_MULT / zi;	// prescale to 16.16 fixed-point
-				snext = (int)(sdivz * z) + sadjust;
-				if (snext > bbextents)
-					snext = bbextents;
+				snext = (int)(sdivz * z) + grad->sadjust;
+				if (snext > grad->bbextents)
+					snext = grad->bbextents;
 				else if (snext < spanstep_value)
 					// prevent round-off error on <0 steps from
 					//  from causing overstepping & running off the
 					//  edge of the texture
 					snext = spanstep_value;
 
-				tnext = (int)(tdivz * z) + tadjust;
-				if (tnext > bbextentt)
-					tnext = bbextentt;
+				tnext = (int)(tdivz * z) + grad->tadjust;
+				if (tnext > grad->bbextentt)
+					tnext = grad->bbextentt;
 				else if (tnext < spanstep_value)
 					// guard against round-off error on <0 steps
 					tnext = spanstep_value;
@@ -482,7 +482,7 @@ NonTurbulentPow2 (espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zis
 
 		} while (count > 0);
 
-	} while ((pspan = pspan->pnext) != NULL);
+	} while ((pspan = pspan->pnext) != pend);
 }
 
 //====================
@@ -506,7 +506,8 @@ D_DrawSpan
 =============
 */
 static pixel_t *
-D_DrawSpan(pixel_t *pdest, const pixel_t *pbase, int s, int t, int sstep, int tstep, int spancount)
+D_DrawSpan(pixel_t *pdest, const pixel_t *pbase, int width, int s, int t,
+	int sstep, int tstep, int spancount)
 {
 	const pixel_t *tdest_max = pdest + spancount;
 
@@ -514,7 +515,7 @@ D_DrawSpan(pixel_t *pdest, const pixel_t *pbase, int s, int t, int sstep, int ts
 	if (((t + tstep * spancount) >> SHIFT16XYZ) == (t >> SHIFT16XYZ))
 	{
 		// position in texture
-		const pixel_t *tbase = pbase + (t >> SHIFT16XYZ) * cachewidth;
+		const pixel_t *tbase = pbase + (t >> SHIFT16XYZ) * width;
 
 		do
 		{
@@ -530,7 +531,7 @@ D_DrawSpan(pixel_t *pdest, const pixel_t *pbase, int s, int t, int sstep, int ts
 
 		do
 		{
-			*pdest++ = *(tbase + (t >> SHIFT16XYZ) * cachewidth);
+			*pdest++ = *(tbase + (t >> SHIFT16XYZ) * width);
 			t += tstep;
 		} while (pdest < tdest_max);
 	}
@@ -539,7 +540,7 @@ D_DrawSpan(pixel_t *pdest, const pixel_t *pbase, int s, int t, int sstep, int ts
 	{
 		do
 		{
-			*pdest++ = *(pbase + (s >> SHIFT16XYZ) + (t >> SHIFT16XYZ) * cachewidth);
+			*pdest++ = *(pbase + (s >> SHIFT16XYZ) + (t >> SHIFT16XYZ) * width);
 			s += sstep;
 			t += tstep;
 		} while (pdest < tdest_max);
@@ -554,8 +555,8 @@ D_DrawSpanFiltered
 =============
 */
 static pixel_t *
-D_DrawSpanFiltered(pixel_t *pdest, pixel_t *pbase, int s, int t, int sstep, int tstep, int spancount,
-	   const espan_t *pspan)
+D_DrawSpanFiltered(pixel_t *pdest, const pixel_t *pbase, int width, int s, int t,
+	int sstep, int tstep, int spancount, const espan_t *pspan)
 {
 	do
 	{
@@ -577,7 +578,7 @@ D_DrawSpanFiltered(pixel_t *pdest, pixel_t *pbase, int s, int t, int sstep, int
 		iditht = iditht ? iditht -1 : iditht;
 
 
-		*pdest++ = *(pbase + idiths + iditht * cachewidth);
+		*pdest++ = *(pbase + idiths + iditht * width);
 		s += sstep;
 		t += tstep;
 	} while (--spancount > 0);
@@ -591,7 +592,7 @@ D_DrawSpansPow2
 =============
 */
 void
-D_DrawSpansPow2(const espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zistepv)
+D_DrawSpansPow2(const espan_t *pspan, const espan_t *pend, const spangrad_t *grad)
 {
 	int 	spancount;
 	pixel_t	*pbase;
@@ -600,15 +601,15 @@ D_DrawSpansPow2(const espan_t *pspan, float d_ziorigin, float d_zistepu, float d
 	int	texture_filtering;
 	int	spanstep_shift, spanstep_value;
 
-	spanstep_shift = D_DrawSpanGetStep(d_zistepu, d_zistepv);
+	spanstep_shift = D_DrawSpanGetStep(grad->zistepu, grad->zistepv);
 	spanstep_value = (1 << spanstep_shift);
 
-	pbase = (byte *)cacheblock;
+	pbase = grad->cacheblock;
 
 	texture_filtering = (int)sw_texture_filtering->value;
-	sdivzpow2stepu = d_sdivzstepu * spanstep_value;
-	tdivzpow2stepu = d_tdivzstepu * spanstep_value;
-	zipow2stepu = d_zistepu * spanstep_value;
+	sdivzpow2stepu = grad->sdivzstepu * spanstep_value;
+	tdivzpow2stepu = grad->tdivzstepu * spanstep_value;
+	zipow2stepu = grad->zistepu * spanstep_value;
 
 	do
 	{
@@ -624,20 +625,20 @@ D_DrawSpansPow2(const espan_t *pspan, float d_ziorigin, float d_zistepu, float d
 		du = (float)pspan->u;
 		dv = (float)pspan->v;
 
-		sdivz = d_sdivzorigin + dv*d_sdivzstepv + du*d_sdivzstepu;
-		tdivz = d_tdivzorigin + dv*d_tdivzstepv + du*d_tdivzstepu;
-		zi = d_ziorigin + dv*d_zistepv + du*d_zistepu;
+		sdivz = grad->sdivzorigin + dv*grad->sdivzstepv + du*grad->sdivzstepu;
+		tdivz = grad->tdivzorigin + dv*grad->tdivzstepv + du*grad->tdivzstepu;
+		zi = grad->ziorigin + dv*grad->zistepv + du*grad->zistepu;
 		z = (float)SHIFT16XYZ_MULT / zi;	// prescale to 16.16 fixed-point
 
-		s = (int)(sdivz * z) + sadjust;
-		if (s > bbextents)
-			s = bbextents;
+		s = (int)(sdivz * z) + grad->sadjust;
+		if (s > grad->bbextents)
+			s = grad->bbextents;
 		else if (s < 0)
 			s = 0;
 
-		t = (int)(tdivz * z) + tadjust;
-		if (t > bbextentt)
-			t = bbextentt;
+		t = (int)(tdivz * z) + grad->tadjust;
+		if (t > grad->bbextentt)
+			t = grad->bbextentt;
 		else if (t < 0)
 			t = 0;
 
@@ -665,18 +666,18 @@ D_DrawSpansPow2(const espan_t *pspan, float d_ziorigin, float d_zistepu, float d
 				zi += zipow2stepu;
 				z = (float)SHIFT16XYZ_MULT / zi;	// prescale to 16.16 fixed-point
 
-				snext = (int)(sdivz * z) + sadjust;
-				if (snext > bbextents)
-					snext = bbextents;
+				snext = (int)(sdivz * z) + grad->sadjust;
+				if (snext > grad->bbextents)
+					snext = grad->bbextents;
 				else if (snext < spanstep_value)
 					// prevent round-off error on <0 steps from
 					//  from causing overstepping & running off the
 					//  edge of the texture
 					snext = spanstep_value;
 
-				tnext = (int)(tdivz * z) + tadjust;
-				if (tnext > bbextentt)
-					tnext = bbextentt;
+				tnext = (int)(tdivz * z) + grad->tadjust;
+				if (tnext > grad->bbextentt)
+					tnext = grad->bbextentt;
 				else if (tnext < spanstep_value)
 					// guard against round-off error on <0 steps
 					tnext = spanstep_value;
@@ -693,22 +694,22 @@ D_DrawSpansPow2(const espan_t *pspan, float d_ziorigin, float d_zistepu, float d
 				// span by division, biasing steps low so we don't run off the
 				// texture
 				spancountminus1 = (float)(spancount - 1);
-				sdivz += d_sdivzstepu * spancountminus1;
-				tdivz += d_tdivzstepu * spancountminus1;
-				zi += d_zistepu * spancountminus1;
+				sdivz += grad->sdivzstepu * spancountminus1;
+				tdivz += grad->tdivzstepu * spancountminus1;
+				zi += grad->zistepu * spancountminus1;
 				z = (float)SHIFT16XYZ_MULT / zi;	// prescale to 16.16 fixed-point
-				snext = (int)(sdivz * z) + sadjust;
-				if (snext > bbextents)
-					snext = bbextents;
+				snext = (int)(sdivz * z) + grad->sadjust;
+				if (snext > grad->bbextents)
+					snext = grad->bbextents;
 				else if (snext < spanstep_value)
 					// prevent round-off error on <0 steps from
 					//  from causing overstepping & running off the
 					//  edge of the texture
 					snext = spanstep_value;
 
-				tnext = (int)(tdivz * z) + tadjust;
-				if (tnext > bbextentt)
-					tnext = bbextentt;
+				tnext = (int)(tdivz * z) + grad->tadjust;
+				if (tnext > grad->bbextentt)
+					tnext = grad->bbextentt;
 				else if (tnext < spanstep_value)
 					// guard against round-off error on <0 steps
 					tnext = spanstep_value;
@@ -723,19 +724,19 @@ D_DrawSpansPow2(const espan_t *pspan, float d_ziorigin, float d_zistepu, float d
 			// Drawing phrase
 			if ((texture_filtering == 0) || fastmoving)
 			{
-				pdest = D_DrawSpan(pdest, pbase, s, t, sstep, tstep,
-						   spancount);
+				pdest = D_DrawSpan(pdest, pbase, grad->cachewidth,
+						   s, t, sstep, tstep, spancount);
 			}
 			else
 			{
-				pdest = D_DrawSpanFiltered(pdest, pbase, s, t, sstep, tstep,
-						   spancount, pspan);
+				pdest = D_DrawSpanFiltered(pdest, pbase, grad->cachewidth,
+						   s, t, sstep, tstep, spancount, pspan);
 			}
 			s = snext;
 			t = tnext;
 		} while (count > 0);
 
-	} while ((pspan = pspan->pnext) != NULL);
+	} while ((pspan = pspan->pnext) != pend);
 }
 
 /*
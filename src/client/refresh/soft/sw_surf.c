@@ -36,6 +36,10 @@ static int	sc_size;
 static surfcache_t	*sc_rover;
 surfcache_t	*sc_base;
 
+/* span batch of D_DrawSurfaces, its surfaces must not be reused */
+static int	sc_batch = 1;
+static qboolean	sc_batchopen;
+
 /*
  * Color light apply is not required
  */
@@ -305,6 +309,7 @@ R_InitCaches(void)
 	sc_base->next = NULL;
 	sc_base->owner = NULL;
 	sc_base->size = sc_size;
+	sc_base->batch = 0;
 }
 
 /*
@@ -330,6 +335,63 @@ D_FlushCaches(void)
 	sc_base->next = NULL;
 	sc_base->owner = NULL;
 	sc_base->size = sc_size;
+	sc_base->batch = 0;
+}
+
+/*
+=================
+D_SCBlockSize
+
+Bytes of a cache block holding size bytes of texels
+=================
+*/
+static int
+D_SCBlockSize(int size)
+{
+	size += ((char*)sc_base->data - (char*)sc_base);
+	return (size + 3) & ~3;
+}
+
+/*
+=================
+D_SCRoverStart
+
+First block the rover takes for a block of size bytes.
+If there is not size bytes after the rover, it starts over.
+=================
+*/
+static surfcache_t *
+D_SCRoverStart(int size)
+{
+	if (!sc_rover || (byte *)sc_rover - (byte *)sc_base > sc_size - size)
+	{
+		return sc_base;
+	}
+
+	return sc_rover;
+}
+
+/*
+=================
+D_SCReclaim
+=================
+*/
+static void
+D_SCReclaim(surfcache_t *block)
+{
+	if (!block->owner)
+	{
+		return;
+	}
+
+	if (sc_batchopen && (block->batch == sc_batch))
+	{
+		Com_Error(ERR_FATAL, "%s: surface of the waiting batch reused",
+			__func__);
+		return;
+	}
+
+	*block->owner = NULL;
 }
 
 /*
@@ -355,8 +417,7 @@ D_SCAlloc(int width, int size)
 	}
 
 	/* Add header size */
-	size += ((char*)sc_base->data - (char*)sc_base);
-	size = (size + 3) & ~3;
+	size = D_SCBlockSize(size);
 	if (size > sc_size)
 	{
 		Com_Error(ERR_FATAL, "%s: %i > cache size of %i",
@@ -364,18 +425,11 @@ D_SCAlloc(int width, int size)
 		return NULL;
 	}
 
-	/* if there is not size bytes after the rover, reset to the start */
-	if ( !sc_rover || (byte *)sc_rover - (byte *)sc_base > sc_size - size)
-	{
-		sc_rover = sc_base;
-	}
+	sc_rover = D_SCRoverStart(size);
 
 	/* colect and free surfcache_t blocks until the rover block is large enough */
 	new = sc_rover;
-	if (sc_rover->owner)
-	{
-		*sc_rover->owner = NULL;
-	}
+	D_SCReclaim(sc_rover);
 
 	while (new->size < size)
 	{
@@ -388,10 +442,7 @@ D_SCAlloc(int width, int size)
 			return NULL;
 		}
 
-		if (sc_rover->owner)
-		{
-			*sc_rover->owner = NULL;
-		}
+		D_SCReclaim(sc_rover);
 
 		new->size += sc_rover->size;
 		new->next = sc_rover->next;
@@ -405,6 +456,7 @@ D_SCAlloc(int width, int size)
 		sc_rover->next = new->next;
 		sc_rover->width = 0;
 		sc_rover->owner = NULL;
+		sc_rover->batch = 0;
 		new->next = sc_rover;
 		new->size = size;
 	}
@@ -461,7 +513,12 @@ D_CacheSurface(const entity_t *currententity, msurface_t *surface, int miplevel)
 			&& cache->lightadj[1] == r_drawsurf.lightadj[1]
 			&& cache->lightadj[2] == r_drawsurf.lightadj[2]
 			&& cache->lightadj[3] == r_drawsurf.lightadj[3] )
+	{
+		cache->batch = sc_batch;
 		return cache;
+	}
+
+	R_BenchBegin(BENCH_SURFCACHE);
 
 	//
 	// determine shape of surface
@@ -510,5 +567,88 @@ D_CacheSurface(const entity_t *currententity, msurface_t *surface, int miplevel)
 	// rasterize the surface into the cache
 	R_DrawSurface(&r_drawsurf, blocklights, blocklight_max);
 
+	R_BenchEnd();
+
+	cache->batch = sc_batch;
+
 	return cache;
 }
+
+/*
+================
+D_SCBatchBegin
+
+Starts a new batch of surfaces, all cached surfaces handed
+out since the last call are not referenced any more.
+================
+*/
+void
+D_SCBatchBegin(void)
+{
+	sc_batch++;
+	sc_batchopen = true;
+}
+
+/*
+================
+D_SCBatchEnd
+
+The last batch is drawn, surfaces cached from now on are
+used right away.
+================
+*/
+void
+D_SCBatchEnd(void)
+{
+	sc_batchopen = false;
+}
+
+/*
+================
+D_SCBatchFull
+
+Returns true if caching the surface could overwrite a surface
+handed out in the current batch: the surface itself may be
+rebuilt in place, or the rover could reclaim one of them.
+Surfaces used again are stamped too, so they may be anywhere
+in front of the rover.
+================
+*/
+qboolean
+D_SCBatchFull(const msurface_t *surface, int miplevel)
+{
+	const surfcache_t *cache;
+	int size, reclaimed;
+
+	cache = surface->cachespots[miplevel];
+	if (cache)
+	{
+		/* no allocation, but maybe rebuilt in place */
+		return cache->batch == sc_batch;
+	}
+
+	size = D_SCBlockSize((surface->extents[0] >> miplevel) *
+		(surface->extents[1] >> miplevel));
+	if (size > sc_size)
+	{
+		/* D_SCAlloc fails anyway */
+		return false;
+	}
+
+	/* walk the blocks D_SCAlloc will take */
+	cache = D_SCRoverStart(size);
+	reclaimed = 0;
+
+	while (cache && (reclaimed < size))
+	{
+		if (cache->owner && (cache->batch == sc_batch))
+		{
+			return true;
+		}
+
+		reclaimed += cache->size;
+		cache = cache->next;
+	}
+
+	return false;
+}
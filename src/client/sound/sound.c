@@ -86,6 +86,7 @@ int s_rawend;
 static int s_registration_sequence = 0;
 portable_samplepair_t s_rawsamples[MAX_RAW_SAMPLES];
 static sfx_t known_sfx[MAX_SFX];
+static namehash_t sfx_hash = {"sfx"}; /* known_sfx by name */
 sndstarted_t sound_started = SS_NOT;
 sound_t sound;
 static qboolean s_registering;
@@ -573,17 +574,7 @@ S_LoadSound(sfx_t *s)
 static sfx_t *
 S_GetSfxByName(const char *name)
 {
-	int i;
-
-	for (i = 0; i < num_sfx; i++)
-	{
-		if (!strcmp(known_sfx[i].name, name))
-		{
-			return &known_sfx[i];
-		}
-	}
-
-	return NULL;
+	return NameHash_Find(&sfx_hash, name);
 }
 
 static sfx_t *
@@ -642,6 +633,7 @@ S_FindOrCreateSfx(const char *name)
 
 	sfx->truename = NULL;
 	strcpy(sfx->name, name);
+	NameHash_Insert(&sfx_hash, sfx->name, sfx);
 	sfx->registration_sequence = s_registration_sequence;
 	sfx->is_silenced_muzzle_flash = false;
 
@@ -673,6 +665,7 @@ S_AliasName(const char *aliasname, const char *truename)
 
 	sfx->cache = NULL;
 	Q_strlcpy(sfx->name, aliasname, sizeof(sfx->name));
+	NameHash_Insert(&sfx_hash, sfx->name, sfx);
 	sfx->registration_sequence = s_registration_sequence;
 	sfx->truename = Z_Malloc(strlen(truename) + 1);
 	strcpy(sfx->truename, truename);
@@ -887,6 +880,7 @@ S_EndRegistration(void)
 					Z_Free(sfx->truename);
 				}
 
+				NameHash_Remove(&sfx_hash, sfx->name, sfx);
 				sfx->cache = NULL;
 				sfx->name[0] = 0;
 			}
@@ -1778,6 +1772,7 @@ S_Shutdown(void)
 
 	memset(known_sfx, 0, sizeof(known_sfx));
 	num_sfx = 0;
+	NameHash_Clear(&sfx_hash);
 
 #if USE_OPENAL
 	if (sound_started == SS_OAL)
@@ -443,7 +443,8 @@ VID_LoadRenderer(void)
 	rimport.Cvar_Get = Cvar_Get;
 	rimport.Cvar_Set = Cvar_Set;
 	rimport.Cvar_SetValue = Cvar_SetValue;
-	rimport.FS_FreeFile = FS_FreeFile;
+	/* Also releases maps shared with the collision code */
+	rimport.FS_FreeFile = Mod_FreeBuffer;
 	rimport.FS_Gamedir = FS_Gamedir;
 	rimport.FS_LoadFile = FS_LoadFile;
 	rimport.FS_AllocFile = Z_Malloc;
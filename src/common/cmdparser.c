@@ -41,6 +41,7 @@ typedef struct cmd_function_s
 } cmd_function_t;
 
 static cmd_function_t *cmd_functions; /* possible commands to execute */
+static namehash_t cmd_hash = {"commands"}; /* cmd_functions by name */
 
 typedef struct cmdalias_s
 {
@@ -52,6 +53,7 @@ typedef struct cmdalias_s
 char retval[256];
 int alias_count; /* for detecting runaway loops */
 cmdalias_t *cmd_alias;
+static namehash_t alias_hash = {"aliases"}; /* cmd_alias by name */
 int cmd_wait;
 static int cmd_argc;
 static char *cmd_argv[MAX_STRING_TOKENS];
@@ -466,23 +468,21 @@ Cmd_Alias_f(void)
 	}
 
 	/* if the alias already exists, reuse it */
-	for (a = cmd_alias; a; a = a->next)
+	a = NameHash_Find(&alias_hash, s);
+
+	if (a)
 	{
-		if (!strcmp(s, a->name))
-		{
-			Z_Free(a->value);
-			break;
-		}
+		Z_Free(a->value);
 	}
-
-	if (!a)
+	else
 	{
 		a = Z_Malloc(sizeof(cmdalias_t));
 		a->next = cmd_alias;
 		cmd_alias = a;
-	}
 
-	strcpy(a->name, s);
+		strcpy(a->name, s);
+		NameHash_Insert(&alias_hash, a->name, a);
+	}
 
 	/* copy the rest of the command line */
 	cmd[0] = 0; /* start out with a null string */
@@ -721,13 +721,10 @@ Cmd_AddCommand(const char *cmd_name, xcommand_t function)
 	}
 
 	/* fail if the command already exists */
-	for (cmd = cmd_functions; cmd; cmd = cmd->next)
+	if (NameHash_Find(&cmd_hash, cmd_name))
 	{
-		if (!strcmp(cmd_name, cmd->name))
-		{
-			Com_Printf("Cmd_AddCommand: %s already defined\n", cmd_name);
-			return;
-		}
+		Com_Printf("Cmd_AddCommand: %s already defined\n", cmd_name);
+		return;
 	}
 
 	cmd = Z_Malloc(sizeof(cmd_function_t));
@@ -742,6 +739,8 @@ Cmd_AddCommand(const char *cmd_name, xcommand_t function)
 	}
 	cmd->next = *pos;
 	*pos = cmd;
+
+	NameHash_Insert(&cmd_hash, cmd->name, cmd);
 }
 
 void
@@ -764,6 +763,7 @@ Cmd_RemoveCommand(const char *cmd_name)
 		if (!strcmp(cmd_name, cmd->name))
 		{
 			*back = cmd->next;
+			NameHash_Remove(&cmd_hash, cmd->name, cmd);
 			Z_Free(cmd);
 			return;
 		}
@@ -775,17 +775,7 @@ Cmd_RemoveCommand(const char *cmd_name)
 qboolean
 Cmd_Exists(const char *cmd_name)
 {
-	const cmd_function_t *cmd;
-
-	for (cmd = cmd_functions; cmd; cmd = cmd->next)
-	{
-		if (!strcmp(cmd_name, cmd->name))
-		{
-			return true;
-		}
-	}
-
-	return false;
+	return NameHash_Find(&cmd_hash, cmd_name) != NULL;
 }
 
 const char *
@@ -1110,39 +1100,48 @@ Cmd_ExecuteString(char *text)
 		doneWithDefaultCfg = true;
 	}
 
-	/* check functions */
-	for (cmd = cmd_functions; cmd; cmd = cmd->next)
+	/* check functions, names differing only in case
+	   are matched if there's no exact one */
+	cmd = NameHash_Find(&cmd_hash, cmd_argv[0]);
+
+	if (!cmd)
 	{
-		if (!Q_strcasecmp(cmd_argv[0], cmd->name))
-		{
-			if (!cmd->function)
-			{
-				/* forward to server command */
-				Cmd_ExecuteString(va("cmd %s", text));
-			}
-			else
-			{
-				cmd->function();
-			}
+		cmd = NameHash_FindNoCase(&cmd_hash, cmd_argv[0]);
+	}
 
-			return;
+	if (cmd)
+	{
+		if (!cmd->function)
+		{
+			/* forward to server command */
+			Cmd_ExecuteString(va("cmd %s", text));
+		}
+		else
+		{
+			cmd->function();
 		}
+
+		return;
 	}
 
 	/* check alias */
-	for (a = cmd_alias; a; a = a->next)
+	a = NameHash_Find(&alias_hash, cmd_argv[0]);
+
+	if (!a)
 	{
-		if (!Q_strcasecmp(cmd_argv[0], a->name))
-		{
-			if (++alias_count == ALIAS_LOOP_COUNT)
-			{
-				Com_Printf("ALIAS_LOOP_COUNT\n");
-				return;
-			}
+		a = NameHash_FindNoCase(&alias_hash, cmd_argv[0]);
+	}
 
-			Cbuf_InsertText(a->value);
+	if (a)
+	{
+		if (++alias_count == ALIAS_LOOP_COUNT)
+		{
+			Com_Printf("ALIAS_LOOP_COUNT\n");
 			return;
 		}
+
+		Cbuf_InsertText(a->value);
+		return;
 	}
 
 	/* check cvars */
@@ -1183,6 +1182,7 @@ Cmd_Init(void)
 	Cmd_AddCommand("echo", Cmd_Echo_f);
 	Cmd_AddCommand("alias", Cmd_Alias_f);
 	Cmd_AddCommand("wait", Cmd_Wait_f);
+	Cmd_AddCommand("hashstats", NameHash_Stats_f);
 }
 
 void
@@ -1197,4 +1197,7 @@ Cmd_Shutdown(void)
 		Z_Free(cmd_alias);
 		cmd_alias = next;
 	}
+
+	NameHash_Clear(&alias_hash);
+	NameHash_Clear(&cmd_hash);
 }
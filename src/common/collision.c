@@ -56,7 +56,6 @@ typedef struct
 	int			contents;
 	unsigned int	numsides;
 	unsigned int	firstbrushside;
-	int			checkcount;	/* to avoid repeated testings */
 } cbrush_t;
 
 typedef struct
@@ -73,6 +72,8 @@ typedef struct
 	unsigned checksum;
 	byte *cache; /* raw converted map */
 	size_t cache_size;
+	void *cachefile; /* map cache file backing cache, if any */
+	int refcount; /* cache references handed out by CM_LoadFile() */
 
 	cleaf_t *map_leafs;
 	int emptyleaf;
@@ -111,6 +112,10 @@ typedef struct
 	int numclusters;
 	int numvisibility;
 
+	byte *vismatrix; /* all PVS and PHS rows, see cm_expandvis */
+	size_t visrowsize;
+	int vismatrixmsec;
+
 	const char *map_entitystring;
 	int numentitychars;
 
@@ -120,6 +125,20 @@ typedef struct
 
 #define MAX_MOD_KNOWN 8
 
+/* Map data freed while the renderer still
+   holds a reference to the raw map. */
+typedef struct cmorphan_s
+{
+	byte *cache;
+	void *extradata;
+	int extradatasize;
+	void *cachefile;
+	int refcount;
+	struct cmorphan_s *next;
+} cmorphan_t;
+
+static cmorphan_t *cm_orphans;
+
 /* Just empty model for cinematic */
 static model_t empty_model;
 /* Loaded models */
@@ -128,31 +147,57 @@ static int model_num = 0;
 static model_t *cmod = models;
 
 // DG: is casted to int32_t* in SV_FatPVS() so align accordingly
-static byte *pvsrow = NULL;
-static byte *phsrow = NULL;
 static byte *ptsrow = NULL;
 static size_t pxsrow_len = 0;
 // -2: nothing is cached
 #define CLUSTER_NOT_CACHED -2
-static int cached_pvs_cluster = CLUSTER_NOT_CACHED;
-static int cached_phs_cluster = CLUSTER_NOT_CACHED;
+
+/* Recently decompressed PVS and PHS rows, least
+   recently used ones are replaced first. Rows are
+   a multiple of 8 bytes and 8 byte aligned. */
+#define CM_VISROWS 16
+
+typedef struct
+{
+	int cluster;
+	int type;
+	unsigned lastused;
+	byte *row;
+} cmvisrow_t;
+
+static cmvisrow_t visrows[CM_VISROWS];
+static byte *visrows_buf = NULL;
+static unsigned visrows_clock;
+
+/* Converted maps are stored in the game dir, so the
+   conversion can be skipped the next time. */
+#define MAPCACHE_IDENT (('C' << 24) + ('M' << 16) + ('Q' << 8) + 'Y')
+#define MAPCACHE_VERSION 1
+#define MAPCACHE_KEYLEN 512
+
+typedef struct
+{
+	int ident;
+	int version;
+	char key[MAPCACHE_KEYLEN]; /* source, size, mtime, maptype */
+	unsigned checksum; /* of the source map */
+	int maptype;
+	int length; /* of the converted map */
+	int ofs; /* of the converted map */
+} mapcache_t;
+
 static cbrush_t *box_brush;
 static cleaf_t *box_leaf;
 static cplane_t *box_planes = NULL;
 static cvar_t *map_noareas;
 static cvar_t *r_maptype;
 static cvar_t *r_game;
+static cvar_t *cm_mapcache;
+static cvar_t *cm_expandvis;
 static int box_headnode;
-static int checkcount;
 static int floodvalid;
-static int leaf_topnode;
-static int trace_contents;
 static mapsurface_t nullsurface;
-static qboolean trace_ispoint; /* optimized case */
-static trace_t trace_trace;
-static vec3_t trace_start, trace_end;
-static vec3_t trace_mins, trace_maxs;
-static vec3_t trace_extents;
+static cmtrace_t trace_ctx; /* of CM_BoxTrace() */
 
 #ifndef DEDICATED_ONLY
 int		c_pointcontents;
@@ -534,7 +579,7 @@ CM_PointLeafnum(const vec3_t p)
  */
 static void
 CM_BoxLeafnums_r(int nodenum, vec3_t leaf_mins, vec3_t leaf_maxs,
-	int *leaf_list, int *leaf_count, int leaf_maxcount)
+	int *leaf_list, int *leaf_count, int leaf_maxcount, int *leaf_topnode)
 {
 	while (1)
 	{
@@ -573,13 +618,13 @@ CM_BoxLeafnums_r(int nodenum, vec3_t leaf_mins, vec3_t leaf_maxs,
 		else
 		{
 			/* go down both */
-			if (leaf_topnode == -1)
+			if (*leaf_topnode == -1)
 			{
-				leaf_topnode = nodenum;
+				*leaf_topnode = nodenum;
 			}
 
 			CM_BoxLeafnums_r(node->children[0], leaf_mins, leaf_maxs, leaf_list,
-				leaf_count, leaf_maxcount);
+				leaf_count, leaf_maxcount, leaf_topnode);
 			nodenum = node->children[1];
 		}
 	}
@@ -589,12 +634,10 @@ static int
 CM_BoxLeafnums_headnode(vec3_t leaf_mins, vec3_t leaf_maxs, int *leaf_list,
 		int leaf_maxcount, int headnode, int *topnode)
 {
-	int leaf_count = 0;
-
-	leaf_topnode = -1;
+	int leaf_count = 0, leaf_topnode = -1;
 
 	CM_BoxLeafnums_r(headnode, leaf_mins, leaf_maxs, leaf_list,
-		&leaf_count, leaf_maxcount);
+		&leaf_count, leaf_maxcount, &leaf_topnode);
 
 	if (topnode)
 	{
@@ -670,8 +713,8 @@ CM_TransformedPointContents(const vec3_t p, int headnode,
 }
 
 static void
-CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
-		vec3_t p2, trace_t *trace, const cbrush_t *brush)
+CM_ClipBoxToBrush(const vec3_t mins, const vec3_t maxs, const vec3_t p1,
+		const vec3_t p2, qboolean ispoint, trace_t *trace, const cbrush_t *brush)
 {
 	cbrushside_t *side, *leadside;
 	float enterfrac, leavefrac;
@@ -713,7 +756,7 @@ CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
 		side = &cmod->map_brushsides[brush->firstbrushside + i];
 		plane = side->plane;
 
-		if (!trace_ispoint)
+		if (!ispoint)
 		{
 			/* general box case
 			   push the plane out
@@ -828,7 +871,7 @@ CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
 }
 
 static void
-CM_TestBoxInBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
+CM_TestBoxInBrush(const vec3_t mins, const vec3_t maxs, const vec3_t p1,
 		trace_t *trace, const cbrush_t *brush)
 {
 	int i, j;
@@ -888,8 +931,24 @@ CM_TestBoxInBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
 	trace->contents = brush->contents;
 }
 
+/*
+ * Returns true if the brush was already checked by the
+ * current trace of the context, marks it otherwise.
+ */
+static qboolean
+CM_BrushChecked(cmtrace_t *ctx, int brushnum)
+{
+	if (ctx->brushmarks[brushnum] == ctx->tracenum)
+	{
+		return true;
+	}
+
+	ctx->brushmarks[brushnum] = ctx->tracenum;
+	return false;
+}
+
 static void
-CM_TraceToLeaf(int leafnum)
+CM_TraceToLeaf(cmtrace_t *ctx, int leafnum)
 {
 	const cleaf_t *leaf;
 	int k, maxleaf;
@@ -901,7 +960,7 @@ CM_TraceToLeaf(int leafnum)
 
 	leaf = &cmod->map_leafs[leafnum];
 
-	if (!(leaf->contents & trace_contents) || !cmod->numleafbrushes)
+	if (!(leaf->contents & ctx->contents) || !cmod->numleafbrushes)
 	{
 		return;
 	}
@@ -930,22 +989,20 @@ CM_TraceToLeaf(int leafnum)
 
 		b = &cmod->map_brushes[brushnum];
 
-		if (b->checkcount == checkcount)
+		if (CM_BrushChecked(ctx, brushnum))
 		{
 			continue; /* already checked this brush in another leaf */
 		}
 
-		b->checkcount = checkcount;
-
-		if (!(b->contents & trace_contents))
+		if (!(b->contents & ctx->contents))
 		{
 			continue;
 		}
 
-		CM_ClipBoxToBrush(trace_mins, trace_maxs, trace_start,
-				trace_end, &trace_trace, b);
+		CM_ClipBoxToBrush(ctx->mins, ctx->maxs, ctx->start,
+				ctx->end, ctx->ispoint, &ctx->trace, b);
 
-		if (!trace_trace.fraction)
+		if (!ctx->trace.fraction)
 		{
 			return;
 		}
@@ -953,7 +1010,7 @@ CM_TraceToLeaf(int leafnum)
 }
 
 static void
-CM_TestInLeaf(int leafnum)
+CM_TestInLeaf(cmtrace_t *ctx, int leafnum)
 {
 	const cleaf_t *leaf;
 	int k, maxleaf;
@@ -965,7 +1022,7 @@ CM_TestInLeaf(int leafnum)
 
 	leaf = &cmod->map_leafs[leafnum];
 
-	if (!(leaf->contents & trace_contents) || !cmod->numleafbrushes)
+	if (!(leaf->contents & ctx->contents) || !cmod->numleafbrushes)
 	{
 		return;
 	}
@@ -994,21 +1051,19 @@ CM_TestInLeaf(int leafnum)
 
 		b = &cmod->map_brushes[brushnum];
 
-		if (b->checkcount == checkcount)
+		if (CM_BrushChecked(ctx, brushnum))
 		{
 			continue; /* already checked this brush in another leaf */
 		}
 
-		b->checkcount = checkcount;
-
-		if (!(b->contents & trace_contents))
+		if (!(b->contents & ctx->contents))
 		{
 			continue;
 		}
 
-		CM_TestBoxInBrush(trace_mins, trace_maxs, trace_start, &trace_trace, b);
+		CM_TestBoxInBrush(ctx->mins, ctx->maxs, ctx->start, &ctx->trace, b);
 
-		if (!trace_trace.fraction)
+		if (!ctx->trace.fraction)
 		{
 			return;
 		}
@@ -1016,7 +1071,8 @@ CM_TestInLeaf(int leafnum)
 }
 
 static void
-CM_RecursiveHullCheck(int num, float p1f, float p2f, const vec3_t p1, const vec3_t p2)
+CM_RecursiveHullCheck(cmtrace_t *ctx, int num, float p1f, float p2f,
+		const vec3_t p1, const vec3_t p2)
 {
 	cnode_t *node;
 	cplane_t *plane;
@@ -1028,7 +1084,7 @@ CM_RecursiveHullCheck(int num, float p1f, float p2f, const vec3_t p1, const vec3
 	int side;
 	float midf;
 
-	if (trace_trace.fraction <= p1f)
+	if (ctx->trace.fraction <= p1f)
 	{
 		return; /* already hit something nearer */
 	}
@@ -1036,7 +1092,7 @@ CM_RecursiveHullCheck(int num, float p1f, float p2f, const vec3_t p1, const vec3
 	/* if < 0, we are in a leaf node */
 	if (num < 0)
 	{
-		CM_TraceToLeaf(-1 - num);
+		CM_TraceToLeaf(ctx, -1 - num);
 		return;
 	}
 
@@ -1055,7 +1111,7 @@ CM_RecursiveHullCheck(int num, float p1f, float p2f, const vec3_t p1, const vec3
 	{
 		t1 = p1[plane->type] - plane->dist;
 		t2 = p2[plane->type] - plane->dist;
-		offset = trace_extents[plane->type];
+		offset = ctx->extents[plane->type];
 	}
 
 	else
@@ -1063,29 +1119,29 @@ CM_RecursiveHullCheck(int num, float p1f, float p2f, const vec3_t p1, const vec3
 		t1 = DotProduct(plane->normal, p1) - plane->dist;
 		t2 = DotProduct(plane->normal, p2) - plane->dist;
 
-		if (trace_ispoint)
+		if (ctx->ispoint)
 		{
 			offset = 0;
 		}
 
 		else
 		{
-			offset = (float)fabs(trace_extents[0] * plane->normal[0]) +
-					 (float)fabs(trace_extents[1] * plane->normal[1]) +
-					 (float)fabs(trace_extents[2] * plane->normal[2]);
+			offset = (float)fabs(ctx->extents[0] * plane->normal[0]) +
+					 (float)fabs(ctx->extents[1] * plane->normal[1]) +
+					 (float)fabs(ctx->extents[2] * plane->normal[2]);
 		}
 	}
 
 	/* see which sides we need to consider */
 	if ((t1 >= offset) && (t2 >= offset))
 	{
-		CM_RecursiveHullCheck(node->children[0], p1f, p2f, p1, p2);
+		CM_RecursiveHullCheck(ctx, node->children[0], p1f, p2f, p1, p2);
 		return;
 	}
 
 	if ((t1 < -offset) && (t2 < -offset))
 	{
-		CM_RecursiveHullCheck(node->children[1], p1f, p2f, p1, p2);
+		CM_RecursiveHullCheck(ctx, node->children[1], p1f, p2f, p1, p2);
 		return;
 	}
 
@@ -1131,7 +1187,7 @@ CM_RecursiveHullCheck(int num, float p1f, float p2f, const vec3_t p1, const vec3
 		mid[i] = p1[i] + frac * (p2[i] - p1[i]);
 	}
 
-	CM_RecursiveHullCheck(node->children[side], p1f, midf, p1, mid);
+	CM_RecursiveHullCheck(ctx, node->children[side], p1f, midf, p1, mid);
 
 	/* go past the node */
 	if (frac2 < 0)
@@ -1151,34 +1207,95 @@ CM_RecursiveHullCheck(int num, float p1f, float p2f, const vec3_t p1, const vec3
 		mid[i] = p1[i] + frac2 * (p2[i] - p1[i]);
 	}
 
-	CM_RecursiveHullCheck(node->children[side ^ 1], midf, p2f, mid, p2);
+	CM_RecursiveHullCheck(ctx, node->children[side ^ 1], midf, p2f, mid, p2);
 }
 
-trace_t
-CM_BoxTrace(const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs,
-		int headnode, int brushmask)
+void
+CM_InitTraceContext(cmtrace_t *ctx)
 {
-	checkcount++; /* for multi-check avoidance */
+	memset(ctx, 0, sizeof(*ctx));
+}
 
+void
+CM_FreeTraceContext(cmtrace_t *ctx)
+{
+	free(ctx->brushmarks);
+	memset(ctx, 0, sizeof(*ctx));
+}
+
+/*
+ * Starts a new trace of the context, the brush marks
+ * grow with the map and are reset when the trace
+ * number wraps around.
+ */
+static qboolean
+CM_BeginTrace(cmtrace_t *ctx)
+{
+	int numbrushes;
+
+	numbrushes = cmod->numbrushes + EXTRA_LUMP_BRUSHES;
+
+	if (numbrushes > ctx->numbrushmarks)
+	{
+		unsigned *tmp;
+
+		tmp = realloc(ctx->brushmarks, numbrushes * sizeof(*tmp));
+		YQ2_COM_CHECK_OOM(tmp, "realloc()", numbrushes * sizeof(*tmp))
+		if (!tmp)
+		{
+			/* unaware about YQ2_ATTR_NORETURN_FUNCPTR? */
+			return false;
+		}
+
+		ctx->brushmarks = tmp;
+		ctx->numbrushmarks = numbrushes;
+		memset(ctx->brushmarks, 0, numbrushes * sizeof(*tmp));
+		ctx->tracenum = 0;
+	}
+
+	if (!++ctx->tracenum)
+	{
+		memset(ctx->brushmarks, 0, ctx->numbrushmarks * sizeof(unsigned));
+		ctx->tracenum = 1;
+	}
+
+	return true;
+}
+
+/*
+ * Like CM_BoxTrace(), but keeps all state of the trace in
+ * ctx. Traces with different contexts can run at the same
+ * time, as long as the map isn't changed and no box hull
+ * (CM_HeadnodeForBox()) is set up meanwhile.
+ */
+trace_t
+CM_BoxTraceContext(cmtrace_t *ctx, const vec3_t start, const vec3_t end,
+		const vec3_t mins, const vec3_t maxs, int headnode, int brushmask)
+{
 #ifndef DEDICATED_ONLY
 	c_traces++; /* for statistics, may be zeroed */
 #endif
 
 	/* fill in a default trace */
-	memset(&trace_trace, 0, sizeof(trace_trace));
-	trace_trace.fraction = 1;
-	trace_trace.surface = &(nullsurface.c);
+	memset(&ctx->trace, 0, sizeof(ctx->trace));
+	ctx->trace.fraction = 1;
+	ctx->trace.surface = &(nullsurface.c);
 
 	if (!cmod->numnodes)  /* map not loaded */
 	{
-		return trace_trace;
+		return ctx->trace;
+	}
+
+	if (!CM_BeginTrace(ctx)) /* for multi-check avoidance */
+	{
+		return ctx->trace;
 	}
 
-	trace_contents = brushmask;
-	VectorCopy(start, trace_start);
-	VectorCopy(end, trace_end);
-	VectorCopy(mins, trace_mins);
-	VectorCopy(maxs, trace_maxs);
+	ctx->contents = brushmask;
+	VectorCopy(start, ctx->start);
+	VectorCopy(end, ctx->end);
+	VectorCopy(mins, ctx->mins);
+	VectorCopy(maxs, ctx->maxs);
 
 	/* check for position test special case */
 	if ((start[0] == end[0]) && (start[1] == end[1]) && (start[2] == end[2]))
@@ -1202,40 +1319,40 @@ CM_BoxTrace(const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_
 
 		for (i = 0; i < numleafs; i++)
 		{
-			CM_TestInLeaf(leafs[i]);
+			CM_TestInLeaf(ctx, leafs[i]);
 
-			if (trace_trace.allsolid)
+			if (ctx->trace.allsolid)
 			{
 				break;
 			}
 		}
 
-		VectorCopy(start, trace_trace.endpos);
-		return trace_trace;
+		VectorCopy(start, ctx->trace.endpos);
+		return ctx->trace;
 	}
 
 	/* check for point special case */
 	if ((mins[0] == 0) && (mins[1] == 0) && (mins[2] == 0) &&
 		(maxs[0] == 0) && (maxs[1] == 0) && (maxs[2] == 0))
 	{
-		trace_ispoint = true;
-		VectorClear(trace_extents);
+		ctx->ispoint = true;
+		VectorClear(ctx->extents);
 	}
 
 	else
 	{
-		trace_ispoint = false;
-		trace_extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
-		trace_extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
-		trace_extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
+		ctx->ispoint = false;
+		ctx->extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
+		ctx->extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
+		ctx->extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
 	}
 
 	/* general sweeping through world */
-	CM_RecursiveHullCheck(headnode, 0, 1, start, end);
+	CM_RecursiveHullCheck(ctx, headnode, 0, 1, start, end);
 
-	if (trace_trace.fraction == 1)
+	if (ctx->trace.fraction == 1)
 	{
-		VectorCopy(end, trace_trace.endpos);
+		VectorCopy(end, ctx->trace.endpos);
 	}
 	else
 	{
@@ -1243,12 +1360,20 @@ CM_BoxTrace(const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_
 
 		for (i = 0; i < 3; i++)
 		{
-			trace_trace.endpos[i] = start[i] + trace_trace.fraction *
+			ctx->trace.endpos[i] = start[i] + ctx->trace.fraction *
 									(end[i] - start[i]);
 		}
 	}
 
-	return trace_trace;
+	return ctx->trace;
+}
+
+trace_t
+CM_BoxTrace(const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs,
+		int headnode, int brushmask)
+{
+	return CM_BoxTraceContext(&trace_ctx, start, end, mins, maxs,
+		headnode, brushmask);
 }
 
 /*
@@ -1256,9 +1381,9 @@ CM_BoxTrace(const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_
  * rotating entities
  */
 trace_t
-CM_TransformedBoxTrace(const vec3_t start, const vec3_t end,
-		const vec3_t mins, const vec3_t maxs, int headnode, int brushmask,
-		const vec3_t origin, const vec3_t angles)
+CM_TransformedBoxTraceContext(cmtrace_t *ctx, const vec3_t start,
+		const vec3_t end, const vec3_t mins, const vec3_t maxs, int headnode,
+		int brushmask, const vec3_t origin, const vec3_t angles)
 {
 	vec3_t forward, right, up;
 	vec3_t start_l, end_l;
@@ -1298,7 +1423,8 @@ CM_TransformedBoxTrace(const vec3_t start, const vec3_t end,
 	}
 
 	/* sweep the box through the model */
-	trace = CM_BoxTrace(start_l, end_l, mins, maxs, headnode, brushmask);
+	trace = CM_BoxTraceContext(ctx, start_l, end_l, mins, maxs,
+		headnode, brushmask);
 
 	if (rotated && (trace.fraction != 1.0))
 	{
@@ -1320,6 +1446,15 @@ CM_TransformedBoxTrace(const vec3_t start, const vec3_t end,
 	return trace;
 }
 
+trace_t
+CM_TransformedBoxTrace(const vec3_t start, const vec3_t end,
+		const vec3_t mins, const vec3_t maxs, int headnode, int brushmask,
+		const vec3_t origin, const vec3_t angles)
+{
+	return CM_TransformedBoxTraceContext(&trace_ctx, start, end, mins, maxs,
+		headnode, brushmask, origin, angles);
+}
+
 static void
 CMod_LoadSubmodels(const char *name, cmodel_t *map_cmodels, int *numcmodels, int numnodes,
 	const byte *cmod_base, const lump_t *l)
@@ -1781,31 +1916,84 @@ CMod_LoadEntityString(const char *name, const char **map_entitystring, int *nume
 	*map_entitystring = (const char *)cmod_base + l->fileofs;
 }
 
+static void
+CM_FreeModData(void *extradata, int extradatasize, void *cachefile)
+{
+	if (extradata && extradatasize)
+	{
+		Hunk_Free(extradata);
+	}
+
+	if (cachefile)
+	{
+		FS_FreeFile(cachefile);
+	}
+}
+
 static void
 CM_ModFree(model_t *cmod)
 {
-	if (cmod->extradata && cmod->extradatasize)
+	if (cmod->refcount)
+	{
+		cmorphan_t *orphan;
+
+		/* Still referenced, freed by the last CM_FreeFile() */
+		orphan = malloc(sizeof(*orphan));
+		YQ2_COM_CHECK_OOM(orphan, "malloc()", sizeof(*orphan))
+		if (!orphan)
+		{
+			/* unaware about YQ2_ATTR_NORETURN_FUNCPTR? */
+			return;
+		}
+
+		orphan->cache = cmod->cache;
+		orphan->extradata = cmod->extradata;
+		orphan->extradatasize = cmod->extradatasize;
+		orphan->cachefile = cmod->cachefile;
+		orphan->refcount = cmod->refcount;
+		orphan->next = cm_orphans;
+		cm_orphans = orphan;
+	}
+	else
 	{
-		Hunk_Free(cmod->extradata);
+		CM_FreeModData(cmod->extradata, cmod->extradatasize,
+			cmod->cachefile);
 	}
 
+	free(cmod->vismatrix);
+
 	memset(cmod, 0, sizeof(model_t));
 }
 
+static void
+CM_FlushVisRows(void)
+{
+	int i;
+
+	for (i = 0; i < CM_VISROWS; i++)
+	{
+		visrows[i].cluster = CLUSTER_NOT_CACHED;
+		visrows[i].lastused = 0;
+	}
+}
+
 void
 CM_ModInit(void)
 {
 	memset(models, 0, sizeof(models));
 
 	/* init buffers for PVS/PHS buffers*/
-	pvsrow = NULL;
-	phsrow = NULL;
+	memset(visrows, 0, sizeof(visrows));
+	CM_FlushVisRows();
+	visrows_buf = NULL;
 	ptsrow = NULL;
 	pxsrow_len = 0;
 
 	map_noareas = Cvar_Get("map_noareas", "0", 0);
 	r_maptype = Cvar_Get("maptype", "0", CVAR_ARCHIVE);
 	r_game = Cvar_Get("game", "", CVAR_LATCH | CVAR_SERVERINFO);
+	cm_mapcache = Cvar_Get("cm_mapcache", "1", CVAR_ARCHIVE);
+	cm_expandvis = Cvar_Get("cm_expandvis", "0", CVAR_ARCHIVE);
 }
 
 void
@@ -1819,16 +2007,10 @@ CM_ModFreeAll(void)
 	}
 
 	/* Free up buffer for PVS/PHS */
-	if (pvsrow)
-	{
-		free(pvsrow);
-		pvsrow = NULL;
-	}
-
-	if (phsrow)
+	if (visrows_buf)
 	{
-		free(phsrow);
-		phsrow = NULL;
+		free(visrows_buf);
+		visrows_buf = NULL;
 	}
 
 	if (ptsrow)
@@ -1837,44 +2019,198 @@ CM_ModFreeAll(void)
 		ptsrow = NULL;
 	}
 
+	memset(visrows, 0, sizeof(visrows));
+	CM_FlushVisRows();
 	pxsrow_len = 0;
-	cached_pvs_cluster = CLUSTER_NOT_CACHED;
-	cached_phs_cluster = CLUSTER_NOT_CACHED;
+
+	CM_FreeTraceContext(&trace_ctx);
 
 	Com_Printf("Server models free up\n");
 }
 
+/*
+ * Builds the name of the map cache file and the key
+ * identifying the source map it was converted from.
+ */
+static qboolean
+CM_MapCacheKey(const char *name, char *path, size_t pathsize,
+	char *key, size_t keysize)
+{
+	char source[MAX_OSPATH];
+	long long mtime;
+	char *ext;
+	int size;
+
+	if (!cm_mapcache->value ||
+		!FS_FileSource(name, source, sizeof(source), &size, &mtime))
+	{
+		return false;
+	}
+
+	Com_sprintf(path, pathsize, "mapcache/%s", name);
+
+	ext = strrchr(path, '.');
+
+	if (ext && !strchr(ext, '/'))
+	{
+		*ext = '\0';
+	}
+
+	Q_strlcat(path, ".qbsp", pathsize);
+
+	Com_sprintf(key, keysize, "%s|%s|%d|%lld|%d|%s",
+		name, source, size, mtime, (int)r_maptype->value, YQ2VERSION);
+
+	return true;
+}
+
+/*
+ * Returns the converted map stored in the map cache
+ * or NULL if there's no usable one. The cache file
+ * stays loaded in mod->cachefile.
+ */
+static byte *
+CM_ReadMapCache(model_t *mod, const char *path, const char *key,
+	size_t *length)
+{
+	const mapcache_t *hdr;
+	int filelen;
+	void *buf;
+
+	filelen = FS_LoadFileFromGamedir(path, &buf);
+
+	if (!buf)
+	{
+		return NULL;
+	}
+
+	hdr = buf;
+
+	if ((filelen < sizeof(*hdr)) ||
+		(LittleLong(hdr->ident) != MAPCACHE_IDENT) ||
+		(LittleLong(hdr->version) != MAPCACHE_VERSION) ||
+		strncmp(hdr->key, key, sizeof(hdr->key)) ||
+		(LittleLong(hdr->ofs) < sizeof(*hdr)) ||
+		(LittleLong(hdr->length) < sizeof(dheader_t)) ||
+		(LittleLong(hdr->ofs) + LittleLong(hdr->length) > filelen))
+	{
+		Com_DPrintf("%s: %s is stale\n", __func__, path);
+		FS_FreeFile(buf);
+		return NULL;
+	}
+
+	mod->cachefile = buf;
+	mod->checksum = LittleLong(hdr->checksum);
+	*length = LittleLong(hdr->length);
+
+	return (byte *)buf + LittleLong(hdr->ofs);
+}
+
+/*
+ * Stores the converted map in the map cache. Written
+ * to a temporary file first, so other processes never
+ * see partial files.
+ */
+static void
+CM_WriteMapCache(const char *path, const char *key, unsigned checksum,
+	const byte *data, size_t length)
+{
+	char fullpath[MAX_OSPATH], tmppath[MAX_OSPATH];
+	mapcache_t hdr;
+	qboolean ok;
+	FILE *f;
+
+	Com_sprintf(fullpath, sizeof(fullpath), "%s/%s", FS_Gamedir(), path);
+	Com_sprintf(tmppath, sizeof(tmppath), "%s.tmp", fullpath);
+
+	FS_CreatePath(fullpath);
+
+	if ((f = Q_fopen(tmppath, "wb")) == NULL)
+	{
+		Com_DPrintf("%s: Couldn't write %s\n", __func__, tmppath);
+		return;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ident = LittleLong(MAPCACHE_IDENT);
+	hdr.version = LittleLong(MAPCACHE_VERSION);
+	Q_strlcpy(hdr.key, key, sizeof(hdr.key));
+	hdr.checksum = LittleLong(checksum);
+	hdr.maptype = LittleLong((int)r_maptype->value);
+	hdr.length = LittleLong(length);
+	hdr.ofs = LittleLong(sizeof(hdr));
+
+	ok = (fwrite(&hdr, sizeof(hdr), 1, f) == 1) &&
+		(fwrite(data, length, 1, f) == 1);
+
+	if (fclose(f) || !ok)
+	{
+		Com_DPrintf("%s: Couldn't write %s\n", __func__, tmppath);
+		Sys_Remove(tmppath);
+		return;
+	}
+
+	/* rename() doesn't replace files on Windows */
+	Sys_Remove(fullpath);
+
+	if (Sys_Rename(tmppath, fullpath))
+	{
+		Com_DPrintf("%s: Couldn't rename %s\n", __func__, tmppath);
+		Sys_Remove(tmppath);
+	}
+}
+
 static void
 CM_LoadCachedMap(const char *name, model_t *mod)
 {
+	char path[MAX_OSPATH], key[MAPCACHE_KEYLEN];
 	size_t length, hunkSize;
 	byte *cmod_base, *filebuf;
 	maptype_t maptype;
 	dheader_t *header;
+	qboolean usecache;
 	int filelen;
 
-	filelen = FS_LoadFile(name, (void **)&filebuf);
+	cmod_base = NULL;
+	usecache = CM_MapCacheKey(name, path, sizeof(path), key, sizeof(key));
 
-	if (!filebuf || filelen <= 0)
+	if (usecache)
 	{
-		Com_Printf("%s: Couldn't load %s\n", __func__, name);
-		return;
+		cmod_base = CM_ReadMapCache(mod, path, key, &length);
 	}
 
-	mod->checksum = LittleLong(Com_BlockChecksum(filebuf, filelen));
+	if (!cmod_base)
+	{
+		filelen = FS_LoadFile(name, (void **)&filebuf);
+
+		if (!filebuf || filelen <= 0)
+		{
+			Com_Printf("%s: Couldn't load %s\n", __func__, name);
+			return;
+		}
+
+		mod->checksum = LittleLong(Com_BlockChecksum(filebuf, filelen));
 
-	/* Can't detect will use provided */
-	maptype = r_maptype->value;
+		/* Can't detect will use provided */
+		maptype = r_maptype->value;
 
-	cmod_base = Mod_Load2QBSP(name, (byte *)filebuf, filelen, &length, &maptype);
-	FS_FreeFile(filebuf);
+		cmod_base = Mod_Load2QBSP(name, (byte *)filebuf, filelen, &length, &maptype);
+		FS_FreeFile(filebuf);
+
+		if (usecache)
+		{
+			CM_WriteMapCache(path, key, mod->checksum, cmod_base, length);
+		}
+	}
 
 	header = (dheader_t *)cmod_base;
 
 	/* load into heap */
 	Q_strlcpy(mod->name, name, sizeof(mod->name));
 
-	hunkSize = length; /* allocate memory for future maps cache */
+	/* allocate memory for future maps cache, a cache
+	   file is used in place */
+	hunkSize = mod->cachefile ? 0 : length;
 	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_TEXINFO],
 		sizeof(xtexinfo_t), sizeof(mapsurface_t), EXTRA_LUMP_TEXINFO);
 	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_LEAFS],
@@ -1902,8 +2238,16 @@ CM_LoadCachedMap(const char *name, model_t *mod)
 
 	mod->extradata = Hunk_Begin(hunkSize);
 
-	mod->cache = Hunk_Alloc(length);
-	memcpy(mod->cache, cmod_base, length);
+	if (mod->cachefile)
+	{
+		mod->cache = cmod_base;
+	}
+	else
+	{
+		mod->cache = Hunk_Alloc(length);
+		memcpy(mod->cache, cmod_base, length);
+	}
+
 	mod->cache_size = length;
 
 	CMod_LoadSurfaces(mod->name, &mod->map_surfaces, &mod->numtexinfo,
@@ -1950,34 +2294,33 @@ CM_LoadCachedMap(const char *name, model_t *mod)
 	Com_DPrintf("Allocated %d from expected " YQ2_COM_PRIdS " hunk size\n",
 		mod->extradatasize, hunkSize);
 
-	free(cmod_base);
+	if (!mod->cachefile)
+	{
+		free(cmod_base);
+	}
 
-	if ((mod->numleafs > pxsrow_len) || !pvsrow || !phsrow || !ptsrow)
+	if ((mod->numleafs > pxsrow_len) || !visrows_buf || !ptsrow)
 	{
 		byte *tmp;
+		int i;
 
 		/* reallocate buffers for PVS/PHS buffers*/
 		pxsrow_len = (mod->numleafs + 63) & ~63;
-		tmp = realloc(pvsrow, pxsrow_len / 8);
-		YQ2_COM_CHECK_OOM(tmp, "realloc()", pxsrow_len / 8)
+		tmp = realloc(visrows_buf, CM_VISROWS * pxsrow_len / 8);
+		YQ2_COM_CHECK_OOM(tmp, "realloc()", CM_VISROWS * pxsrow_len / 8)
 		if (!tmp)
 		{
 			/* unaware about YQ2_ATTR_NORETURN_FUNCPTR? */
 			return;
 		}
 
-		pvsrow = tmp;
+		visrows_buf = tmp;
 
-		tmp = realloc(phsrow, pxsrow_len / 8);
-		YQ2_COM_CHECK_OOM(tmp, "realloc()", pxsrow_len / 8)
-		if (!tmp)
+		for (i = 0; i < CM_VISROWS; i++)
 		{
-			/* unaware about YQ2_ATTR_NORETURN_FUNCPTR? */
-			return;
+			visrows[i].row = visrows_buf + i * pxsrow_len / 8;
 		}
 
-		phsrow = tmp;
-
 		tmp = realloc(ptsrow, pxsrow_len / 8);
 		YQ2_COM_CHECK_OOM(tmp, "realloc()", pxsrow_len / 8)
 		if (!tmp)
@@ -1988,14 +2331,74 @@ CM_LoadCachedMap(const char *name, model_t *mod)
 
 		ptsrow = tmp;
 
-		cached_pvs_cluster = CLUSTER_NOT_CACHED;
-		cached_phs_cluster = CLUSTER_NOT_CACHED;
+		CM_FlushVisRows();
 
 		Com_Printf("Allocated " YQ2_COM_PRIdS " bit leafs of PVS/PHS buffer\n",
 			pxsrow_len);
 	}
 }
 
+/*
+ * Decompresses all PVS and PHS rows of the map into one
+ * bit matrix, so a row lookup is just a pointer into it.
+ * Row cluster * 2 + type, the last row is the empty one
+ * for cluster -1. Frees the matrix if cm_expandvis was
+ * switched off.
+ */
+static void
+CM_ExpandVis(model_t *mod)
+{
+	size_t rowsize, matrixsize;
+	int i, start;
+
+	if (!cm_expandvis->value || !mod->map_vis)
+	{
+		free(mod->vismatrix);
+		mod->vismatrix = NULL;
+		mod->visrowsize = 0;
+		mod->vismatrixmsec = 0;
+		return;
+	}
+
+	if (mod->vismatrix)
+	{
+		return;
+	}
+
+	start = Sys_Milliseconds();
+
+	/* multiple of 8 bytes for SV_FatPVS() */
+	rowsize = ((mod->numclusters + 63) & ~63) / 8;
+	matrixsize = rowsize * (mod->numclusters * 2 + 1);
+
+	mod->vismatrix = calloc(1, matrixsize);
+	if (!mod->vismatrix)
+	{
+		Com_Printf("%s: Couldn't allocate " YQ2_COM_PRIdS " bytes for %s\n",
+			__func__, matrixsize, mod->name);
+		return;
+	}
+
+	for (i = 0; i < mod->numclusters; i++)
+	{
+		byte *row;
+
+		row = mod->vismatrix + i * 2 * rowsize;
+
+		Mod_DecompressVis((byte *)mod->map_vis +
+				mod->map_vis->bitofs[i][DVIS_PVS], row,
+				(byte *)mod->map_vis + mod->numvisibility,
+				(mod->numclusters + 7) >> 3);
+		Mod_DecompressVis((byte *)mod->map_vis +
+				mod->map_vis->bitofs[i][DVIS_PHS], row + rowsize,
+				(byte *)mod->map_vis + mod->numvisibility,
+				(mod->numclusters + 7) >> 3);
+	}
+
+	mod->visrowsize = rowsize;
+	mod->vismatrixmsec = Sys_Milliseconds() - start;
+}
+
 const byte *
 CM_GetRawMap(int *len)
 {
@@ -2088,14 +2491,32 @@ CM_LoadMap(const char *name, qboolean clientload, unsigned *checksum)
 
 	*checksum = cmod->checksum;
 
+	CM_ExpandVis(cmod);
+
+	/* rows of the previous map */
+	CM_FlushVisRows();
+
 	CM_InitBoxHull();
 
 	memset(cmod->portalopen, 0, sizeof(qboolean) * cmod->numareaportals);
 	FloodAreaConnections();
 
-	Com_DPrintf("%s: Loaded map: %s: %d Kb in %.2fs\n",
-		__func__, name, cmod->extradatasize / 1024,
-		(Sys_Milliseconds() - sec_start) / 1000.0);
+	if (cmod->vismatrix)
+	{
+		Com_DPrintf("%s: Loaded map: %s: %d Kb in %.2fs, vis matrix "
+			YQ2_COM_PRIdS " Kb in %.2fs\n",
+			__func__, name, cmod->extradatasize / 1024,
+			(Sys_Milliseconds() - sec_start) / 1000.0,
+			cmod->visrowsize * (cmod->numclusters * 2 + 1) / 1024,
+			cmod->vismatrixmsec / 1000.0);
+	}
+	else
+	{
+		Com_DPrintf("%s: Loaded map: %s: %d Kb in %.2fs\n",
+			__func__, name, cmod->extradatasize / 1024,
+			(Sys_Milliseconds() - sec_start) / 1000.0);
+	}
+
 	return cmod->map_cmodels;
 }
 
@@ -2246,32 +2667,73 @@ CM_Cluster(int cluster, int type, byte *buffer, size_t size)
 	return buffer;
 }
 
-const byte *
-CM_ClusterPVS(int cluster, size_t *size)
+/*
+ * Returns the decompressed row from the row cache. It stays
+ * valid for at least CM_VISROWS - 1 further calls.
+ */
+static const byte *
+CM_CachedCluster(int cluster, int type, size_t *size)
 {
-	const byte *result;
+	cmvisrow_t *row, *lru;
+	int i;
+
+	if (cmod->vismatrix)
+	{
+		if (cluster < -1 || cluster >= cmod->numclusters)
+		{
+			Com_Error(ERR_DROP, "%s: bad cluster", __func__);
+			return NULL;
+		}
+
+		*size = cmod->visrowsize;
+
+		if (cluster == -1)
+		{
+			return cmod->vismatrix +
+				cmod->numclusters * 2 * cmod->visrowsize;
+		}
+
+		return cmod->vismatrix + (cluster * 2 + type) * cmod->visrowsize;
+	}
+
 	*size = pxsrow_len / 8;
-	if (cluster == cached_pvs_cluster)
+	lru = &visrows[0];
+
+	for (i = 0; i < CM_VISROWS; i++)
 	{
-		return pvsrow;
+		row = &visrows[i];
+
+		if ((row->cluster == cluster) && (row->type == type))
+		{
+			row->lastused = ++visrows_clock;
+			return row->row;
+		}
+
+		if (row->lastused < lru->lastused)
+		{
+			lru = row;
+		}
 	}
-	result = CM_Cluster(cluster, DVIS_PVS, pvsrow, *size);
-	cached_pvs_cluster = cluster;
-	return result;
+
+	CM_Cluster(cluster, type, lru->row, *size);
+
+	lru->cluster = cluster;
+	lru->type = type;
+	lru->lastused = ++visrows_clock;
+
+	return lru->row;
+}
+
+const byte *
+CM_ClusterPVS(int cluster, size_t *size)
+{
+	return CM_CachedCluster(cluster, DVIS_PVS, size);
 }
 
 const byte *
 CM_ClusterPHS(int cluster, size_t *size)
 {
-	const byte *result;
-	*size = pxsrow_len / 8;
-	if (cluster == cached_phs_cluster)
-	{
-		return phsrow;
-	}
-	result = CM_Cluster(cluster, DVIS_PHS, phsrow, *size);
-	cached_phs_cluster = cluster;
-	return result;
+	return CM_CachedCluster(cluster, DVIS_PHS, size);
 }
 
 byte *
@@ -2282,7 +2744,9 @@ CM_ClusterPTS(size_t *size)
 }
 
 /*
- * Return file content for most case but could cache converted file in future
+ * Returns the converted map already loaded by the collision
+ * code. The buffer is shared and must be treated as read only,
+ * release it with CM_FreeFile().
  */
 int
 CM_LoadFile(const char *path, void **buffer)
@@ -2296,8 +2760,8 @@ CM_LoadFile(const char *path, void **buffer)
 			models[i].cache &&
 			models[i].extradatasize)
 		{
-			*buffer = Z_Malloc(models[i].cache_size);
-			memcpy(*buffer, models[i].cache, models[i].cache_size);
+			models[i].refcount++;
+			*buffer = models[i].cache;
 			return models[i].cache_size;
 		}
 	}
@@ -2306,3 +2770,42 @@ CM_LoadFile(const char *path, void **buffer)
 		__func__, path);
 	return -1;
 }
+
+/*
+ * Drops a reference returned by CM_LoadFile(). Returns
+ * false if the buffer isn't a map owned by the collision
+ * code.
+ */
+qboolean
+CM_FreeFile(const void *buffer)
+{
+	cmorphan_t *orphan, **prev;
+	int i;
+
+	for (i = 0; i < MAX_MOD_KNOWN; i++)
+	{
+		if (models[i].refcount && models[i].cache == buffer)
+		{
+			models[i].refcount--;
+			return true;
+		}
+	}
+
+	for (prev = &cm_orphans, orphan = cm_orphans; orphan; prev = &orphan->next, orphan = orphan->next)
+	{
+		if (orphan->cache == buffer)
+		{
+			if (!--orphan->refcount)
+			{
+				CM_FreeModData(orphan->extradata, orphan->extradatasize,
+					orphan->cachefile);
+				*prev = orphan->next;
+				free(orphan);
+			}
+
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -28,6 +28,9 @@
 
 cvar_t *cvar_vars;
 
+/* cvar_vars by name */
+static namehash_t cvar_hash = {"cvars"};
+
 
 typedef struct
 {
@@ -178,17 +181,7 @@ Cvar_InfoValidate(const char *s)
 static cvar_t *
 Cvar_FindVar(const char *var_name)
 {
-	cvar_t *var;
-
-	for (var = cvar_vars; var; var = var->next)
-	{
-		if (!strcmp(var_name, var->name))
-		{
-			return var;
-		}
-	}
-
-	return NULL;
+	return NameHash_Find(&cvar_hash, var_name);
 }
 
 static qboolean
@@ -278,6 +271,8 @@ Cvar_AddToList(const char *var_name, const char *var_value, int flags)
 	var->next = *pos;
 	*pos = var;
 
+	NameHash_Insert(&cvar_hash, var->name, var);
+
 	return var;
 }
 
@@ -963,6 +958,7 @@ Cvar_FreeList(void)
 	}
 
 	cvar_vars = NULL;
+	NameHash_Clear(&cvar_hash);
 }
 
 void
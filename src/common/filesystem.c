@@ -25,10 +25,19 @@
  * =======================================================================
  */
 
+#include <ctype.h>
+
 #ifndef _MSC_VER
 #include <libgen.h>
 #endif
 
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #include "header/common.h"
 #include "header/glob.h"
 
@@ -45,6 +54,9 @@
 #define MAX_MODS 32
 #define MAX_PAKS 100
 
+/* Smaller files are cheaper to read than to map. */
+#define FS_MMAP_MINSIZE (64 * 1024)
+
 #ifdef SYSTEMWIDE
  #ifndef SYSTEMDIR
   #define SYSTEMDIR "/usr/share/games/quake2"
@@ -58,16 +70,6 @@ typedef enum
 	PAK_MODE_DAT,
 } fsPackCompress_t;
 
-typedef struct
-{
-	char name[MAX_FILENAME];
-	fsMode_t mode;
-	FILE *file;           /* Only one will be used. */
-	unzFile *zip;        /* (file or zip) */
-	int compressed_size; /* Should be zero for original PAK files */
-	fsPackCompress_t format;
-} fsHandle_t;
-
 typedef struct fsLink_s
 {
 	char *from;
@@ -80,7 +82,7 @@ typedef struct
 {
 	char name[MAX_FILENAME];
 	size_t size;
-	size_t offset;     /* Ignored in PK3 files. */
+	size_t offset;     /* Central directory position in PK3 files. */
 	size_t compressed_size; /* Should be zero for original PAK files */
 	fsPackCompress_t format;
 } fsPackFile_t;
@@ -89,12 +91,29 @@ typedef struct
 {
 	char name[MAX_OSPATH];
 	size_t numFiles;
-	FILE *pak;
-	unzFile *pk3;
+	FILE *pak;           /* Shared by all handles into the pack. */
+	unzFile *pk3;        /* Shared by the first handle into the pack. */
+	qboolean pk3InUse;
+	FILE *pk3map;        /* Opened on demand to map stored PK3 files. */
+	int refcount;        /* Number of open handles into the pack. */
+	qboolean orphaned;   /* Removed from the search path, but still open. */
 	qboolean isProtectedPak;
 	fsPackFile_t *files;
 } fsPack_t;
 
+typedef struct
+{
+	char name[MAX_FILENAME];
+	fsMode_t mode;
+	FILE *file;           /* Only one will be used. */
+	unzFile *zip;        /* (file or zip) */
+	int compressed_size; /* Should be zero for original PAK files */
+	fsPackCompress_t format;
+	fsPack_t *pack;      /* Pack the file or zip belongs to, if any. */
+	size_t offset;       /* Start of the file inside the PAK. */
+	size_t position;     /* Read position relative to offset. */
+} fsHandle_t;
+
 typedef struct fsSearchPath_s
 {
 	char path[MAX_OSPATH]; /* Only one used. */
@@ -117,10 +136,69 @@ typedef struct
 	fsPackFormat_t format;
 } fsPackTypes_t;
 
+/*
+ * One file known to the virtual file system. The index
+ * holds an entry for every file in every mounted pack
+ * and every file below the loose directories, except
+ * for the writable game directory which may change at
+ * runtime and is always probed.
+ */
+typedef struct
+{
+	const char *name;       /* Name as stored in the pack or on disk. */
+	unsigned int hash;      /* Case folded hash of name. */
+	int position;           /* Position in the search path, lower wins. */
+	int file;               /* Index into pack->files, -1 for loose files. */
+	fsSearchPath_t *search;
+	int next;               /* Next entry in the bucket, -1 terminates. */
+} fsIndexEntry_t;
+
+typedef struct
+{
+	fsIndexEntry_t *entries;
+	int numEntries;
+	int maxEntries;
+	int *buckets;
+	int numBuckets;         /* Always a power of two. */
+	int *looseBefore;       /* Loose dirs probed before a position. */
+	int numPositions;
+	fsSearchPath_t *gamedir; /* Writable dir, not indexed. */
+	int gamedirPosition;
+	qboolean dirty;
+} fsIndex_t;
+
+typedef struct
+{
+	unsigned int lookups;
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int legacy;
+	unsigned int rebuilds;
+	unsigned int syscalls;
+	unsigned int syscallsAvoided;
+	unsigned int mapped;
+	size_t mappedBytes;
+} fsStats_t;
+
+/*
+ * A file returned by FS_LoadFile() that's a private
+ * mapping of its pack or loose file instead of a copy.
+ */
+typedef struct fsMapping_s
+{
+	void *data;
+	void *base;
+	size_t length;
+	struct fsMapping_s *next;
+} fsMapping_t;
+
 fsHandle_t fs_handles[MAX_HANDLES];
 fsLink_t *fs_links = NULL;
 fsSearchPath_t *fs_searchPaths = NULL;
 fsSearchPath_t *fs_baseSearchPaths = NULL;
+static fsIndex_t fs_index = {.dirty = true};
+static fsStats_t fs_stats;
+static fsMapping_t *fs_mappings = NULL;
 
 /* Pack formats / suffixes. */
 fsPackTypes_t fs_packtypes[] = {
@@ -362,6 +440,28 @@ FS_GetFileByHandle(fileHandle_t f)
 	return &fs_handles[f - 1];
 }
 
+static void
+FS_FreePack(fsPack_t *pack)
+{
+	if (pack->pak)
+	{
+		fclose(pack->pak);
+	}
+
+	if (pack->pk3)
+	{
+		unzClose(pack->pk3);
+	}
+
+	if (pack->pk3map)
+	{
+		fclose(pack->pk3map);
+	}
+
+	Z_Free(pack->files);
+	Z_Free(pack);
+}
+
 /*
  * Other dll's can't just call fclose() on files returned by FS_FOpenFile.
  */
@@ -369,10 +469,37 @@ void
 FS_FCloseFile(fileHandle_t f)
 {
 	fsHandle_t *handle;
+	fsPack_t *pack;
 
 	handle = FS_GetFileByHandle(f);
+	pack = handle->pack;
 
-	if (handle->file)
+	if (pack)
+	{
+		/* The pack owns the file, only the zip
+		   may be private to this handle. */
+		if (handle->zip)
+		{
+			unzCloseCurrentFile(handle->zip);
+
+			if (handle->zip == pack->pk3)
+			{
+				pack->pk3InUse = false;
+			}
+			else
+			{
+				unzClose(handle->zip);
+			}
+		}
+
+		pack->refcount--;
+
+		if (pack->orphaned && (pack->refcount <= 0))
+		{
+			FS_FreePack(pack);
+		}
+	}
+	else if (handle->file)
 	{
 		fclose(handle->file);
 	}
@@ -395,42 +522,567 @@ FS_SortPackCompare(const void *p1, const void *p2)
 	return Q_stricmp(file1->name, file2->name);
 }
 
-static void
-FS_SortPack(fsPack_t *pak)
-{
-	qsort(pak->files, pak->numFiles, sizeof(fsPackFile_t), FS_SortPackCompare);
+static void
+FS_SortPack(fsPack_t *pak)
+{
+	qsort(pak->files, pak->numFiles, sizeof(fsPackFile_t), FS_SortPackCompare);
+}
+
+static int
+FS_PackQuickSearch(const fsPack_t *pak, const char *name)
+{
+	int start, end;
+
+	start = 0;
+	end = pak->numFiles - 1;
+
+	while (start <= end)
+	{
+		int i, res;
+
+		i = start + (end - start) / 2;
+
+		res = Q_stricmp(pak->files[i].name, name);
+		if (res == 0)
+		{
+			return i;
+		}
+		else if (res < 0)
+		{
+			start = i + 1;
+		}
+		else
+		{
+			end = i - 1;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Case folded FNV-1a, matching the Q_stricmp() used
+ * to compare pack file names.
+ */
+static unsigned int
+FS_HashName(const char *name)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*name)
+	{
+		hash ^= (unsigned char)tolower((unsigned char)*name);
+		hash *= 16777619u;
+		name++;
+	}
+
+	return hash;
+}
+
+/*
+ * Marks the index as outdated. It's rebuild on the
+ * next lookup, so several search path changes in a
+ * row trigger just one rebuild.
+ */
+static void
+FS_InvalidateIndex(void)
+{
+	fs_index.dirty = true;
+}
+
+static void
+FS_FreeIndex(void)
+{
+	int i;
+
+	for (i = 0; i < fs_index.numEntries; i++)
+	{
+		if (fs_index.entries[i].file < 0)
+		{
+			free((char *)fs_index.entries[i].name);
+		}
+	}
+
+	free(fs_index.entries);
+	free(fs_index.buckets);
+	free(fs_index.looseBefore);
+
+	memset(&fs_index, 0, sizeof(fs_index));
+	fs_index.gamedirPosition = -1;
+	fs_index.dirty = true;
+}
+
+static void
+FS_IndexAdd(const char *name, int position, int file, fsSearchPath_t *search)
+{
+	fsIndexEntry_t *entry;
+
+	if (fs_index.numEntries == fs_index.maxEntries)
+	{
+		fsIndexEntry_t *entries;
+		int max;
+
+		max = fs_index.maxEntries ? fs_index.maxEntries * 2 : 4096;
+		entries = realloc(fs_index.entries, max * sizeof(fsIndexEntry_t));
+		YQ2_COM_CHECK_OOM(entries, "realloc()", max * sizeof(fsIndexEntry_t))
+
+		fs_index.entries = entries;
+		fs_index.maxEntries = max;
+	}
+
+	entry = &fs_index.entries[fs_index.numEntries++];
+	entry->name = name;
+	entry->hash = FS_HashName(name);
+	entry->position = position;
+	entry->file = file;
+	entry->search = search;
+	entry->next = -1;
+}
+
+/*
+ * Adds all files below the given loose directory. The
+ * names are stored relative to the search path, in the
+ * case they have on disk.
+ */
+static void
+FS_IndexLooseDir(const char *dir, size_t prefixlen, int depth,
+		int position, fsSearchPath_t *search)
+{
+	char findname[MAX_OSPATH];
+	char **list;
+	int i, nfiles;
+
+	/* Guard against symlink loops. */
+	if (depth > 32)
+	{
+		return;
+	}
+
+	Com_sprintf(findname, sizeof(findname), "%s/*", dir);
+
+	if ((list = FS_ListFiles(findname, &nfiles, 0, 0)) == NULL)
+	{
+		return;
+	}
+
+	for (i = 0; i < nfiles - 1; i++)
+	{
+		if (Sys_IsDir(list[i]))
+		{
+			FS_IndexLooseDir(list[i], prefixlen, depth + 1, position, search);
+		}
+		else if (strlen(list[i]) > prefixlen)
+		{
+			char *name;
+
+			name = strdup(list[i] + prefixlen);
+			YQ2_COM_CHECK_OOM(name, "strdup()", strlen(list[i] + prefixlen) + 1)
+
+			FS_IndexAdd(name, position, -1, search);
+		}
+	}
+
+	FS_FreeList(list, nfiles);
+}
+
+/*
+ * Pack files are case insensitive. Loose files are
+ * tried with the requested name and in lowercase, just
+ * like FS_FOpenFile() always did. Windows and macOS
+ * have case insensitive file systems.
+ */
+static qboolean
+FS_IndexMatches(const fsIndexEntry_t *entry, const char *name, const char *lwrName)
+{
+#if !defined(_WIN32) && !defined(__APPLE__)
+	if (entry->file < 0)
+	{
+		return !strcmp(entry->name, name) || !strcmp(entry->name, lwrName);
+	}
+#endif
+
+	return !Q_stricmp(entry->name, name);
+}
+
+/*
+ * Rebuilds the global index over all search paths.
+ * Must be called whenever the search paths changed.
+ */
+static void
+FS_BuildIndex(void)
+{
+	fsSearchPath_t *search;
+	int i, position, loose;
+	int duplicates = 0;
+	int start = Sys_Milliseconds();
+
+	FS_FreeIndex();
+
+	/* Collect all files in search path order. */
+	for (search = fs_searchPaths, position = 0; search; search = search->next, position++)
+	{
+		if (search->pack)
+		{
+			for (i = 0; i < search->pack->numFiles; i++)
+			{
+				FS_IndexAdd(search->pack->files[i].name, position, i, search);
+			}
+		}
+		else if (!fs_index.gamedir && !strcmp(search->path, fs_gamedir))
+		{
+			fs_index.gamedir = search;
+			fs_index.gamedirPosition = position;
+		}
+		else
+		{
+			FS_IndexLooseDir(search->path, strlen(search->path) + 1, 0,
+					position, search);
+		}
+	}
+
+	/* Count the loose directories the old linear
+	   search would have probed before each position. */
+	fs_index.numPositions = position + 1;
+	fs_index.looseBefore = calloc(fs_index.numPositions, sizeof(int));
+	YQ2_COM_CHECK_OOM(fs_index.looseBefore, "calloc()", fs_index.numPositions * sizeof(int))
+
+	for (search = fs_searchPaths, position = 0, loose = 0; search; search = search->next, position++)
+	{
+		fs_index.looseBefore[position] = loose;
+
+		if (!search->pack && search != fs_index.gamedir)
+		{
+			loose++;
+		}
+	}
+
+	fs_index.looseBefore[position] = loose;
+
+	/* Bucket count is the next power of two. */
+	fs_index.numBuckets = 1024;
+
+	while (fs_index.numBuckets < fs_index.numEntries)
+	{
+		fs_index.numBuckets <<= 1;
+	}
+
+	fs_index.buckets = malloc(fs_index.numBuckets * sizeof(int));
+	YQ2_COM_CHECK_OOM(fs_index.buckets, "malloc()", fs_index.numBuckets * sizeof(int))
+	memset(fs_index.buckets, -1, fs_index.numBuckets * sizeof(int));
+
+	/* Link the entries. A pack entry shadows everything
+	   with the same name behind it, these are dropped. */
+	for (i = 0; i < fs_index.numEntries; i++)
+	{
+		fsIndexEntry_t *entry = &fs_index.entries[i];
+		int *bucket = &fs_index.buckets[entry->hash & (fs_index.numBuckets - 1)];
+		int *tail = bucket;
+		qboolean shadowed = false;
+
+		while (*tail >= 0)
+		{
+			const fsIndexEntry_t *other = &fs_index.entries[*tail];
+
+			if ((other->file >= 0) && (other->hash == entry->hash) &&
+				!Q_stricmp(other->name, entry->name))
+			{
+				shadowed = true;
+				break;
+			}
+
+			tail = &fs_index.entries[*tail].next;
+		}
+
+		if (shadowed)
+		{
+			duplicates++;
+			continue;
+		}
+
+		/* Appending keeps the chains in search path order. */
+		*tail = i;
+	}
+
+	fs_index.dirty = false;
+	fs_stats.rebuilds++;
+
+	FS_DPrintf("%s: %i files, %i shadowed, %i buckets in %i ms.\n", __func__,
+			fs_index.numEntries, duplicates, fs_index.numBuckets,
+			Sys_Milliseconds() - start);
+}
+
+/*
+ * Returns the entry the given name resolves to, or NULL.
+ */
+static const fsIndexEntry_t *
+FS_IndexLookup(const char *name)
+{
+	char lwrName[MAX_OSPATH];
+	unsigned int hash;
+	int i;
+
+	if (fs_index.dirty)
+	{
+		FS_BuildIndex();
+	}
+
+	Q_strlcpy(lwrName, name, sizeof(lwrName));
+	Q_strlwr(lwrName);
+
+	hash = FS_HashName(name);
+
+	for (i = fs_index.buckets[hash & (fs_index.numBuckets - 1)]; i >= 0; i = fs_index.entries[i].next)
+	{
+		const fsIndexEntry_t *entry = &fs_index.entries[i];
+
+		if ((entry->hash == hash) && FS_IndexMatches(entry, name, lwrName))
+		{
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+FS_Stats_f(void)
+{
+	int i, used = 0, longest = 0;
+
+	if (fs_index.dirty)
+	{
+		FS_BuildIndex();
+	}
+
+	for (i = 0; i < fs_index.numBuckets; i++)
+	{
+		int j, len = 0;
+
+		for (j = fs_index.buckets[i]; j >= 0; j = fs_index.entries[j].next)
+		{
+			len++;
+		}
+
+		if (len)
+		{
+			used++;
+		}
+
+		if (len > longest)
+		{
+			longest = len;
+		}
+	}
+
+	Com_Printf("Index: %i files, %i/%i buckets used, longest chain %i, %i rebuilds.\n",
+			fs_index.numEntries, used, fs_index.numBuckets, longest,
+			fs_stats.rebuilds);
+	Com_Printf("Writable dir: %s\n", fs_index.gamedir ? fs_index.gamedir->path : "none");
+	Com_Printf("Lookups: %u (%u hits, %u misses, %u unindexed).\n",
+			fs_stats.lookups, fs_stats.hits, fs_stats.misses,
+			fs_stats.legacy);
+	Com_Printf("Syscalls: %u done, %u avoided.\n",
+			fs_stats.syscalls, fs_stats.syscallsAvoided);
+	Com_Printf("Mapped: %u files, " YQ2_COM_PRIdS " KiB not copied.\n",
+			fs_stats.mapped, fs_stats.mappedBytes / 1024);
+}
+
+/*
+ * Opens file i of the given pack into the handle.
+ */
+static int
+FS_OpenPackFile(fsHandle_t *handle, fsPack_t *pack, int i)
+{
+	/* Found it! */
+	if (fs_debug->value)
+	{
+		Com_Printf("%s: '%s' (found in '%s').\n",
+			__func__, handle->name, pack->name);
+	}
+
+	// save the name with *correct case* in the handle
+	// (relevant for savegames, when starting map with wrong case but it's still found
+	//  because it's from pak, but save/bla/MAPname.sav/sv2 will have wrong case and can't be found then)
+	Q_strlcpy(handle->name, pack->files[i].name, sizeof(handle->name));
+	handle->compressed_size = 0;
+	handle->format = PAK_MODE_Q2;
+
+	if (pack->pak)
+	{
+		/* PAK and DAT. All handles share the packs
+		   file and read at their own position. */
+		if (pack->isProtectedPak)
+		{
+			file_from_protected_pak = true;
+		}
+
+		handle->file = pack->pak;
+		handle->pack = pack;
+		handle->offset = pack->files[i].offset;
+		handle->position = 0;
+		handle->compressed_size = pack->files[i].compressed_size;
+		handle->format = pack->files[i].format;
+		pack->refcount++;
+
+		return pack->files[i].size;
+	}
+	else if (pack->pk3)
+	{
+		/* PK3 */
+		if (pack->isProtectedPak)
+		{
+			file_from_protected_pak = true;
+		}
+
+		/* A zip can only have one file open at a time.
+		   The first handle gets the packs zip, others
+		   need their own. */
+		if (!pack->pk3InUse)
+		{
+			handle->zip = pack->pk3;
+			pack->pk3InUse = true;
+		}
+		else
+		{
+#ifdef _WIN32
+			handle->zip = unzOpen2(pack->name, &zlib_file_api);
+#else
+			handle->zip = unzOpen(pack->name);
+#endif
+		}
+
+		if (handle->zip)
+		{
+			handle->pack = pack;
+			pack->refcount++;
+
+			/* Jump right to the directory entry recorded
+			   at load time, no need to search for it. */
+			if (unzSetOffset(handle->zip, pack->files[i].offset) == UNZ_OK)
+			{
+				if (unzOpenCurrentFile(handle->zip) == UNZ_OK)
+				{
+					return pack->files[i].size;
+				}
+			}
+
+			if (handle->zip != pack->pk3)
+			{
+				unzClose(handle->zip);
+			}
+			else
+			{
+				pack->pk3InUse = false;
+			}
+
+			handle->zip = NULL;
+			handle->pack = NULL;
+			pack->refcount--;
+		}
+	}
+
+	Com_Error(ERR_FATAL, "Couldn't reopen '%s'", pack->name);
+	return 0;
+}
+
+/*
+ * Opens a file from a loose directory into the handle.
+ * Tries the name as given and in lowercase. Returns the
+ * file size or -1 if the file doesn't exist.
+ */
+static int
+FS_OpenLooseFile(fsHandle_t *handle, const char *dir)
+{
+	char path[MAX_OSPATH], lwrName[MAX_OSPATH];
+
+	/* Search in a directory tree. */
+	Com_sprintf(path, sizeof(path), "%s/%s", dir, handle->name);
+
+	handle->file = Q_fopen(path, "rb");
+	fs_stats.syscalls++;
+
+	if (!handle->file)
+	{
+		Com_sprintf(lwrName, sizeof(lwrName), "%s", handle->name);
+		Q_strlwr(lwrName);
+		Com_sprintf(path, sizeof(path), "%s/%s", dir, lwrName);
+		handle->file = Q_fopen(path, "rb");
+		fs_stats.syscalls++;
+	}
+
+	if (handle->file)
+	{
+		if (fs_debug->value)
+		{
+			Com_Printf("%s: '%s' (found in '%s').\n",
+				__func__, handle->name, dir);
+		}
+
+		return FS_FileLength(handle->file);
+	}
+
+	return -1;
 }
 
+/*
+ * Resolves the file through the index. The writable
+ * game directory is probed whenever it takes precedence
+ * over the indexed location.
+ */
 static int
-FS_PackQuickSearch(const fsPack_t *pak, const char *name)
+FS_FOpenFileIndexed(fsHandle_t *handle)
 {
-	int start, end;
+	const fsIndexEntry_t *entry;
+	int position, size;
 
-	start = 0;
-	end = pak->numFiles - 1;
+	fs_stats.lookups++;
 
-	while (start <= end)
-	{
-		int i, res;
+	entry = FS_IndexLookup(handle->name);
+	position = entry ? entry->position : fs_index.numPositions - 1;
 
-		i = start + (end - start) / 2;
+	if (fs_index.gamedir && (fs_index.gamedirPosition < position))
+	{
+		size = FS_OpenLooseFile(handle, fs_index.gamedir->path);
 
-		res = Q_stricmp(pak->files[i].name, name);
-		if (res == 0)
-		{
-			return i;
-		}
-		else if (res < 0)
-		{
-			start = i + 1;
-		}
-		else
+		if (size >= 0)
 		{
-			end = i - 1;
+			fs_stats.hits++;
+			fs_stats.syscallsAvoided +=
+				2 * fs_index.looseBefore[fs_index.gamedirPosition];
+			return size;
 		}
 	}
 
-	return -1;
+	/* The old search tried both cases in every
+	   loose dir in front of the file. */
+	fs_stats.syscallsAvoided += 2 * fs_index.looseBefore[position];
+
+	if (!entry)
+	{
+		fs_stats.misses++;
+		return -1;
+	}
+
+	fs_stats.hits++;
+
+	if (entry->file >= 0)
+	{
+		return FS_OpenPackFile(handle, entry->search->pack, entry->file);
+	}
+
+	/* The index knows the name on disk, one open is enough. */
+	Q_strlcpy(handle->name, entry->name, sizeof(handle->name));
+	fs_stats.syscallsAvoided++;
+
+	size = FS_OpenLooseFile(handle, entry->search->path);
+
+	if (size < 0)
+	{
+		/* Deleted behind our back. */
+		FS_InvalidateIndex();
+	}
+
+	return size;
 }
 
 /*
@@ -440,9 +1092,7 @@ FS_PackQuickSearch(const fsPack_t *pak, const char *name)
 int
 FS_FOpenFile(const char *rawname, fileHandle_t *f, qboolean gamedir_only)
 {
-	char path[MAX_OSPATH], lwrName[MAX_OSPATH];
 	fsHandle_t *handle;
-	fsPack_t *pack;
 	fsSearchPath_t *search;
 	int input, output;
 
@@ -509,136 +1159,70 @@ FS_FOpenFile(const char *rawname, fileHandle_t *f, qboolean gamedir_only)
 	Q_strlcpy(handle->name, name, sizeof(handle->name));
 	handle->mode = FS_READ;
 
-	/* Search through the path, one element at a time. */
-	for (search = fs_searchPaths; search; search = search->next)
+	/* Ask the index, unless the search is limited to
+	   the game dir or the hack below may kick in. */
+	if (!gamedir_only && !((strcmp(fs_gamedirvar->string, "") == 0) &&
+			((!strcmp(name, "maps.lst")) || (!strncmp(name, "players/", 8)))))
 	{
-		if (gamedir_only)
+		int size = FS_FOpenFileIndexed(handle);
+
+		if (size >= 0)
 		{
-			if (strstr(search->path, FS_Gamedir()) == NULL)
-			{
-				continue;
-			}
+			return size;
 		}
+	}
+	else
+	{
+		fs_stats.legacy++;
 
-		// Evil hack for maps.lst and players/
-		// TODO: A flag to ignore paks would be better
-		if ((strcmp(fs_gamedirvar->string, "") == 0) && search->pack)
+		/* Search through the path, one element at a time. */
+		for (search = fs_searchPaths; search; search = search->next)
 		{
-			if ((!strcmp(name, "maps.lst")) || (!strncmp(name, "players/", 8)))
+			if (gamedir_only)
 			{
-				if (FS_FileInGamedir(name))
+				if (strstr(search->path, FS_Gamedir()) == NULL)
 				{
 					continue;
 				}
 			}
-		}
-
-		/* Search inside a pack file. */
-		if (search->pack)
-		{
-			int i;
 
-			pack = search->pack;
-			i = FS_PackQuickSearch(pack, handle->name);
-
-			if (i >= 0)
+			// Evil hack for maps.lst and players/
+			// TODO: A flag to ignore paks would be better
+			if ((strcmp(fs_gamedirvar->string, "") == 0) && search->pack)
 			{
-				/* Found it! */
-				if (fs_debug->value)
-				{
-					Com_Printf("%s: '%s' (found in '%s').\n",
-						__func__, handle->name, pack->name);
-				}
-
-				// save the name with *correct case* in the handle
-				// (relevant for savegames, when starting map with wrong case but it's still found
-				//  because it's from pak, but save/bla/MAPname.sav/sv2 will have wrong case and can't be found then)
-				Q_strlcpy(handle->name, pack->files[i].name, sizeof(handle->name));
-				handle->compressed_size = 0;
-				handle->format = PAK_MODE_Q2;
-
-				if (pack->pak)
+				if ((!strcmp(name, "maps.lst")) || (!strncmp(name, "players/", 8)))
 				{
-					/* PAK and DAT */
-					if (pack->isProtectedPak)
-					{
-						file_from_protected_pak = true;
-					}
-
-					handle->file = Q_fopen(pack->name, "rb");
-
-					if (handle->file)
+					if (FS_FileInGamedir(name))
 					{
-						handle->compressed_size = pack->files[i].compressed_size;
-						handle->format = pack->files[i].format;
-						if (fseek(handle->file, pack->files[i].offset, SEEK_SET))
-						{
-							Com_Printf("%s: '%s' seek failed", __func__, handle->name);
-							return 0;
-						}
-
-						return pack->files[i].size;
+						continue;
 					}
 				}
-				else if (pack->pk3)
-				{
-					/* PK3 */
-					if (pack->isProtectedPak)
-					{
-						file_from_protected_pak = true;
-					}
+			}
 
-#ifdef _WIN32
-					handle->zip = unzOpen2(pack->name, &zlib_file_api);
-#else
-					handle->zip = unzOpen(pack->name);
-#endif
+			/* Search inside a pack file. */
+			if (search->pack)
+			{
+				int i;
 
-					if (handle->zip)
-					{
-						if (unzLocateFile(handle->zip, handle->name, 2) == UNZ_OK)
-						{
-							if (unzOpenCurrentFile(handle->zip) == UNZ_OK)
-							{
-								return pack->files[i].size;
-							}
-						}
+				i = FS_PackQuickSearch(search->pack, handle->name);
 
-						unzClose(handle->zip);
-					}
+				if (i >= 0)
+				{
+					return FS_OpenPackFile(handle, search->pack, i);
 				}
-
-				Com_Error(ERR_FATAL, "Couldn't reopen '%s'", pack->name);
-				return 0;
 			}
-		}
-		else
-		{
-			/* Search in a directory tree. */
-			Com_sprintf(path, sizeof(path), "%s/%s", search->path, handle->name);
-
-			handle->file = Q_fopen(path, "rb");
-
-			if (!handle->file)
+			else
 			{
-				Com_sprintf(lwrName, sizeof(lwrName), "%s", handle->name);
-				Q_strlwr(lwrName);
-				Com_sprintf(path, sizeof(path), "%s/%s", search->path, lwrName);
-				handle->file = Q_fopen(path, "rb");
-			}
+				int size = FS_OpenLooseFile(handle, search->path);
 
-			if (handle->file)
-			{
-				if (fs_debug->value)
+				if (size >= 0)
 				{
-					Com_Printf("%s: '%s' (found in '%s').\n",
-						__func__, handle->name, search->path);
+					return size;
 				}
-
-				return FS_FileLength(handle->file);
 			}
 		}
 	}
+
 	if (fs_debug->value)
 	{
 		Com_Printf("%s: couldn't find '%s'.\n", __func__, handle->name);
@@ -780,6 +1364,45 @@ FS_DecompressFile(void *buffer, int size, const fsHandle_t *handle)
 	return size;
 }
 
+/*
+ * Reads from the file or zip behind the handle. Files
+ * inside a PAK share the packs FILE and are read at
+ * their own position without moving the file pointer.
+ */
+static int
+FS_ReadHandle(fsHandle_t *handle, void *buffer, int size)
+{
+	int r;
+
+	if (handle->zip)
+	{
+		return unzReadCurrentFile(handle->zip, buffer, size);
+	}
+
+	if (!handle->pack)
+	{
+		return fread(buffer, 1, size, handle->file);
+	}
+
+#ifdef _WIN32
+	if (fseek(handle->file, handle->offset + handle->position, SEEK_SET))
+	{
+		return -1;
+	}
+
+	r = fread(buffer, 1, size, handle->file);
+#else
+	r = pread(fileno(handle->file), buffer, size, handle->offset + handle->position);
+#endif
+
+	if (r > 0)
+	{
+		handle->position += r;
+	}
+
+	return r;
+}
+
 /*
  * Properly handles partial reads.
  */
@@ -823,13 +1446,9 @@ FS_Read(void *buffer, int size, fileHandle_t f)
 
 	while (remaining)
 	{
-		if (handle->file)
-		{
-			r = fread(buf, 1, remaining, handle->file);
-		}
-		else if (handle->zip)
+		if (handle->file || handle->zip)
 		{
-			r = unzReadCurrentFile(handle->zip, buf, remaining);
+			r = FS_ReadHandle(handle, buf, remaining);
 		}
 		else
 		{
@@ -934,13 +1553,9 @@ FS_FRead(void *buffer, int size, int count, fileHandle_t f)
 
 		while (remaining)
 		{
-			if (handle->file)
-			{
-				r = fread(buf, 1, remaining, handle->file);
-			}
-			else if (handle->zip)
+			if (handle->file || handle->zip)
 			{
-				r = unzReadCurrentFile(handle->zip, buf, remaining);
+				r = FS_ReadHandle(handle, buf, remaining);
 			}
 			else
 			{
@@ -1000,18 +1615,127 @@ FS_FRead(void *buffer, int size, int count, fileHandle_t f)
 }
 
 /*
- * Filename are reletive to the quake search path. A null buffer will just
- * return the file length without loading.
+ * Maps an uncompressed file instead of reading it. The
+ * mapping is private and writeable, callers may modify
+ * the buffer just like a copy. Returns NULL if the file
+ * can't be mapped, the caller must read it instead.
  */
-int
-FS_LoadFile(const char *path, void **buffer)
+static void *
+FS_MapFile(fsHandle_t *handle, int size)
+{
+#ifdef _WIN32
+	return NULL;
+#else
+	fsMapping_t *mapping;
+	struct stat st;
+	size_t offset, pageoffset;
+	byte *base;
+	FILE *file;
+
+	if ((size < FS_MMAP_MINSIZE) || handle->compressed_size)
+	{
+		return NULL;
+	}
+
+	if (handle->zip)
+	{
+		unz_file_info info;
+
+		/* Only stored, unencrypted files. */
+		if ((unzGetCurrentFileInfo(handle->zip, &info, NULL, 0, NULL, 0, NULL, 0) != UNZ_OK) ||
+			(info.compression_method != 0) || (info.flag & 1))
+		{
+			return NULL;
+		}
+
+		if (!handle->pack->pk3map)
+		{
+			handle->pack->pk3map = Q_fopen(handle->pack->name, "rb");
+
+			if (!handle->pack->pk3map)
+			{
+				return NULL;
+			}
+		}
+
+		file = handle->pack->pk3map;
+		offset = unzGetCurrentFileZStreamPos64(handle->zip);
+	}
+	else if (handle->pack)
+	{
+		file = handle->file;
+		offset = handle->offset + handle->position;
+	}
+	else
+	{
+		file = handle->file;
+		offset = ftell(handle->file);
+	}
+
+	/* Corrupt directories would fault on access. */
+	if (fstat(fileno(file), &st) || (offset + size > st.st_size))
+	{
+		return NULL;
+	}
+
+	pageoffset = offset % sysconf(_SC_PAGESIZE);
+	base = mmap(NULL, size + pageoffset, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+			fileno(file), offset - pageoffset);
+
+	if (base == MAP_FAILED)
+	{
+		return NULL;
+	}
+
+	mapping = Z_Malloc(sizeof(fsMapping_t));
+	mapping->data = base + pageoffset;
+	mapping->base = base;
+	mapping->length = size + pageoffset;
+	mapping->next = fs_mappings;
+	fs_mappings = mapping;
+
+	fs_stats.mapped++;
+	fs_stats.mappedBytes += size;
+
+	return mapping->data;
+#endif
+}
+
+/*
+ * Releases the buffer if it's mapped. Returns false
+ * for buffers allocated by FS_LoadFile().
+ */
+static qboolean
+FS_UnmapFile(void *buffer)
+{
+#ifndef _WIN32
+	fsMapping_t *mapping, **prev;
+
+	for (prev = &fs_mappings, mapping = fs_mappings; mapping; prev = &mapping->next, mapping = mapping->next)
+	{
+		if (mapping->data == buffer)
+		{
+			munmap(mapping->base, mapping->length);
+			*prev = mapping->next;
+			Z_Free(mapping);
+
+			return true;
+		}
+	}
+#endif
+
+	return false;
+}
+
+static int
+FS_LoadFileFrom(const char *path, void **buffer, qboolean gamedir_only)
 {
 	byte *buf; /* Buffer. */
 	int size; /* File size. */
 	fileHandle_t f; /* File handle. */
 
 	buf = NULL;
-	size = FS_FOpenFile(path, &f, false);
+	size = FS_FOpenFile(path, &f, gamedir_only);
 
 	if (size <= 0)
 	{
@@ -1035,15 +1759,104 @@ FS_LoadFile(const char *path, void **buffer)
 		return size;
 	}
 
-	buf = Z_Malloc(size);
-	*buffer = buf;
+	/* Large uncompressed files are mapped,
+	   everything else is copied. */
+	buf = FS_MapFile(FS_GetFileByHandle(f), size);
+
+	if (!buf)
+	{
+		buf = Z_Malloc(size);
+		FS_Read(buf, size, f);
+	}
 
-	FS_Read(buf, size, f);
+	*buffer = buf;
 	FS_FCloseFile(f);
 
 	return size;
 }
 
+/*
+ * Filename are reletive to the quake search path. A null buffer will just
+ * return the file length without loading.
+ */
+int
+FS_LoadFile(const char *path, void **buffer)
+{
+	return FS_LoadFileFrom(path, buffer, false);
+}
+
+/*
+ * Like FS_LoadFile(), but only looks into the current
+ * gamedir. Used for files written by the engine itself.
+ */
+int
+FS_LoadFileFromGamedir(const char *path, void **buffer)
+{
+	return FS_LoadFileFrom(path, buffer, true);
+}
+
+/*
+ * Describes where a file in the search path comes from:
+ * the pack it's stored in (empty for loose files), its
+ * size and the modification time of the pack or of the
+ * loose file. Used to validate caches of derived data.
+ */
+qboolean
+FS_FileSource(const char *path, char *source, size_t sourcesize,
+		int *size, long long *mtime)
+{
+	fsHandle_t *handle;
+	fileHandle_t f;
+	struct stat st;
+	int ret;
+
+	*size = FS_FOpenFile(path, &f, false);
+
+	if (*size < 0)
+	{
+		return false;
+	}
+
+	handle = FS_GetFileByHandle(f);
+	ret = -1;
+
+	if (handle->pack)
+	{
+		Q_strlcpy(source, handle->pack->name, sourcesize);
+
+		if (handle->pack->pak)
+		{
+			ret = fstat(fileno(handle->pack->pak), &st);
+		}
+		else
+		{
+			FILE *file;
+
+			if ((file = Q_fopen(handle->pack->name, "rb")) != NULL)
+			{
+				ret = fstat(fileno(file), &st);
+				fclose(file);
+			}
+		}
+	}
+	else if (handle->file)
+	{
+		*source = '\0';
+		ret = fstat(fileno(handle->file), &st);
+	}
+
+	FS_FCloseFile(f);
+
+	if (ret)
+	{
+		return false;
+	}
+
+	*mtime = (long long)st.st_mtime;
+
+	return true;
+}
+
 void
 FS_FreeFile(void *buffer)
 {
@@ -1053,6 +1866,11 @@ FS_FreeFile(void *buffer)
 		return;
 	}
 
+	if (FS_UnmapFile(buffer))
+	{
+		return;
+	}
+
 	Z_Free(buffer);
 }
 
@@ -1082,18 +1900,16 @@ FS_FreeSearchPaths(fsSearchPath_t *start, const fsSearchPath_t *end)
 	{
 		if (cur->pack)
 		{
-			if (cur->pack->pak)
+			/* Files may still be read from the pack,
+			   the last FS_FCloseFile() frees it. */
+			if (cur->pack->refcount > 0)
 			{
-				fclose(cur->pack->pak);
+				cur->pack->orphaned = true;
 			}
-
-			if (cur->pack->pk3)
+			else
 			{
-				unzClose(cur->pack->pk3);
+				FS_FreePack(cur->pack);
 			}
-
-			Z_Free(cur->pack->files);
-			Z_Free(cur->pack);
 		}
 
 		next = cur->next;
@@ -1101,6 +1917,8 @@ FS_FreeSearchPaths(fsSearchPath_t *start, const fsSearchPath_t *end)
 		cur = next;
 	}
 
+	FS_InvalidateIndex();
+
 	return cur;
 }
 
@@ -2065,7 +2883,7 @@ FS_LoadPK3(const char *packPath)
 		unzGetCurrentFileInfo(handle, &info, fileName, sizeof(fileName),
 				NULL, 0, NULL, 0);
 		Q_strlcpy(files[i].name, fileName, sizeof(files[i].name));
-		files[i].offset = -1; /* Not used in ZIP files */
+		files[i].offset = unzGetOffset(handle);
 		files[i].size = info.uncompressed_size;
 		i++;
 		status = unzGoToNextFile(handle);
@@ -2854,6 +3672,8 @@ FS_AddPAKFromGamedir(const char *pak)
 			search->next = fs_searchPaths;
 			fs_searchPaths = search;
 
+			FS_InvalidateIndex();
+
 			return true;
 		}
 	}
@@ -2920,6 +3740,8 @@ FS_AddKPFpack(void)
 		search->pack = pack;
 		search->next = fs_searchPaths;
 		fs_searchPaths = search;
+
+		FS_InvalidateIndex();
 	}
 }
 
@@ -3114,6 +3936,8 @@ FS_AddDirToSearchPath(char *dir, qboolean create) {
 
 		FS_FreeList(list, nfiles);
 	}
+
+	FS_InvalidateIndex();
 }
 
 static void
@@ -3391,6 +4215,7 @@ FS_InitFilesystem(void)
 	Cmd_AddCommand("path", FS_Path_f);
 	Cmd_AddCommand("link", FS_Link_f);
 	Cmd_AddCommand("dir", FS_Dir_f);
+	Cmd_AddCommand("fs_stats", FS_Stats_f);
 
 	// Register cvars
 	fs_basedir = Cvar_Get("basedir", ".", CVAR_NOSET);
@@ -3442,6 +4267,7 @@ FS_ShutdownFilesystem(void)
 {
 	fs_searchPaths = FS_FreeSearchPaths(fs_searchPaths, NULL);
 	fs_rawPath = FS_FreeRawPaths(fs_rawPath, NULL);
+	FS_FreeIndex();
 
 	fs_baseSearchPaths = NULL;
 }
@@ -207,8 +207,6 @@ Qcommon_Mainloop(void)
 				Sys_Nanosleep(5000);
 			}
 		}
-#else
-		Sys_Nanosleep(850000);
 #endif
 
 		newtime = Sys_Microseconds();
@@ -753,6 +751,12 @@ Qcommon_Frame(int usec)
 	// Accumulated time since last server run.
 	static int servertimedelta = 0;
 
+	// Time to sleep after this frame in microsec.
+	int wait;
+
+	// Wake up on packets?
+	qboolean network;
+
 	/* A packetframe runs the server and the client,
 	   but not the renderer. The minimal interval of
 	   packetframes is about 10.000 microsec. If run
@@ -825,6 +829,30 @@ Qcommon_Frame(int usec)
 		// Reset deltas if necessary.
 		packetdelta = 0;
 	}
+
+
+	/* Sleep until the next serverframe is due. Packets
+	   wake us up only if a packetframe can run, else
+	   we would spin until it can. */
+	wait = SV_NextFrame();
+
+	if (wait < 0) {
+		// No server running, just throttle.
+		wait = 850;
+	}
+
+	network = true;
+
+	if (pfps > 0) {
+		int interval = 1000000 / pfps - packetdelta;
+
+		if (interval > 0) {
+			wait = Q_max(wait, interval);
+			network = false;
+		}
+	}
+
+	SV_Sleep(wait, network);
 }
 #endif
 
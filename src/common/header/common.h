@@ -476,6 +476,31 @@ void Cmd_ForwardToServer(void);
 /* things like godmode, noclip, etc, are commands directed to the server, */
 /* so when they are typed in at the console, they will need to be forwarded. */
 
+/* NAME HASH */
+
+/* Name to pointer hash table. Zero initialize with the
+   description shown by the hashstats command. */
+typedef struct namehashslot_s namehashslot_t;
+
+typedef struct namehash_s
+{
+	const char *desc;
+	namehashslot_t *slots;
+	int size;
+	int count;
+	unsigned int lookups;
+	unsigned int probes;
+	qboolean linked;
+	struct namehash_s *next;
+} namehash_t;
+
+void NameHash_Insert(namehash_t *table, const char *name, void *value);
+void NameHash_Remove(namehash_t *table, const char *name, const void *value);
+void *NameHash_Find(namehash_t *table, const char *name);
+void *NameHash_FindNoCase(namehash_t *table, const char *name);
+void NameHash_Clear(namehash_t *table);
+void NameHash_Stats_f(void);
+
 /* CVAR */
 
 /*
@@ -594,6 +619,8 @@ void NET_Config(qboolean multiplayer);
 qboolean NET_GetPacket(netsrc_t sock, netadr_t *net_from,
 		sizebuf_t *net_message);
 void NET_SendPacket(netsrc_t sock, int length, const void *data, netadr_t to);
+void NET_BeginSendBatch(netsrc_t sock);
+void NET_EndSendBatch(netsrc_t sock);
 
 qboolean NET_CompareAdr(netadr_t a, netadr_t b);
 qboolean NET_CompareBaseAdr(netadr_t a, netadr_t b);
@@ -601,6 +628,7 @@ qboolean NET_IsLocalAddress(netadr_t adr);
 char *NET_AdrToString(netadr_t a);
 qboolean NET_StringToAdr(const char *s, netadr_t *a);
 void NET_Sleep(int msec);
+void NET_SleepUsec(int usec, qboolean network);
 
 /*=================================================================== */
 
@@ -681,6 +709,30 @@ int CM_PointContents(const vec3_t p, int headnode);
 int CM_TransformedPointContents(const vec3_t p, int headnode,
 		vec3_t origin, vec3_t angles);
 
+/* state of a trace, traces with their own context
+   can run concurrently on a loaded map */
+typedef struct
+{
+	trace_t trace;
+	vec3_t start, end;
+	vec3_t mins, maxs;
+	vec3_t extents;
+	int contents;
+	qboolean ispoint; /* optimized case */
+	unsigned *brushmarks; /* trace number a brush was last checked by */
+	int numbrushmarks;
+	unsigned tracenum;
+} cmtrace_t;
+
+void CM_InitTraceContext(cmtrace_t *ctx);
+void CM_FreeTraceContext(cmtrace_t *ctx);
+trace_t CM_BoxTraceContext(cmtrace_t *ctx, const vec3_t start,
+		const vec3_t end, const vec3_t mins, const vec3_t maxs,
+		int headnode, int brushmask);
+trace_t CM_TransformedBoxTraceContext(cmtrace_t *ctx, const vec3_t start,
+		const vec3_t end, const vec3_t mins, const vec3_t maxs, int headnode,
+		int brushmask, const vec3_t origin, const vec3_t angles);
+
 trace_t CM_BoxTrace(const vec3_t start, const vec3_t end, const vec3_t mins,
 		const vec3_t maxs, int headnode, int brushmask);
 trace_t CM_TransformedBoxTrace(const vec3_t start, const vec3_t end,
@@ -710,10 +762,12 @@ qboolean CM_HeadnodeVisible(int nodenum, const byte *visbits);
 
 void CM_WritePortalState(FILE *f);
 int CM_LoadFile(const char *path, void **buffer);
+qboolean CM_FreeFile(const void *buffer);
 
 /* Shared Model load code */
 int Mod_LoadFile(const char *name, void **buffer);
 void Mod_FreeFile(const char *path);
+void Mod_FreeBuffer(void *buffer);
 void Mod_AliasesInit(void);
 void Mod_AliasesFreeAll(void);
 const dmdxframegroup_t *Mod_GetModelInfo(const char *name, int *num,
@@ -781,6 +835,9 @@ void FS_BuildGameSpecificSearchPath(const char *dir);
 const char *FS_Gamedir(void);
 const char *FS_NextPath(const char *prevPath);
 int FS_LoadFile(const char *path, void **buffer);
+int FS_LoadFileFromGamedir(const char *path, void **buffer);
+qboolean FS_FileSource(const char *path, char *source, size_t sourcesize,
+		int *size, long long *mtime);
 qboolean FS_FileInGamedir(const char *file);
 qboolean FS_AddPAKFromGamedir(const char *pak);
 const char* FS_GetNextRawPath(const char* lastRawPath);
@@ -895,6 +952,8 @@ void SCR_BeginLoadingPlaque(void);
 void SV_Init(void);
 void SV_Shutdown(const char *finalmsg, qboolean reconnect);
 void SV_Frame(int usec);
+int SV_NextFrame(void);
+void SV_Sleep(int usec, qboolean network);
 const char *SV_LocalizationUIMessage(const char *message, const char *default_message);
 const char *SV_LocalizationMessage(const char *message, const char **sound);
 void SV_LocalizationInit(void);
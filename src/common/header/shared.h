@@ -593,7 +593,8 @@ typedef struct cvar_s
 	 CONTENTS_CURRENT_UP | \
 	 CONTENTS_CURRENT_DOWN)
 
-/* gi.BoxEdicts() can return a list of either solid or trigger entities */
+/* gi.BoxEdicts() can return a list of either solid or trigger entities,
+   gi.SphereEdicts() both */
 #define AREA_SOLID 1
 #define AREA_TRIGGERS 2
 
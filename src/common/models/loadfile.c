@@ -839,6 +839,22 @@ Mod_FreeFile(const char *path)
 	}
 }
 
+/*
+ * Releases a buffer returned by Mod_LoadFile() or
+ * FS_LoadFile(). Maps are shared with the collision
+ * code and only lose a reference.
+ */
+void
+Mod_FreeBuffer(void *buffer)
+{
+	if (buffer && CM_FreeFile(buffer))
+	{
+		return;
+	}
+
+	FS_FreeFile(buffer);
+}
+
 /*
 =================
 Mod_LoadFile
@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+ * USA.
+ *
+ * =======================================================================
+ *
+ * Hash tables from names to pointers, used by the registries of cvars,
+ * commands, aliases and sounds. The names are not copied, they must
+ * stay valid while they're in a table. The hash is case folded, so
+ * names differing only in case end up on the same probe sequence and
+ * can be looked up with and without case.
+ *
+ * =======================================================================
+ */
+
+#include <ctype.h>
+
+#include "header/common.h"
+
+struct namehashslot_s
+{
+	const char *name; /* NULL for empty slots */
+	void *value;
+	unsigned int hash;
+};
+
+/* all tables with at least one insert, for hashstats */
+static namehash_t *namehash_tables;
+static int namehash_resettime;
+
+static unsigned int
+NameHash_Hash(const char *name)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*name)
+	{
+		hash ^= (unsigned char)tolower((unsigned char)*name);
+		hash *= 16777619u;
+		name++;
+	}
+
+	return hash;
+}
+
+static void
+NameHash_Resize(namehash_t *table, int size)
+{
+	namehashslot_t *slots;
+	int i, mask;
+
+	slots = calloc(size, sizeof(namehashslot_t));
+	YQ2_COM_CHECK_OOM(slots, "calloc()", size * sizeof(namehashslot_t))
+	if (!slots)
+	{
+		/* unaware about YQ2_ATTR_NORETURN_FUNCPTR? */
+		return;
+	}
+
+	mask = size - 1;
+
+	for (i = 0; i < table->size; i++)
+	{
+		const namehashslot_t *old = &table->slots[i];
+		int j;
+
+		if (!old->name)
+		{
+			continue;
+		}
+
+		j = old->hash & mask;
+		while (slots[j].name)
+		{
+			j = (j + 1) & mask;
+		}
+
+		slots[j] = *old;
+	}
+
+	free(table->slots);
+	table->slots = slots;
+	table->size = size;
+}
+
+/*
+ * Adds a name, which must not be in the table with
+ * exactly the same spelling yet.
+ */
+void
+NameHash_Insert(namehash_t *table, const char *name, void *value)
+{
+	unsigned int hash;
+	int i, mask;
+
+	if (!table->linked)
+	{
+		table->linked = true;
+		table->next = namehash_tables;
+		namehash_tables = table;
+	}
+
+	/* keep the load below 3/4 */
+	if ((table->count + 1) * 4 > table->size * 3)
+	{
+		NameHash_Resize(table, table->size ? table->size * 2 : 256);
+	}
+
+	hash = NameHash_Hash(name);
+	mask = table->size - 1;
+
+	i = hash & mask;
+	while (table->slots[i].name)
+	{
+		i = (i + 1) & mask;
+	}
+
+	table->slots[i].name = name;
+	table->slots[i].value = value;
+	table->slots[i].hash = hash;
+	table->count++;
+}
+
+/*
+ * Removes the entry of the given name and value.
+ */
+void
+NameHash_Remove(namehash_t *table, const char *name, const void *value)
+{
+	unsigned int hash;
+	int i, mask;
+
+	if (!table->count)
+	{
+		return;
+	}
+
+	hash = NameHash_Hash(name);
+	mask = table->size - 1;
+
+	for (i = hash & mask; table->slots[i].name; i = (i + 1) & mask)
+	{
+		int j;
+
+		if (table->slots[i].value != value)
+		{
+			continue;
+		}
+
+		/* move following entries back, so that no probe
+		   sequence has a hole */
+		for (j = (i + 1) & mask; table->slots[j].name; j = (j + 1) & mask)
+		{
+			int home = table->slots[j].hash & mask;
+
+			if (((j - home) & mask) >= ((j - i) & mask))
+			{
+				table->slots[i] = table->slots[j];
+				i = j;
+			}
+		}
+
+		table->slots[i].name = NULL;
+		table->slots[i].value = NULL;
+		table->count--;
+
+		return;
+	}
+}
+
+static void *
+NameHash_Lookup(namehash_t *table, const char *name, qboolean nocase)
+{
+	unsigned int hash;
+	int i, mask;
+
+	table->lookups++;
+
+	if (!table->count)
+	{
+		return NULL;
+	}
+
+	hash = NameHash_Hash(name);
+	mask = table->size - 1;
+
+	for (i = hash & mask; table->slots[i].name; i = (i + 1) & mask)
+	{
+		const namehashslot_t *slot = &table->slots[i];
+
+		table->probes++;
+
+		if (slot->hash != hash)
+		{
+			continue;
+		}
+
+		if (nocase ? !Q_strcasecmp(slot->name, name) : !strcmp(slot->name, name))
+		{
+			return slot->value;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Returns the value of the name, NULL if it's unknown.
+ */
+void *
+NameHash_Find(namehash_t *table, const char *name)
+{
+	return NameHash_Lookup(table, name, false);
+}
+
+/*
+ * Like NameHash_Find(), but ignores the case.
+ */
+void *
+NameHash_FindNoCase(namehash_t *table, const char *name)
+{
+	return NameHash_Lookup(table, name, true);
+}
+
+/*
+ * Removes all entries and frees the slots.
+ */
+void
+NameHash_Clear(namehash_t *table)
+{
+	free(table->slots);
+
+	table->slots = NULL;
+	table->size = 0;
+	table->count = 0;
+}
+
+/*
+ * Prints the fill and probe lengths of all tables and
+ * the lookups since the last call.
+ */
+void
+NameHash_Stats_f(void)
+{
+	namehash_t *table;
+	float seconds;
+	int now;
+
+	now = Sys_Milliseconds();
+	seconds = (now - namehash_resettime) / 1000.0f;
+	namehash_resettime = now;
+
+	Com_Printf("table      names  slots  avg probe  max probe  lookups  per sec  probes/lookup\n");
+
+	for (table = namehash_tables; table; table = table->next)
+	{
+		int i, maxprobe, totalprobe;
+
+		maxprobe = 0;
+		totalprobe = 0;
+
+		for (i = 0; i < table->size; i++)
+		{
+			const namehashslot_t *slot = &table->slots[i];
+			int probe;
+
+			if (!slot->name)
+			{
+				continue;
+			}
+
+			probe = ((i - (int)(slot->hash & (table->size - 1))) & (table->size - 1)) + 1;
+			totalprobe += probe;
+			maxprobe = Q_max(maxprobe, probe);
+		}
+
+		Com_Printf("%-8s %7d %6d %10.2f %10d %8u %8.0f %14.2f\n",
+			table->desc, table->count, table->size,
+			table->count ? (float)totalprobe / table->count : 0.0f, maxprobe,
+			table->lookups, seconds > 0 ? table->lookups / seconds : 0.0f,
+			table->lookups ? (float)table->probes / table->lookups : 0.0f);
+	}
+
+	/* counters are reset on each call */
+	for (table = namehash_tables; table; table = table->next)
+	{
+		table->lookups = 0;
+		table->probes = 0;
+	}
+}
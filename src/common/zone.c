@@ -19,7 +19,8 @@
  *
  * =======================================================================
  *
- * Zone malloc. It's just a normal malloc with tags.
+ * Zone malloc. Small blocks with a tag are taken from per tag arenas,
+ * everything else is a normal malloc.
  *
  * =======================================================================
  */
@@ -29,34 +30,167 @@
 #include <stdint.h>
 
 #define Z_MAGIC 0x1d1d
+#define Z_MAGIC_ARENA 0x1d1e
+
+/* Blocks up to this size (header included) are carved
+   out of per tag chunks, larger ones are malloc()ed. */
+#define Z_ARENA_GRANULE 16
+#define Z_ARENA_MAXBLOCK 1024
+#define Z_ARENA_CLASSES (Z_ARENA_MAXBLOCK / Z_ARENA_GRANULE)
+#define Z_ARENA_CHUNKSIZE (64 * 1024)
+
+#define Z_TAGHASH 64
 
 typedef struct zhead_s
 {
-	struct zhead_s *prev, *next;
+	struct zhead_s *prev, *next; /* tag chain or free list */
 	size_t size;
 	unsigned short magic;
 	unsigned short tag; /* for group free */
 } zhead_t;
 
-static zhead_t z_chain;
+typedef struct zchunk_s
+{
+	struct zchunk_s *next;
+	size_t size;
+} zchunk_t;
+
+/*
+ * Everything allocated with one tag. Small blocks
+ * live in chunks and are recycled through one free
+ * list per size class. Freeing the tag releases the
+ * chunks as a whole.
+ */
+typedef struct ztag_s
+{
+	unsigned short tag;
+	zhead_t chain;            /* malloc()ed blocks */
+	zchunk_t *chunks;
+	byte *cur;                /* bump pointer into the newest chunk */
+	size_t left;
+	zhead_t *free[Z_ARENA_CLASSES];
+	size_t count, bytes;      /* live blocks */
+	size_t arena, freebytes;  /* chunk bytes, bytes on free lists */
+	struct ztag_s *next;
+} ztag_t;
+
+static ztag_t z_tag0;
+static ztag_t *z_tags[Z_TAGHASH];
 static size_t z_count, z_bytes;
 
+static void
+Z_InitTag(ztag_t *zt, unsigned short tag)
+{
+	memset(zt, 0, sizeof(*zt));
+
+	zt->tag = tag;
+	zt->chain.prev = &zt->chain;
+	zt->chain.next = &zt->chain;
+}
+
 void
 Z_Init(void)
 {
-	memset(&z_chain, 0, sizeof(z_chain));
-
-	z_chain.prev = &z_chain;
-	z_chain.next = &z_chain;
+	Z_InitTag(&z_tag0, 0);
+	memset(z_tags, 0, sizeof(z_tags));
 
 	z_count = 0;
 	z_bytes = 0;
 }
 
+static ztag_t *
+Z_GetTag(unsigned short tag, qboolean create)
+{
+	ztag_t *zt;
+
+	if (tag == 0)
+	{
+		return &z_tag0;
+	}
+
+	for (zt = z_tags[tag % Z_TAGHASH]; zt; zt = zt->next)
+	{
+		if (zt->tag == tag)
+		{
+			return zt;
+		}
+	}
+
+	if (!create)
+	{
+		return NULL;
+	}
+
+	zt = malloc(sizeof(ztag_t));
+
+	if (!zt)
+	{
+		Com_Error(ERR_FATAL, "%s: failed to allocate tag %i", __func__, tag);
+		return NULL;
+	}
+
+	Z_InitTag(zt, tag);
+	zt->next = z_tags[tag % Z_TAGHASH];
+	z_tags[tag % Z_TAGHASH] = zt;
+
+	return zt;
+}
+
+/*
+ * Takes a block of the given size class from the tags
+ * free list or bump allocates it from the newest chunk.
+ */
+static zhead_t *
+Z_ArenaAlloc(ztag_t *zt, size_t size)
+{
+	int class = (int)(size / Z_ARENA_GRANULE) - 1;
+	zhead_t *z;
+
+	if ((z = zt->free[class]) != NULL)
+	{
+		zt->free[class] = z->next;
+		zt->freebytes -= size;
+		memset(z, 0, size);
+
+		return z;
+	}
+
+	if (zt->left < size)
+	{
+		zchunk_t *chunk;
+
+		/* The tail of the old chunk is lost until the tag is freed. */
+		chunk = calloc(1, Z_ARENA_CHUNKSIZE);
+
+		if (!chunk)
+		{
+			Com_Error(ERR_FATAL, "%s: failed to allocate " YQ2_COM_PRIdS " bytes",
+				__func__, (size_t)Z_ARENA_CHUNKSIZE);
+			return NULL;
+		}
+
+		chunk->size = Z_ARENA_CHUNKSIZE;
+		chunk->next = zt->chunks;
+		zt->chunks = chunk;
+		zt->arena += Z_ARENA_CHUNKSIZE;
+
+		/* Keep blocks aligned to the granule. */
+		zt->cur = (byte *)chunk + ((sizeof(zchunk_t) + Z_ARENA_GRANULE - 1) & ~(Z_ARENA_GRANULE - 1));
+		zt->left = Z_ARENA_CHUNKSIZE - (zt->cur - (byte *)chunk);
+	}
+
+	z = (zhead_t *)zt->cur;
+	zt->cur += size;
+	zt->left -= size;
+
+	return z;
+}
+
 void
 Z_Free(void *ptr)
 {
 	zhead_t *z;
+	ztag_t *zt;
 
 	if (!ptr)
 	{
@@ -65,51 +199,126 @@ Z_Free(void *ptr)
 
 	z = ((zhead_t *)ptr) - 1;
 
-	if (z->magic != Z_MAGIC)
+	if ((z->magic != Z_MAGIC) && (z->magic != Z_MAGIC_ARENA))
 	{
 		Com_Error(ERR_FATAL, "%s: not a valid memory block: %p", __func__, ptr);
 		return;
 	}
 
-	z->prev->next = z->next;
-	z->next->prev = z->prev;
+	zt = Z_GetTag(z->tag, false);
+
+	if (!zt)
+	{
+		Com_Error(ERR_FATAL, "%s: block with unknown tag %i: %p", __func__, z->tag, ptr);
+		return;
+	}
 
 	z_count--;
 	z_bytes -= z->size;
+	zt->count--;
+	zt->bytes -= z->size;
+
+	if (z->magic == Z_MAGIC_ARENA)
+	{
+		int class = (int)(z->size / Z_ARENA_GRANULE) - 1;
+
+		/* can avoid possible double free with check above */
+		z->magic = 0;
+		z->next = zt->free[class];
+		zt->free[class] = z;
+		zt->freebytes += z->size;
+
+		return;
+	}
+
+	z->prev->next = z->next;
+	z->next->prev = z->prev;
 
 	z->magic = 0; /* can avoid possible double free with check above */
 	free(z);
 }
 
+static void
+Z_TagStats(const ztag_t *zt)
+{
+	size_t unused;
+
+	/* Free lists and the tail of the newest chunk. */
+	unused = zt->freebytes + zt->left;
+
+	Com_Printf("tag %5i: " YQ2_COM_PRIdS " bytes in " YQ2_COM_PRIdS " blocks, "
+		YQ2_COM_PRIdS " KiB in chunks, %i%% unused\n", zt->tag, zt->bytes,
+		zt->count, zt->arena / 1024,
+		zt->arena ? (int)(unused * 100 / zt->arena) : 0);
+}
+
 void
 Z_Stats_f(void)
 {
+	const ztag_t *zt;
+	int i;
+
 	Com_Printf(YQ2_COM_PRIdS " bytes in " YQ2_COM_PRIdS " blocks\n",
 		z_bytes, z_count);
+
+	Z_TagStats(&z_tag0);
+
+	for (i = 0; i < Z_TAGHASH; i++)
+	{
+		for (zt = z_tags[i]; zt; zt = zt->next)
+		{
+			if (zt->count || zt->arena)
+			{
+				Z_TagStats(zt);
+			}
+		}
+	}
 }
 
 void
 Z_FreeTags(unsigned short tag)
 {
 	zhead_t *z, *next;
+	zchunk_t *chunk;
+	ztag_t *zt;
 
-	for (z = z_chain.next; z != &z_chain; z = next)
+	if ((zt = Z_GetTag(tag, false)) == NULL)
+	{
+		return;
+	}
+
+	for (z = zt->chain.next; z != &zt->chain; z = next)
 	{
 		next = z->next;
+		Z_Free((void *)(z + 1));
+	}
 
-		if (z->tag == tag)
-		{
-			Z_Free((void *)(z + 1));
-		}
+	/* Small blocks go away with their chunks. */
+	while ((chunk = zt->chunks) != NULL)
+	{
+		zt->chunks = chunk->next;
+		free(chunk);
 	}
+
+	z_count -= zt->count;
+	z_bytes -= zt->bytes;
+
+	zt->cur = NULL;
+	zt->left = 0;
+	zt->count = 0;
+	zt->bytes = 0;
+	zt->arena = 0;
+	zt->freebytes = 0;
+	memset(zt->free, 0, sizeof(zt->free));
 }
 
 void *
 Z_TagMalloc(size_t size, unsigned short tag)
 {
 	zhead_t *z;
+	ztag_t *zt;
 
-	if (!size || ((SIZE_MAX - size) < sizeof(zhead_t)))
+	if (!size || ((SIZE_MAX - size) < sizeof(zhead_t) + Z_ARENA_GRANULE))
 	{
 		Com_Error(ERR_FATAL, "%s: bad allocation size: " YQ2_COM_PRIdS,
 			__func__, size);
@@ -117,26 +326,42 @@ Z_TagMalloc(size_t size, unsigned short tag)
 	}
 
 	size = size + sizeof(zhead_t);
-	z = calloc(1, size);
+	zt = Z_GetTag(tag, true);
 
-	if (!z)
+	/* Tag 0 is never freed as a whole, there's
+	   nothing to gain from arenas. */
+	if (tag && (size <= Z_ARENA_MAXBLOCK))
 	{
-		Com_Error(ERR_FATAL, "%s: failed to allocate " YQ2_COM_PRIdS " bytes",
-			__func__, size);
-		return NULL;
+		size = (size + Z_ARENA_GRANULE - 1) & ~(size_t)(Z_ARENA_GRANULE - 1);
+		z = Z_ArenaAlloc(zt, size);
+		z->magic = Z_MAGIC_ARENA;
+	}
+	else
+	{
+		z = calloc(1, size);
+
+		if (!z)
+		{
+			Com_Error(ERR_FATAL, "%s: failed to allocate " YQ2_COM_PRIdS " bytes",
+				__func__, size);
+			return NULL;
+		}
+
+		z->magic = Z_MAGIC;
+
+		z->next = zt->chain.next;
+		z->prev = &zt->chain;
+		zt->chain.next->prev = z;
+		zt->chain.next = z;
 	}
 
 	z_count++;
 	z_bytes += size;
-	z->magic = Z_MAGIC;
+	zt->count++;
+	zt->bytes += size;
 	z->tag = tag;
 	z->size = size;
 
-	z->next = z_chain.next;
-	z->prev = &z_chain;
-	z_chain.next->prev = z;
-	z_chain.next = z;
-
 	return (void *)(z + 1);
 }
 
@@ -150,8 +375,9 @@ void *
 Z_TagRealloc(void *ptr, size_t size, unsigned short tag)
 {
 	zhead_t *z, *zr;
+	ztag_t *zt;
 
-	if (!size || ((SIZE_MAX - size) < sizeof(zhead_t)))
+	if (!size || ((SIZE_MAX - size) < sizeof(zhead_t) + Z_ARENA_GRANULE))
 	{
 		Com_Error(ERR_FATAL, "%s: bad allocation size: " YQ2_COM_PRIdS,
 			__func__, size);
@@ -165,12 +391,28 @@ Z_TagRealloc(void *ptr, size_t size, unsigned short tag)
 
 	z = (zhead_t *)ptr - 1;
 
-	if (z->magic != Z_MAGIC)
+	if ((z->magic != Z_MAGIC) && (z->magic != Z_MAGIC_ARENA))
 	{
 		Com_Error(ERR_FATAL, "%s: not a valid memory block: %p", __func__, ptr);
 		return NULL;
 	}
 
+	/* Arena blocks can't grow in place and blocks
+	   changing their tag must change their chain. */
+	if ((z->magic == Z_MAGIC_ARENA) || (z->tag != tag) ||
+		(tag && (size + sizeof(zhead_t) <= Z_ARENA_MAXBLOCK)))
+	{
+		void *newptr;
+
+		newptr = Z_TagMalloc(size, tag);
+		memcpy(newptr, ptr, Q_min(size, z->size - sizeof(zhead_t)));
+		Z_Free(ptr);
+
+		return newptr;
+	}
+
+	zt = Z_GetTag(tag, false);
+
 	size = size + sizeof(zhead_t);
 	zr = realloc(z, size);
 
@@ -188,8 +430,9 @@ Z_TagRealloc(void *ptr, size_t size, unsigned short tag)
 
 	z_bytes -= zr->size;
 	z_bytes += size;
+	zt->bytes -= zr->size;
+	zt->bytes += size;
 
-	zr->tag = tag;
 	zr->size = size;
 	zr->prev->next = zr;
 	zr->next->prev = zr;
@@ -215,11 +458,10 @@ Z_BlockSize(const void *ptr)
 
 	z = (const zhead_t *)ptr - 1;
 
-	if (z->magic != Z_MAGIC)
+	if ((z->magic != Z_MAGIC) && (z->magic != Z_MAGIC_ARENA))
 	{
 		return 0;
 	}
 
 	return z->size - sizeof(*z);
 }
-
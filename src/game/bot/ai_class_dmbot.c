@@ -1049,7 +1049,7 @@ BOT_DMclass_InitPersistant(edict_t *self)
 	self->ai->pers.deadFrame = BOT_DMclass_DeadFrame;
 
 	/* available moveTypes for this class */
-	self->ai->pers.moveTypesMask = (LINK_MOVE|LINK_STAIRS|LINK_FALL|LINK_WATER|LINK_WATERJUMP|LINK_JUMPPAD|LINK_PLATFORM|LINK_TELEPORT|LINK_LADDER|LINK_JUMP|LINK_CROUCH);
+	self->ai->pers.moveTypesMask = AI_DMBOT_MOVETYPES;
 
 	//Persistant Inventory Weights (0 = can not pick)
 	memset(self->ai->pers.inventoryWeights, 0, sizeof (self->ai->pers.inventoryWeights));
@@ -97,16 +97,206 @@ AI_Distance(const vec3_t o1, const vec3_t o2)
 	return VectorLength(distVec);
 }
 
+//==================================================================
+//
+//		NODE GRID (uniform grid over the node origins on x and y)
+//
+//==================================================================
+
+#define NODEGRID_MAXSIZE 128	// max cells per side
+
+typedef struct
+{
+	int		numnodes;	// nodes in the grid, later ones are scanned
+	vec2_t	mins;
+	float	cellsize;
+	int		width;
+	int		height;
+	int		cellstart[NODEGRID_MAXSIZE * NODEGRID_MAXSIZE + 1];
+	int		cellnodes[MAX_NODES];	// ascending per cell
+} nav_nodegrid_t;
+
+static nav_nodegrid_t nodegrid;
+
+//==========================================
+// AI_ClearNodeGrid
+// forget the grid, must be done when nodes are removed
+//==========================================
+void
+AI_ClearNodeGrid(void)
+{
+	nodegrid.numnodes = 0;
+	nodegrid.width = 0;
+	nodegrid.height = 0;
+}
+
+static int
+AI_NodeGridCell(float value, float mins, int size)
+{
+	int cell;
+
+	cell = (int)floor((value - mins) / nodegrid.cellsize);
+
+	return Q_clamp(cell, 0, size - 1);
+}
+
+//==========================================
+// AI_BuildNodeGrid
+// sort all current nodes into the grid
+//==========================================
+void
+AI_BuildNodeGrid(void)
+{
+	vec2_t	maxs;
+	float	extent;
+	int		i, numcells;
+
+	AI_ClearNodeGrid();
+
+	if (nav.num_nodes < 1)
+	{
+		return;
+	}
+
+	nodegrid.mins[0] = maxs[0] = nodes[0].origin[0];
+	nodegrid.mins[1] = maxs[1] = nodes[0].origin[1];
+
+	for (i = 1; i < nav.num_nodes; i++)
+	{
+		nodegrid.mins[0] = Q_min(nodegrid.mins[0], nodes[i].origin[0]);
+		nodegrid.mins[1] = Q_min(nodegrid.mins[1], nodes[i].origin[1]);
+		maxs[0] = Q_max(maxs[0], nodes[i].origin[0]);
+		maxs[1] = Q_max(maxs[1], nodes[i].origin[1]);
+	}
+
+	extent = Q_max(maxs[0] - nodegrid.mins[0], maxs[1] - nodegrid.mins[1]);
+	nodegrid.cellsize = Q_max(NODE_DENSITY, extent / (NODEGRID_MAXSIZE - 1));
+	nodegrid.width = (int)((maxs[0] - nodegrid.mins[0]) / nodegrid.cellsize) + 1;
+	nodegrid.height = (int)((maxs[1] - nodegrid.mins[1]) / nodegrid.cellsize) + 1;
+	nodegrid.width = Q_min(nodegrid.width, NODEGRID_MAXSIZE);
+	nodegrid.height = Q_min(nodegrid.height, NODEGRID_MAXSIZE);
+	numcells = nodegrid.width * nodegrid.height;
+
+	// counting sort, nodes stay ascending inside their cell
+	memset(nodegrid.cellstart, 0, sizeof(int) * (numcells + 1));
+
+	for (i = 0; i < nav.num_nodes; i++)
+	{
+		int cell;
+
+		cell = AI_NodeGridCell(nodes[i].origin[1], nodegrid.mins[1], nodegrid.height) * nodegrid.width +
+			AI_NodeGridCell(nodes[i].origin[0], nodegrid.mins[0], nodegrid.width);
+		nodegrid.cellstart[cell + 1]++;
+	}
+
+	for (i = 0; i < numcells; i++)
+	{
+		nodegrid.cellstart[i + 1] += nodegrid.cellstart[i];
+	}
+
+	for (i = 0; i < nav.num_nodes; i++)
+	{
+		int cell;
+
+		cell = AI_NodeGridCell(nodes[i].origin[1], nodegrid.mins[1], nodegrid.height) * nodegrid.width +
+			AI_NodeGridCell(nodes[i].origin[0], nodegrid.mins[0], nodegrid.width);
+		nodegrid.cellnodes[nodegrid.cellstart[cell]++] = i;
+	}
+
+	// the fill moved each start to the next cell
+	for (i = numcells; i > 0; i--)
+	{
+		nodegrid.cellstart[i] = nodegrid.cellstart[i - 1];
+	}
+
+	nodegrid.cellstart[0] = 0;
+	nodegrid.numnodes = nav.num_nodes;
+}
+
+static qboolean
+AI_NodeIsInRadius(int node, const vec3_t org, float rad, qboolean ignoreHeight)
+{
+	vec3_t	eorg;
+	int		j;
+
+	for (j = 0; j < 3 ; j++)
+	{
+		eorg[j] = org[j] - nodes[node].origin[j];
+	}
+
+	if (ignoreHeight)
+	{
+		eorg[2] = 0;
+	}
+
+	return (VectorLengthSquared(eorg) <= rad * rad);
+}
+
+//==========================================
+// AI_NodesInRadius
+// all nodes within rad, in no particular order.
+// list must have room for MAX_NODES
+//==========================================
+int
+AI_NodesInRadius(const vec3_t org, float rad, qboolean ignoreHeight, int *list)
+{
+	int		x, y, x0, x1, y0, y1;
+	int		node, count = 0;
+
+	if (nodegrid.numnodes > 0 && nodegrid.numnodes <= nav.num_nodes)
+	{
+		x0 = AI_NodeGridCell(org[0] - rad, nodegrid.mins[0], nodegrid.width);
+		x1 = AI_NodeGridCell(org[0] + rad, nodegrid.mins[0], nodegrid.width);
+		y0 = AI_NodeGridCell(org[1] - rad, nodegrid.mins[1], nodegrid.height);
+		y1 = AI_NodeGridCell(org[1] + rad, nodegrid.mins[1], nodegrid.height);
+
+		for (y = y0; y <= y1; y++)
+		{
+			for (x = x0; x <= x1; x++)
+			{
+				int cell = y * nodegrid.width + x;
+				int k;
+
+				for (k = nodegrid.cellstart[cell]; k < nodegrid.cellstart[cell + 1]; k++)
+				{
+					if (AI_NodeIsInRadius(nodegrid.cellnodes[k], org, rad, ignoreHeight))
+					{
+						list[count++] = nodegrid.cellnodes[k];
+					}
+				}
+			}
+		}
+
+		node = nodegrid.numnodes;
+	}
+	else
+	{
+		node = 0;
+	}
+
+	// nodes added after the grid was built
+	for (; node < nav.num_nodes; node++)
+	{
+		if (AI_NodeIsInRadius(node, org, rad, ignoreHeight))
+		{
+			list[count++] = node;
+		}
+	}
+
+	return count;
+}
+
 //=================
 //AI_findNodeInRadius
 //
 // Copy of findradius to act with nodes instead of entities
 // Setting up ignoreHeight uses a cilinder instead of a sphere (used to catch fall links)
+// Returns the lowest node after from, so the grid gives the same order as a full walk.
 //=================
 int AI_findNodeInRadius (int from, vec3_t org, float rad, qboolean ignoreHeight)
 {
-	vec3_t	eorg;
-	int		j;
+	int		x, y, x0, x1, y0, y1;
+	int		node, best = -1;
 
 	if (from < 0)
 		return -1;
@@ -117,25 +307,58 @@ int AI_findNodeInRadius (int from, vec3_t org, float rad, qboolean ignoreHeight)
 	else
 		from++;
 
-	for (; from < nav.num_nodes; from++)
+	if (nodegrid.numnodes > 0 && nodegrid.numnodes <= nav.num_nodes)
 	{
+		x0 = AI_NodeGridCell(org[0] - rad, nodegrid.mins[0], nodegrid.width);
+		x1 = AI_NodeGridCell(org[0] + rad, nodegrid.mins[0], nodegrid.width);
+		y0 = AI_NodeGridCell(org[1] - rad, nodegrid.mins[1], nodegrid.height);
+		y1 = AI_NodeGridCell(org[1] + rad, nodegrid.mins[1], nodegrid.height);
 
-		for (j = 0; j < 3 ; j++)
+		for (y = y0; y <= y1; y++)
 		{
-			eorg[j] = org[j] - nodes[from].origin[j];
+			for (x = x0; x <= x1; x++)
+			{
+				int cell = y * nodegrid.width + x;
+				int k;
+
+				for (k = nodegrid.cellstart[cell]; k < nodegrid.cellstart[cell + 1]; k++)
+				{
+					node = nodegrid.cellnodes[k];
+
+					if (node < from)
+					{
+						continue;
+					}
+
+					if (best >= 0 && node >= best)
+					{
+						break;
+					}
+
+					if (AI_NodeIsInRadius(node, org, rad, ignoreHeight))
+					{
+						best = node;
+						break;
+					}
+				}
+			}
 		}
 
-		if (ignoreHeight)
+		if (best >= 0)
 		{
-			eorg[2] = 0;
+			return best;
 		}
 
-		if (VectorLengthSquared(eorg) > rad * rad)
+		from = Q_max(from, nodegrid.numnodes);
+	}
+
+	// nodes added after the grid was built
+	for (node = from; node < nav.num_nodes; node++)
+	{
+		if (AI_NodeIsInRadius(node, org, rad, ignoreHeight))
 		{
-			continue;
+			return node;
 		}
-
-		return from;
 	}
 
 	return -1;
@@ -194,6 +417,8 @@ AI_AddLink( int n1, int n2, int linkType)
 
 	pLinks[n1].numLinks++;
 
+	AStar_LinksChanged();
+
 	return true;
 }
 
@@ -692,28 +917,24 @@ AI_FindFallOrigin(int n1, int n2, vec3_t fallorigin)
 static int
 AI_LadderLink_FindUpperNode(int node)
 {
-	int		i = INVALID;
-	int		j;
-	vec3_t	eorg;
-	float	xzdist;
+	static int	list[MAX_NODES];
+	int		count;
+	int		k;
 	int		candidate = INVALID;
 
-	for (i = 0; i < nav.num_nodes; i++)
+	//same ladder: within 8 units, ignoring height
+	count = AI_NodesInRadius(nodes[node].origin, 8, true, list);
+
+	for (k = 0; k < count; k++)
 	{
+		int i = list[k];
+
 		if (i == node)
 			continue;
 
 		if (!(nodes[i].flags & NODEFLAGS_LADDER))
 			continue;
 
-		//same ladder
-		for (j=0 ; j<2 ; j++)
-			eorg[j] = nodes[i].origin[j] - nodes[node].origin[j];
-		eorg[2] = 0; //ignore height
-		xzdist = VectorLength(eorg);
-		if (xzdist > 8)	//not in our ladder
-			continue;
-
 		if (nodes[node].origin[2] > nodes[i].origin[2])	//below
 			continue;
 
@@ -723,8 +944,9 @@ AI_LadderLink_FindUpperNode(int node)
 			continue;
 		}
 
-		//shorter is better
-		if (nodes[i].origin[2] - nodes[node].origin[2] < nodes[candidate].origin[2] - nodes[node].origin[2])
+		//shorter is better, the lower node on a tie as in a full walk
+		if (nodes[i].origin[2] - nodes[node].origin[2] < nodes[candidate].origin[2] - nodes[node].origin[2] ||
+			(nodes[i].origin[2] == nodes[candidate].origin[2] && i < candidate))
 			candidate = i;
 	}
 
@@ -741,28 +963,24 @@ AI_LadderLink_FindUpperNode(int node)
 static int
 AI_LadderLink_FindLowerNode(int node)
 {
-	int		i = INVALID;
-	int		j;
-	vec3_t	eorg;
-	float	xzdist;
+	static int	list[MAX_NODES];
+	int		count;
+	int		k;
 	int		candidate = INVALID;
 
-	for (i=0; i<nav.num_nodes; i++)
+	//same ladder: within 8 units, ignoring height
+	count = AI_NodesInRadius(nodes[node].origin, 8, true, list);
+
+	for (k = 0; k < count; k++)
 	{
+		int i = list[k];
+
 		if (i == node)
 			continue;
 
 		if (!(nodes[i].flags & NODEFLAGS_LADDER))
 			continue;
 
-		//same ladder
-		for (j=0 ; j<2 ; j++)
-			eorg[j] = nodes[i].origin[j] - nodes[node].origin[j];
-		eorg[2] = 0; //ignore height
-		xzdist = VectorLength(eorg);
-		if (xzdist > 8)	//not in our ladder
-			continue;
-
 		if (nodes[i].origin[2] > nodes[node].origin[2])	//above
 			continue;
 
@@ -772,8 +990,9 @@ AI_LadderLink_FindLowerNode(int node)
 			continue;
 		}
 
-		//shorter is better
-		if (nodes[node].origin[2] - nodes[i].origin[2] < nodes[node].origin[2] - nodes[candidate].origin[2])
+		//shorter is better, the lower node on a tie as in a full walk
+		if (nodes[node].origin[2] - nodes[i].origin[2] < nodes[node].origin[2] - nodes[candidate].origin[2] ||
+			(nodes[i].origin[2] == nodes[candidate].origin[2] && i < candidate))
 			candidate = i;
 	}
 
@@ -139,6 +139,9 @@ qboolean AI_AddLink( int n1, int n2, int linkType );
 qboolean AI_PlinkExists(int n1, int n2);
 int AI_PlinkMoveType(int n1, int n2);
 int AI_findNodeInRadius (int from, vec3_t org, float rad, qboolean ignoreHeight);
+int AI_NodesInRadius(const vec3_t org, float rad, qboolean ignoreHeight, int *list);
+void AI_BuildNodeGrid(void);
+void AI_ClearNodeGrid(void);
 char *AI_LinkString(int linktype);
 int AI_GravityBoxToLink(int n1, int n2);
 int AI_LinkCloseNodes_JumpPass(int start);
@@ -161,6 +164,17 @@ qboolean AI_IsLadder(vec3_t origin, vec3_t v_angle, vec3_t mins, vec3_t maxs, ed
 //	A* PROPS
 //===========================================
 qboolean AStar_GetPath(int origin, int goal, int movetypes, struct astarpath_s *path);
+void AStar_LinksChanged(void);
+
+//	ROUTES
+//===========================================
+#define AI_DMBOT_MOVETYPES (LINK_MOVE|LINK_STAIRS|LINK_FALL|LINK_WATER|LINK_WATERJUMP|LINK_JUMPPAD|LINK_PLATFORM|LINK_TELEPORT|LINK_LADDER|LINK_JUMP|LINK_CROUCH)
+
+void AI_InitRoutes(const char *mapname, int filenodes);
+void AI_ClearRoutes(void);
+qboolean AI_RouteGetPath(int origin, int goal, int movetypes, struct astarpath_s *path,
+	qboolean *found);
+qboolean AI_RouteCost(int from, int to, int movetypes, int *cost);
 
 /* ai_class_dmbot */
 qboolean BOT_DMclass_FindEnemy(edict_t *self);
@@ -38,6 +38,10 @@
 int AI_FindCost(int from, int to, int movetypes)
 {
 	astarpath_t	path;
+	int			cost;
+
+	if (AI_RouteCost(from, to, movetypes, &cost))
+		return cost;
 
 	if (!AStar_GetPath( from, to, movetypes, &path))
 		return -1;
@@ -45,6 +49,26 @@ int AI_FindCost(int from, int to, int movetypes)
 	return path.numNodes;
 }
 
+typedef struct
+{
+	float	dist;
+	int		node;
+} nav_candidate_t;
+
+static int
+AI_CandidateCompare(const void *a, const void *b)
+{
+	const nav_candidate_t *c1 = a;
+	const nav_candidate_t *c2 = b;
+
+	if (c1->dist != c2->dist)
+	{
+		return (c1->dist < c2->dist) ? -1 : 1;
+	}
+
+	return c1->node - c2->node;
+}
+
 //==========================================
 // AI_FindClosestReachableNode
 // Find the closest node to the player within a certain range
@@ -52,9 +76,10 @@ int AI_FindCost(int from, int to, int movetypes)
 int
 AI_FindClosestReachableNode( vec3_t origin, edict_t *passent, int range, int flagsmask )
 {
-	size_t i;
+	static int list[MAX_NODES];
+	static nav_candidate_t candidates[MAX_NODES];
 	float closest = 99999;
-	int node = -1;
+	int i, count, numcandidates = 0;
 	vec3_t v;
 	float rng;
 	vec3_t maxs,mins;
@@ -71,31 +96,45 @@ AI_FindClosestReachableNode( vec3_t origin, edict_t *passent, int range, int fla
 
 	rng = (float)(range * range); // square range for distance comparison (eliminate sqrt)
 
-	for(i = 0; i < nav.num_nodes; i++)
+	count = AI_NodesInRadius(origin, range, false, list);
+
+	for (i = 0; i < count; i++)
 	{
-		if (flagsmask == NODE_ALL || nodes[i].flags & flagsmask)
+		int node = list[i];
+
+		if (flagsmask == NODE_ALL || nodes[node].flags & flagsmask)
 		{
 			float dist;
 
-			VectorSubtract(nodes[i].origin, origin, v);
+			VectorSubtract(nodes[node].origin, origin, v);
 
 			dist = v[0]*v[0] + v[1]*v[1] + v[2]*v[2];
 
 			if (dist < closest && dist < rng)
 			{
-				trace_t tr;
-
-				// make sure it is visible
-				tr = gi.trace( origin, mins, maxs, nodes[i].origin, passent, MASK_AISOLID);
-				if (tr.fraction == 1.0)
-				{
-					node = i;
-					closest = dist;
-				}
+				candidates[numcandidates].dist = dist;
+				candidates[numcandidates].node = node;
+				numcandidates++;
 			}
 		}
 	}
-	return node;
+
+	// trace nearest first, the first visible one is the closest
+	qsort(candidates, numcandidates, sizeof(nav_candidate_t), AI_CandidateCompare);
+
+	for (i = 0; i < numcandidates; i++)
+	{
+		trace_t tr;
+
+		// make sure it is visible
+		tr = gi.trace( origin, mins, maxs, nodes[candidates[i].node].origin, passent, MASK_AISOLID);
+		if (tr.fraction == 1.0)
+		{
+			return candidates[i].node;
+		}
+	}
+
+	return -1;
 }
 
 //==========================================
@@ -28,6 +28,8 @@
  * in NO WAY supported by Steve Yeager.
  */
 
+#include <time.h>
+
 #include "../header/local.h"
 #include "ai_local.h"
 
@@ -655,6 +657,8 @@ AI_LoadPLKFile(char *mapname)
 	FILE *pIn;
 
 	nav.num_nodes = 0;
+	AI_ClearNodeGrid();
+	AStar_LinksChanged();
 
 	Com_sprintf (filename, sizeof(filename), "%s/%s/%s.%s",
 		gi.Gamedir(), AI_NODES_FOLDER, mapname, NAV_FILE_EXTENSION);
@@ -1022,6 +1026,9 @@ AI_CleanNodesAndLinks(void)
 	nav.num_nodes = 0;
 	memset(nodes, 0, sizeof(nav_node_t) * MAX_NODES);
 	memset(pLinks, 0, sizeof(nav_plink_t) * MAX_NODES);
+
+	AI_ClearNodeGrid();
+	AStar_LinksChanged();
 }
 
 //==========================================
@@ -1036,6 +1043,7 @@ AI_InitNavigationData(void)
 	int newjumplinks;
 	int linkscount;
 	int	servernodesstart = 0;
+	clock_t linkstart;
 
 	AI_CleanNodesAndLinks();
 
@@ -1056,6 +1064,9 @@ AI_InitNavigationData(void)
 
 	//create nodes for map entities
 	AI_CreateNodesForEntities();
+
+	linkstart = clock();
+	AI_BuildNodeGrid();
 	newlinks = AI_LinkServerNodes(servernodesstart);
 	newjumplinks = AI_LinkCloseNodes_JumpPass(servernodesstart);
 
@@ -1067,4 +1078,8 @@ AI_InitNavigationData(void)
 	Com_Printf("Loaded links: %i.\n", linkscount);
 	Com_Printf("Added links: %i.\n", newlinks);
 	Com_Printf("Added jump links: %i.\n", newjumplinks);
+	Com_Printf("Link time: %i ms of CPU time.\n",
+		(int)((clock() - linkstart) * 1000 / CLOCKS_PER_SEC));
+
+	AI_InitRoutes(level.mapname, servernodesstart);
 }
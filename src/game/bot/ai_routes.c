@@ -0,0 +1,604 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ * Copyright (C) 2001 Steve Yeager
+ * Copyright (C) 2001-2004 Pat AfterMoon
+ * Copyright (c) ZeniMax Media Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Precomputed routes: for maps with a modest number of nodes the next
+ * node on the shortest way from every node to every other node is kept
+ * in a table, so paths and costs are read from it instead of running
+ * A* on each goal change.
+ *
+ * The table is appended to the .nav file after the links. Builds not
+ * knowing about it stop reading before, so the file stays loadable by
+ * them. It's only used if it was made for exactly the graph built at
+ * map start, otherwise it's computed again and the file is updated.
+ *
+ * =======================================================================
+ */
+
+#include <limits.h>
+#include <time.h>
+
+#include "../header/local.h"
+#include "ai_local.h"
+
+#define AI_ROUTES_MAXNODES	1024
+#define AI_ROUTES_MAGIC		(('R' << 24) + ('V' << 16) + ('A' << 8) + 'N')	// "NAVR"
+#define AI_ROUTES_VERSION	1
+#define AI_ROUTES_NONE		0xFFFF
+
+// movetype masks with a table
+static const int routes_masks[] = {
+	AI_DMBOT_MOVETYPES
+};
+
+#define AI_ROUTES_NUMMASKS (sizeof(routes_masks) / sizeof(routes_masks[0]))
+
+typedef struct
+{
+	int				numnodes;	// 0 if there are no routes
+	unsigned int	checksum;
+	unsigned short	*next[AI_ROUTES_NUMMASKS];	// [from * numnodes + to]
+} ai_routes_t;
+
+static ai_routes_t routes;
+
+typedef struct
+{
+	int		dist;
+	int		node;
+} ai_routeheap_t;
+
+//==========================================
+// AI_ClearRoutes
+// forget the routes, must be done when links change
+//==========================================
+void
+AI_ClearRoutes(void)
+{
+	size_t i;
+
+	for (i = 0; i < AI_ROUTES_NUMMASKS; i++)
+	{
+		free(routes.next[i]);
+		routes.next[i] = NULL;
+	}
+
+	routes.numnodes = 0;
+	routes.checksum = 0;
+}
+
+static unsigned int
+AI_RoutesHash(unsigned int hash, const void *data, size_t size)
+{
+	const byte *bytes = data;
+	size_t i;
+
+	for (i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/*
+ * Checksum of everything the routes depend on.
+ */
+static unsigned int
+AI_RoutesChecksum(void)
+{
+	unsigned int hash = 2166136261u;
+	int i;
+
+	hash = AI_RoutesHash(hash, &nav.num_nodes, sizeof(int));
+
+	for (i = 0; i < nav.num_nodes; i++)
+	{
+		hash = AI_RoutesHash(hash, &pLinks[i].numLinks, sizeof(int));
+		hash = AI_RoutesHash(hash, pLinks[i].nodes, sizeof(int) * pLinks[i].numLinks);
+		hash = AI_RoutesHash(hash, pLinks[i].dist, sizeof(int) * pLinks[i].numLinks);
+		hash = AI_RoutesHash(hash, pLinks[i].moveType, sizeof(int) * pLinks[i].numLinks);
+	}
+
+	return hash;
+}
+
+static qboolean
+AI_RoutesHeapLess(const ai_routeheap_t *a, const ai_routeheap_t *b)
+{
+	if (a->dist != b->dist)
+	{
+		return a->dist < b->dist;
+	}
+
+	return a->node < b->node;
+}
+
+static void
+AI_RoutesHeapPush(ai_routeheap_t *heap, int *count, int dist, int node)
+{
+	int i = (*count)++;
+
+	heap[i].dist = dist;
+	heap[i].node = node;
+
+	while (i > 0)
+	{
+		int parent = (i - 1) / 2;
+		ai_routeheap_t tmp;
+
+		if (!AI_RoutesHeapLess(&heap[i], &heap[parent]))
+		{
+			break;
+		}
+
+		tmp = heap[i];
+		heap[i] = heap[parent];
+		heap[parent] = tmp;
+		i = parent;
+	}
+}
+
+static ai_routeheap_t
+AI_RoutesHeapPop(ai_routeheap_t *heap, int *count)
+{
+	ai_routeheap_t top = heap[0];
+	int i = 0;
+
+	(*count)--;
+	heap[0] = heap[*count];
+
+	while (1)
+	{
+		int child = i * 2 + 1;
+		ai_routeheap_t tmp;
+
+		if (child >= *count)
+		{
+			break;
+		}
+
+		if (child + 1 < *count && AI_RoutesHeapLess(&heap[child + 1], &heap[child]))
+		{
+			child++;
+		}
+
+		if (!AI_RoutesHeapLess(&heap[child], &heap[i]))
+		{
+			break;
+		}
+
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+		i = child;
+	}
+
+	return top;
+}
+
+/*
+ * One Dijkstra per goal over the reversed links. The
+ * tree of each goal gives the next node for every start,
+ * so following the table always ends at the goal.
+ */
+static void
+AI_ComputeRoutes(unsigned short *next, int numnodes, int mask)
+{
+	int *start, *from, *dist, *best;
+	ai_routeheap_t *heap;
+	int i, numlinks, goal;
+
+	for (numlinks = 0, i = 0; i < numnodes; i++)
+	{
+		numlinks += pLinks[i].numLinks;
+	}
+
+	start = calloc(numnodes + 1, sizeof(int));
+	from = malloc((numlinks + 1) * sizeof(int));
+	dist = malloc((numlinks + 1) * sizeof(int));
+	best = malloc(numnodes * sizeof(int));
+	heap = malloc((numlinks + numnodes) * sizeof(ai_routeheap_t));
+
+	if (!start || !from || !dist || !best || !heap)
+	{
+		gi.error("%s: malloc failed\n", __func__);
+	}
+
+	// links sorted by their target
+	for (i = 0; i < numnodes; i++)
+	{
+		int j;
+
+		for (j = 0; j < pLinks[i].numLinks; j++)
+		{
+			if ((pLinks[i].moveType[j] & mask) && pLinks[i].nodes[j] != i)
+			{
+				start[pLinks[i].nodes[j] + 1]++;
+			}
+		}
+	}
+
+	for (i = 0; i < numnodes; i++)
+	{
+		start[i + 1] += start[i];
+	}
+
+	for (i = 0; i < numnodes; i++)
+	{
+		int j;
+
+		for (j = 0; j < pLinks[i].numLinks; j++)
+		{
+			int to = pLinks[i].nodes[j];
+
+			if ((pLinks[i].moveType[j] & mask) && to != i)
+			{
+				from[start[to]] = i;
+				dist[start[to]] = Q_max(pLinks[i].dist[j], 0);
+				start[to]++;
+			}
+		}
+	}
+
+	for (i = numnodes; i > 0; i--)
+	{
+		start[i] = start[i - 1];
+	}
+
+	start[0] = 0;
+
+	for (i = 0; i < numnodes * numnodes; i++)
+	{
+		next[i] = AI_ROUTES_NONE;
+	}
+
+	for (goal = 0; goal < numnodes; goal++)
+	{
+		int count = 0;
+
+		for (i = 0; i < numnodes; i++)
+		{
+			best[i] = INT_MAX;
+		}
+
+		best[goal] = 0;
+		AI_RoutesHeapPush(heap, &count, 0, goal);
+
+		while (count)
+		{
+			ai_routeheap_t top;
+			int k;
+
+			top = AI_RoutesHeapPop(heap, &count);
+			if (top.dist > best[top.node])
+			{
+				continue;
+			}
+
+			for (k = start[top.node]; k < start[top.node + 1]; k++)
+			{
+				int d;
+
+				d = (dist[k] > INT_MAX - top.dist) ? INT_MAX : top.dist + dist[k];
+				if (d < best[from[k]])
+				{
+					best[from[k]] = d;
+					next[from[k] * numnodes + goal] = top.node;
+					AI_RoutesHeapPush(heap, &count, d, from[k]);
+				}
+			}
+		}
+	}
+
+	free(heap);
+	free(best);
+	free(dist);
+	free(from);
+	free(start);
+}
+
+static void
+AI_RoutesFileName(char *filename, size_t size, const char *mapname)
+{
+	Com_sprintf(filename, size, "%s/%s/%s.%s",
+		gi.Gamedir(), AI_NODES_FOLDER, mapname, NAV_FILE_EXTENSION);
+}
+
+/*
+ * The routes start after the nodes and
+ * links read by AI_LoadPLKFile().
+ */
+static long
+AI_RoutesFileOffset(int filenodes)
+{
+	return (long)(2 * sizeof(int)) +
+		(long)filenodes * (sizeof(nav_node_t) + sizeof(nav_plink_t));
+}
+
+static qboolean
+AI_LoadRoutes(const char *mapname, int filenodes, unsigned int checksum)
+{
+	char filename[MAX_OSPATH];
+	int header[5];
+	size_t i, size;
+	FILE *pIn;
+
+	AI_RoutesFileName(filename, sizeof(filename), mapname);
+
+	pIn = Q_fopen(filename, "rb");
+	if (!pIn)
+	{
+		return false;
+	}
+
+	size = (size_t)nav.num_nodes * nav.num_nodes;
+
+	if (fseek(pIn, AI_RoutesFileOffset(filenodes), SEEK_SET) ||
+		fread(header, sizeof(int), 5, pIn) != 5 ||
+		header[0] != AI_ROUTES_MAGIC || header[1] != AI_ROUTES_VERSION ||
+		(unsigned int)header[2] != checksum || header[3] != nav.num_nodes ||
+		header[4] != AI_ROUTES_NUMMASKS)
+	{
+		fclose(pIn);
+		return false;
+	}
+
+	for (i = 0; i < AI_ROUTES_NUMMASKS; i++)
+	{
+		int mask;
+
+		routes.next[i] = malloc(size * sizeof(unsigned short));
+		if (!routes.next[i])
+		{
+			gi.error("%s: malloc failed\n", __func__);
+		}
+
+		if (fread(&mask, sizeof(int), 1, pIn) != 1 || mask != routes_masks[i] ||
+			fread(routes.next[i], sizeof(unsigned short), size, pIn) != size)
+		{
+			AI_ClearRoutes();
+			fclose(pIn);
+			return false;
+		}
+	}
+
+	fclose(pIn);
+
+	return true;
+}
+
+static void
+AI_SaveRoutes(const char *mapname, int filenodes, unsigned int checksum)
+{
+	char filename[MAX_OSPATH];
+	int header[5];
+	size_t i, size;
+	FILE *pOut;
+
+	AI_RoutesFileName(filename, sizeof(filename), mapname);
+
+	pOut = Q_fopen(filename, "r+b");
+	if (!pOut)
+	{
+		return;
+	}
+
+	header[0] = AI_ROUTES_MAGIC;
+	header[1] = AI_ROUTES_VERSION;
+	header[2] = (int)checksum;
+	header[3] = nav.num_nodes;
+	header[4] = AI_ROUTES_NUMMASKS;
+
+	size = (size_t)nav.num_nodes * nav.num_nodes;
+
+	if (fseek(pOut, AI_RoutesFileOffset(filenodes), SEEK_SET) ||
+		fwrite(header, sizeof(int), 5, pOut) != 5)
+	{
+		Com_Printf("%s: failed to store routes in %s\n", __func__, filename);
+		fclose(pOut);
+		return;
+	}
+
+	for (i = 0; i < AI_ROUTES_NUMMASKS; i++)
+	{
+		if (fwrite(&routes_masks[i], sizeof(int), 1, pOut) != 1 ||
+			fwrite(routes.next[i], sizeof(unsigned short), size, pOut) != size)
+		{
+			Com_Printf("%s: failed to store routes in %s\n", __func__, filename);
+			break;
+		}
+	}
+
+	fclose(pOut);
+}
+
+//==========================================
+// AI_InitRoutes
+// load the routes of the current graph from the nav file,
+// or compute and store them. filenodes is the number of
+// nodes read from the file
+//==========================================
+void
+AI_InitRoutes(const char *mapname, int filenodes)
+{
+	unsigned int checksum;
+	clock_t routestart;
+	size_t i;
+
+	AI_ClearRoutes();
+
+	if (nav.num_nodes < 2 || nav.num_nodes > AI_ROUTES_MAXNODES)
+	{
+		return;
+	}
+
+	routestart = clock();
+	checksum = AI_RoutesChecksum();
+
+	if (AI_LoadRoutes(mapname, filenodes, checksum))
+	{
+		routes.numnodes = nav.num_nodes;
+		routes.checksum = checksum;
+
+		Com_Printf("Loaded routes in %i ms.\n",
+			(int)((clock() - routestart) * 1000 / CLOCKS_PER_SEC));
+		return;
+	}
+
+	for (i = 0; i < AI_ROUTES_NUMMASKS; i++)
+	{
+		routes.next[i] = malloc((size_t)nav.num_nodes * nav.num_nodes * sizeof(unsigned short));
+		if (!routes.next[i])
+		{
+			gi.error("%s: malloc failed\n", __func__);
+		}
+
+		AI_ComputeRoutes(routes.next[i], nav.num_nodes, routes_masks[i]);
+	}
+
+	routes.numnodes = nav.num_nodes;
+	routes.checksum = checksum;
+
+	Com_Printf("Computed routes in %i ms.\n",
+		(int)((clock() - routestart) * 1000 / CLOCKS_PER_SEC));
+
+	AI_SaveRoutes(mapname, filenodes, checksum);
+}
+
+static const unsigned short *
+AI_RoutesTable(int origin, int goal, int movetypes)
+{
+	size_t i;
+
+	if (!routes.numnodes || routes.numnodes != nav.num_nodes ||
+		origin < 0 || origin >= routes.numnodes ||
+		goal < 0 || goal >= routes.numnodes)
+	{
+		return NULL;
+	}
+
+	for (i = 0; i < AI_ROUTES_NUMMASKS; i++)
+	{
+		if (routes_masks[i] == movetypes)
+		{
+			return routes.next[i];
+		}
+	}
+
+	return NULL;
+}
+
+//==========================================
+// AI_RouteGetPath
+// fill path like AStar_GetPath does. Returns false if
+// there's no table for it, found tells if there's a path
+//==========================================
+qboolean
+AI_RouteGetPath(int origin, int goal, int movetypes, struct astarpath_s *path,
+	qboolean *found)
+{
+	const unsigned short *next;
+	int cur, count;
+
+	next = AI_RoutesTable(origin, goal, movetypes);
+	if (!next)
+	{
+		return false;
+	}
+
+	*found = false;
+
+	if (origin == goal || next[origin * routes.numnodes + goal] == AI_ROUTES_NONE)
+	{
+		return true;
+	}
+
+	// count the steps, the path is stored from the goal back
+	count = 0;
+	for (cur = origin; cur != goal; cur = next[cur * routes.numnodes + goal])
+	{
+		if (next[cur * routes.numnodes + goal] >= routes.numnodes ||
+			count >= routes.numnodes)
+		{
+			return false;	// broken table
+		}
+
+		count++;
+	}
+
+	path->numNodes = count - 1;
+	for (cur = origin; cur != goal; )
+	{
+		cur = next[cur * routes.numnodes + goal];
+		path->nodes[--count] = cur;
+	}
+
+	path->originNode = origin;
+	path->goalNode = goal;
+	*found = true;
+
+	return true;
+}
+
+//==========================================
+// AI_RouteCost
+// number of nodes on the way like AI_FindCost, -1 if there's
+// none. Returns false if there's no table for it
+//==========================================
+qboolean
+AI_RouteCost(int from, int to, int movetypes, int *cost)
+{
+	const unsigned short *next;
+	int cur, count;
+
+	next = AI_RoutesTable(from, to, movetypes);
+	if (!next)
+	{
+		return false;
+	}
+
+	*cost = -1;
+
+	if (from == to || next[from * routes.numnodes + to] == AI_ROUTES_NONE)
+	{
+		return true;
+	}
+
+	count = 0;
+	for (cur = from; cur != to; cur = next[cur * routes.numnodes + to])
+	{
+		if (next[cur * routes.numnodes + to] >= routes.numnodes ||
+			count >= routes.numnodes)
+		{
+			return false;	// broken table
+		}
+
+		count++;
+	}
+
+	*cost = count - 1;
+
+	return true;
+}
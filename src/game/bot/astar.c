@@ -31,8 +31,7 @@
 //
 //==========================================
 
-static int alist[MAX_NODES];	//list contains all studied nodes, Open and Closed together
-static int alist_nodesnum;
+static int alist_nodesnum;	//number of studied nodes, Open and Closed together
 
 typedef enum {
 	NOLIST,
@@ -45,11 +44,37 @@ typedef struct
 	int parent;
 	int g;
 	int h;
+	int order;	//when the node was studied first, breaks ties in the open list
+	int heapindex;
+	unsigned int generation;	//state is only valid for the current search
 
 	astarnodelist_e list;
 } astarnode_t;
 
 static astarnode_t	astar_nodes[MAX_NODES];
+static unsigned int	astar_generation;
+
+/* binary min heap on f, the open list */
+static int aheap[MAX_NODES];
+static int aheap_count;
+
+/* results of earlier searches, dropped when the links change */
+#define ASTAR_CACHE_SIZE 256
+
+typedef struct
+{
+	int origin;
+	int goal;
+	int movetypes;
+	unsigned int version;	//0 for unused entries
+	qboolean found;
+	int numNodes;
+	int maxNodes;
+	int *nodes;
+} astarcache_t;
+
+static astarcache_t astar_cache[ASTAR_CACHE_SIZE];
+static unsigned int astar_cacheversion = 1;
 
 //==========================================
 //
@@ -84,13 +109,27 @@ AStar_IsValidNode(int node)
 	return (node >= 0 && node < MAX_NODES);
 }
 
+/*
+ * List of a node in the current search.
+ */
+static inline astarnodelist_e
+AStar_NodeList(int node)
+{
+	if (astar_nodes[node].generation != astar_generation)
+	{
+		return NOLIST;
+	}
+
+	return astar_nodes[node].list;
+}
+
 /*
  * Check if a node is in the Closed list.
  */
 static inline qboolean
 AStar_nodeIsInClosed(int node)
 {
-	return (AStar_IsValidNode(node) && astar_nodes[node].list == CLOSEDLIST);
+	return (AStar_IsValidNode(node) && AStar_NodeList(node) == CLOSEDLIST);
 }
 
 /*
@@ -99,24 +138,151 @@ AStar_nodeIsInClosed(int node)
 static inline qboolean
 AStar_nodeIsInOpen(int node)
 {
-	return (AStar_IsValidNode(node) && astar_nodes[node].list == OPENLIST);
+	return (AStar_IsValidNode(node) && AStar_NodeList(node) == OPENLIST);
 }
 
+/*
+ * Starts a new search. Node states of older searches are
+ * recognized by their generation, so nothing is cleared
+ * here except when the counter wraps around.
+ */
 static void
 AStar_InitLists(void)
 {
-	size_t i;
+	astar_generation++;
 
-	for (i = 0; i < MAX_NODES; i++)
+	if (!astar_generation)
 	{
-		astar_nodes[i].g = 0;
-		astar_nodes[i].h = 0;
-		astar_nodes[i].parent = 0;
-		astar_nodes[i].list = NOLIST;
+		memset(astar_nodes, 0, sizeof(astar_nodes));
+		astar_generation = 1;
 	}
 
 	alist_nodesnum = 0;
-	memset(alist, -1, sizeof(alist));
+	aheap_count = 0;
+}
+
+/*
+ * Adds a node to the search, it's studied
+ * from now on.
+ */
+static void
+AStar_StudyNode(int node)
+{
+	if (astar_nodes[node].generation == astar_generation)
+	{
+		return;
+	}
+
+	astar_nodes[node].generation = astar_generation;
+	astar_nodes[node].order = alist_nodesnum;
+	astar_nodes[node].list = NOLIST;
+	alist_nodesnum++;
+}
+
+/*
+ * Heap order: lowest f first, on equal f the node
+ * studied first. That's the node a linear scan over
+ * the studied nodes would pick.
+ */
+static inline qboolean
+AStar_HeapLess(int n1, int n2)
+{
+	int f1, f2;
+
+	f1 = astar_nodes[n1].g + astar_nodes[n1].h;
+	f2 = astar_nodes[n2].g + astar_nodes[n2].h;
+
+	if (f1 != f2)
+	{
+		return f1 < f2;
+	}
+
+	return astar_nodes[n1].order < astar_nodes[n2].order;
+}
+
+static inline void
+AStar_HeapSet(int index, int node)
+{
+	aheap[index] = node;
+	astar_nodes[node].heapindex = index;
+}
+
+static void
+AStar_HeapUp(int index)
+{
+	int node = aheap[index];
+
+	while (index > 0)
+	{
+		int parent = (index - 1) / 2;
+
+		if (!AStar_HeapLess(node, aheap[parent]))
+		{
+			break;
+		}
+
+		AStar_HeapSet(index, aheap[parent]);
+		index = parent;
+	}
+
+	AStar_HeapSet(index, node);
+}
+
+static void
+AStar_HeapDown(int index)
+{
+	int node = aheap[index];
+
+	while (1)
+	{
+		int child = index * 2 + 1;
+
+		if (child >= aheap_count)
+		{
+			break;
+		}
+
+		if (child + 1 < aheap_count && AStar_HeapLess(aheap[child + 1], aheap[child]))
+		{
+			child++;
+		}
+
+		if (!AStar_HeapLess(aheap[child], node))
+		{
+			break;
+		}
+
+		AStar_HeapSet(index, aheap[child]);
+		index = child;
+	}
+
+	AStar_HeapSet(index, node);
+}
+
+static void
+AStar_HeapPush(int node)
+{
+	AStar_HeapSet(aheap_count, node);
+	aheap_count++;
+	AStar_HeapUp(aheap_count - 1);
+}
+
+static void
+AStar_HeapRemove(int node)
+{
+	int index = astar_nodes[node].heapindex;
+	int last;
+
+	aheap_count--;
+	if (index == aheap_count)
+	{
+		return;
+	}
+
+	last = aheap[aheap_count];
+	AStar_HeapSet(index, last);
+	AStar_HeapUp(index);
+	AStar_HeapDown(astar_nodes[last].heapindex);
 }
 
 static int
@@ -191,10 +357,11 @@ AStar_PutInClosed(int node)
 		return;
 	}
 
-	if (!astar_nodes[node].list)
+	AStar_StudyNode(node);
+
+	if (astar_nodes[node].list == OPENLIST)
 	{
-		alist[alist_nodesnum] = node;
-		alist_nodesnum++;
+		AStar_HeapRemove(node);
 	}
 
 	astar_nodes[node].list = CLOSEDLIST;
@@ -256,6 +423,7 @@ AStar_PutAdjacentsInOpen(int node)
 			{
 				astar_nodes[addnode].parent = node;
 				astar_nodes[addnode].g = astar_nodes[node].g + plink_dist;
+				AStar_HeapUp(astar_nodes[addnode].heapindex);
 			}
 		}
 		else
@@ -280,16 +448,13 @@ AStar_PutAdjacentsInOpen(int node)
 			}
 
 			// put in global list
-			if (!astar_nodes[addnode].list)
-			{
-				alist[alist_nodesnum] = addnode;
-				alist_nodesnum++;
-			}
+			AStar_StudyNode(addnode);
 
 			astar_nodes[addnode].parent = node;
 			astar_nodes[addnode].g = astar_nodes[node].g + plink_dist;
 			astar_nodes[addnode].h = Astar_HDist_ManhatanGuess( addnode );
 			astar_nodes[addnode].list = OPENLIST;
+			AStar_HeapPush(addnode);
 		}
 	}
 }
@@ -297,24 +462,11 @@ AStar_PutAdjacentsInOpen(int node)
 static int
 AStar_FindInOpen_BestF(void)
 {
-	size_t i;
-	int	bestF = -1;
 	int best = -1;
 
-	for (i = 0; i < alist_nodesnum; i++)
+	if (aheap_count)
 	{
-		int node = alist[i];
-
-		if (!AStar_IsValidNode(node) || astar_nodes[node].list != OPENLIST)
-		{
-			continue;
-		}
-
-		if (bestF < 0 || bestF > (astar_nodes[node].g + astar_nodes[node].h))
-		{
-			bestF = astar_nodes[node].g + astar_nodes[node].h;
-			best = node;
-		}
+		best = aheap[0];
 	}
 
 	if (bot_debugmonster->value)
@@ -397,14 +549,118 @@ AStar_ResolvePath(int origin, int goal, int movetypes, struct astarpath_s *path)
 	return true;
 }
 
+static astarcache_t *
+AStar_CacheEntry(int origin, int goal, int movetypes)
+{
+	unsigned int hash;
+
+	hash = (unsigned int)origin * 2654435761u;
+	hash ^= (unsigned int)goal * 40503u;
+	hash ^= (unsigned int)movetypes * 97u;
+
+	return &astar_cache[(hash ^ (hash >> 16)) % ASTAR_CACHE_SIZE];
+}
+
+static void
+AStar_CachePath(astarcache_t *entry, int origin, int goal, int movetypes,
+	qboolean found, const struct astarpath_s *path)
+{
+	entry->origin = origin;
+	entry->goal = goal;
+	entry->movetypes = movetypes;
+	entry->found = found;
+	entry->numNodes = 0;
+	entry->version = astar_cacheversion;
+
+	if (!found)
+	{
+		return;
+	}
+
+	/* nodes[0] to nodes[numNodes] are used */
+	if (path->numNodes + 1 > entry->maxNodes)
+	{
+		int *nodes;
+
+		nodes = realloc(entry->nodes, (path->numNodes + 1) * sizeof(int));
+		if (!nodes)
+		{
+			entry->version = 0;
+			return;
+		}
+
+		entry->nodes = nodes;
+		entry->maxNodes = path->numNodes + 1;
+	}
+
+	entry->numNodes = path->numNodes;
+	memcpy(entry->nodes, path->nodes, (path->numNodes + 1) * sizeof(int));
+}
+
+/*
+ * Forgets all cached paths and routes,
+ * must be called whenever the links change.
+ */
+void
+AStar_LinksChanged(void)
+{
+	AI_ClearRoutes();
+
+	astar_cacheversion++;
+
+	if (!astar_cacheversion)
+	{
+		size_t i;
+
+		for (i = 0; i < ASTAR_CACHE_SIZE; i++)
+		{
+			astar_cache[i].version = 0;
+		}
+
+		astar_cacheversion = 1;
+	}
+}
+
 qboolean
 AStar_GetPath(int origin, int goal, int movetypes, struct astarpath_s *path)
 {
-	if (!AStar_ResolvePath(origin, goal, movetypes, path))
+	astarcache_t *entry;
+	qboolean found;
+
+	if (origin < 0 || goal < 0)
 	{
 		return false;
 	}
 
+	if (AI_RouteGetPath(origin, goal, movetypes, path, &found))
+	{
+		return found;
+	}
+
+	entry = AStar_CacheEntry(origin, goal, movetypes);
+
+	if (entry->version == astar_cacheversion && entry->origin == origin &&
+		entry->goal == goal && entry->movetypes == movetypes)
+	{
+		if (!entry->found)
+		{
+			return false;
+		}
+
+		path->numNodes = entry->numNodes;
+		memcpy(path->nodes, entry->nodes, (entry->numNodes + 1) * sizeof(int));
+	}
+	else
+	{
+		found = AStar_ResolvePath(origin, goal, movetypes, path);
+		AStar_CachePath(entry, origin, goal, movetypes, found, path);
+
+		if (!found)
+		{
+			return false;
+		}
+	}
+
 	path->originNode = origin;
 	path->goalNode = goal;
 	return true;
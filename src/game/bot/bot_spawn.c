@@ -416,6 +416,7 @@ BOT_RemoveBot(const char *name)
 			/* don't even bother waiting for death frames */
 			bot->deadflag = DEAD_DEAD;
 			bot->inuse = false;
+			G_UpdateFindIndex(bot);
 			AI_EnemyRemoved(bot);
 			G_FreeAI(bot);
 			gi.bprintf(PRINT_MEDIUM, "%s removed\n", bot->client->pers.netname);
@@ -102,6 +102,7 @@ cvar_t *aimfix;
 cvar_t *g_machinegun_norecoil;
 cvar_t *g_quick_weap;
 cvar_t *g_swap_speed;
+cvar_t *g_checkfindradius;
 cvar_t *g_itemsbobeffect;
 cvar_t *g_start_items;
 cvar_t *ai_model_scale;
@@ -480,6 +481,9 @@ G_RunFrame(void)
 	gibsthisframe = 0;
 	debristhisframe = 0;
 
+	/* catch names set since the last frame */
+	G_SyncFindIndex();
+
 	/* choose a client for monsters to target this frame */
 	AI_SetSightClient();
 
@@ -1055,7 +1055,7 @@ static void
 G_FindTeams(void)
 {
 	edict_t *e, *e2, *chain;
-	int i, j;
+	int i;
 	int c, c2;
 
 	c = 0;
@@ -1083,18 +1083,9 @@ G_FindTeams(void)
 		c++;
 		c2++;
 
-		for (j = i + 1, e2 = e + 1; j < globals.num_edicts; j++, e2++)
+		/* G_Find() ignores case, the team names don't */
+		for (e2 = G_Find(e, FOFS(team), e->team); e2; e2 = G_Find(e2, FOFS(team), e->team))
 		{
-			if (!e2->inuse)
-			{
-				continue;
-			}
-
-			if (!e2->team)
-			{
-				continue;
-			}
-
 			if (e2->flags & FL_TEAMSLAVE)
 			{
 				continue;
@@ -1234,6 +1225,7 @@ SpawnEntities(const char *mapname, char *entities, const char *spawnpoint)
 
 	memset(&level, 0, sizeof(level));
 	memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
+	G_ClearFindIndex();
 
 	Q_strlcpy(level.mapname, mapname, sizeof(level.mapname));
 	level.is_n64 = !strncmp(level.mapname, "q64/", 4);
@@ -1339,6 +1331,7 @@ SpawnEntities(const char *mapname, char *entities, const char *spawnpoint)
 
 	gi.dprintf("%i entities inhibited.\n", inhibit);
 
+	G_SyncFindIndex();
 	G_FindTeams();
 
 	PlayerTrail_Init();
@@ -25,6 +25,8 @@
  * =======================================================================
  */
 
+#include <ctype.h>
+
 #include "header/local.h"
 
 #define MAXCHOICES 8
@@ -56,6 +58,329 @@ G_ProjectSource2(const vec3_t point, const vec3_t distance, const vec3_t forward
 				up[2] * distance[2];
 }
 
+/*
+ * Index of the entities by classname, targetname and
+ * team for G_Find(). Each name is hashed without case
+ * into a bucket, holding its entities in ascending order.
+ *
+ * The names are mostly set right after G_Spawn(), so
+ * entities initialized in the current frame are checked
+ * again on each search. All others are checked once per
+ * frame and when they're spawned or freed. Entities
+ * changing their names later on must be passed to
+ * G_UpdateFindIndex(). Entities not in use are left
+ * out, G_Find() never returns them, and the freed ones
+ * would make one large bucket.
+ *
+ * The per frame check also notes the solid entities
+ * not linked into the world, findradius() can't get
+ * them from the server.
+ */
+#define FIND_NUMFIELDS 3
+#define FIND_HASHSIZE 1024
+
+static const int find_fields[FIND_NUMFIELDS] = {
+	FOFS(classname),
+	FOFS(targetname),
+	FOFS(team)
+};
+
+typedef struct
+{
+	const char *key[FIND_NUMFIELDS];	/* name the entity is linked with */
+	int bucket[FIND_NUMFIELDS];	/* -1 if not linked */
+	int prev[FIND_NUMFIELDS];
+	int next[FIND_NUMFIELDS];
+	qboolean dirty;
+} findlink_t;
+
+static struct
+{
+	int size;
+	findlink_t *links;
+	int *dirty;
+	int numdirty;
+	int *unlinked;
+	int numunlinked;
+	int heads[FIND_NUMFIELDS][FIND_HASHSIZE];
+} findindex;
+
+static int
+G_FindHash(const char *name)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*name)
+	{
+		hash ^= (unsigned char)tolower((unsigned char)*name);
+		hash *= 16777619u;
+		name++;
+	}
+
+	return (hash ^ (hash >> 16)) & (FIND_HASHSIZE - 1);
+}
+
+static int
+G_FindField(int fieldofs)
+{
+	int i;
+
+	for (i = 0; i < FIND_NUMFIELDS; i++)
+	{
+		if (find_fields[i] == fieldofs)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Empties the index. Must be called when the
+ * entities are wiped, their names may be
+ * allocated again at the same addresses.
+ */
+void
+G_ClearFindIndex(void)
+{
+	int i, j;
+
+	if (findindex.size != game.maxentities)
+	{
+		free(findindex.links);
+		free(findindex.dirty);
+		free(findindex.unlinked);
+
+		findindex.links = malloc(game.maxentities * sizeof(findlink_t));
+		findindex.dirty = malloc(game.maxentities * sizeof(int));
+		findindex.unlinked = malloc(game.maxentities * sizeof(int));
+
+		if (!findindex.links || !findindex.dirty || !findindex.unlinked)
+		{
+			gi.error("%s: malloc failed\n", __func__);
+		}
+
+		findindex.size = game.maxentities;
+	}
+
+	for (i = 0; i < findindex.size; i++)
+	{
+		for (j = 0; j < FIND_NUMFIELDS; j++)
+		{
+			findindex.links[i].key[j] = NULL;
+			findindex.links[i].bucket[j] = -1;
+		}
+
+		findindex.links[i].dirty = false;
+	}
+
+	for (j = 0; j < FIND_NUMFIELDS; j++)
+	{
+		for (i = 0; i < FIND_HASHSIZE; i++)
+		{
+			findindex.heads[j][i] = -1;
+		}
+	}
+
+	findindex.numdirty = 0;
+	findindex.numunlinked = 0;
+}
+
+static void
+G_FindIndexUnlink(int num, int field)
+{
+	findlink_t *link = &findindex.links[num];
+
+	if (link->prev[field] >= 0)
+	{
+		findindex.links[link->prev[field]].next[field] = link->next[field];
+	}
+	else
+	{
+		findindex.heads[field][link->bucket[field]] = link->next[field];
+	}
+
+	if (link->next[field] >= 0)
+	{
+		findindex.links[link->next[field]].prev[field] = link->prev[field];
+	}
+
+	link->bucket[field] = -1;
+}
+
+static void
+G_FindIndexLink(int num, int field, int bucket)
+{
+	findlink_t *link = &findindex.links[num];
+	int prev = -1, next;
+
+	/* keep the bucket in entity order */
+	next = findindex.heads[field][bucket];
+	while (next >= 0 && next < num)
+	{
+		prev = next;
+		next = findindex.links[next].next[field];
+	}
+
+	link->bucket[field] = bucket;
+	link->prev[field] = prev;
+	link->next[field] = next;
+
+	if (prev >= 0)
+	{
+		findindex.links[prev].next[field] = num;
+	}
+	else
+	{
+		findindex.heads[field][bucket] = num;
+	}
+
+	if (next >= 0)
+	{
+		findindex.links[next].prev[field] = num;
+	}
+}
+
+static void
+G_FindIndexEdict(int num)
+{
+	const edict_t *ent = &g_edicts[num];
+	findlink_t *link = &findindex.links[num];
+	int i;
+
+	for (i = 0; i < FIND_NUMFIELDS; i++)
+	{
+		const char *s = NULL;
+
+		if (ent->inuse)
+		{
+			s = *(char **)((byte *)ent + find_fields[i]);
+		}
+
+		if (s == link->key[i])
+		{
+			continue;
+		}
+
+		if (link->bucket[i] >= 0)
+		{
+			G_FindIndexUnlink(num, i);
+		}
+
+		link->key[i] = s;
+
+		if (s)
+		{
+			G_FindIndexLink(num, i, G_FindHash(s));
+		}
+	}
+}
+
+static qboolean
+G_FindIndexReady(void)
+{
+	if (game.maxentities <= 0)
+	{
+		return false;
+	}
+
+	if (findindex.size != game.maxentities)
+	{
+		G_ClearFindIndex();
+		G_SyncFindIndex();
+	}
+
+	return findindex.size > 0;
+}
+
+/*
+ * Checks the names and links of all entities,
+ * called once per frame and after loading.
+ */
+void
+G_SyncFindIndex(void)
+{
+	int i;
+
+	if (!G_FindIndexReady())
+	{
+		return;
+	}
+
+	findindex.numunlinked = 0;
+
+	for (i = 0; i < globals.num_edicts; i++)
+	{
+		const edict_t *ent = &g_edicts[i];
+
+		G_FindIndexEdict(i);
+		findindex.links[i].dirty = false;
+
+		if (ent->inuse && (ent->solid != SOLID_NOT) && !ent->area.prev)
+		{
+			findindex.unlinked[findindex.numunlinked++] = i;
+		}
+	}
+
+	for (i = 0; i < findindex.numdirty; i++)
+	{
+		findindex.links[findindex.dirty[i]].dirty = false;
+	}
+
+	findindex.numdirty = 0;
+}
+
+/*
+ * Must be called after the classname, targetname
+ * or team of an entity was changed, or after it was
+ * taken in or out of use without G_InitEdict() and
+ * G_FreeEdict(), unless it was initialized in the
+ * same frame.
+ */
+void
+G_UpdateFindIndex(edict_t *ent)
+{
+	int num;
+
+	if (!ent || !G_FindIndexReady())
+	{
+		return;
+	}
+
+	num = ent - g_edicts;
+
+	if (num >= 0 && num < findindex.size)
+	{
+		G_FindIndexEdict(num);
+	}
+}
+
+/*
+ * Entity was initialized, its names are checked
+ * on every search until the next frame.
+ */
+static void
+G_FindIndexDirty(edict_t *ent)
+{
+	int num;
+
+	if (!G_FindIndexReady())
+	{
+		return;
+	}
+
+	num = ent - g_edicts;
+
+	if (num < 0 || num >= findindex.size || findindex.links[num].dirty)
+	{
+		return;
+	}
+
+	findindex.links[num].dirty = true;
+	findindex.dirty[findindex.numdirty++] = num;
+}
+
 /*
  * Searches all active entities for the next
  * one that holds the matching string at fieldofs
@@ -69,12 +394,64 @@ edict_t *
 G_Find(edict_t *from, int fieldofs, const char *match)
 {
 	const char *s;
+	int field;
 
 	if (!match)
 	{
 		return NULL;
 	}
 
+	field = G_FindField(fieldofs);
+
+	if (field >= 0 && G_FindIndexReady())
+	{
+		int i, bucket, num, start;
+
+		for (i = 0; i < findindex.numdirty; i++)
+		{
+			G_FindIndexEdict(findindex.dirty[i]);
+		}
+
+		bucket = G_FindHash(match);
+		start = from ? (from - g_edicts) + 1 : 0;
+
+		if (from && start - 1 < findindex.size &&
+			findindex.links[start - 1].bucket[field] == bucket)
+		{
+			/* usually from is the last match */
+			num = findindex.links[start - 1].next[field];
+		}
+		else
+		{
+			num = findindex.heads[field][bucket];
+
+			while (num >= 0 && num < start)
+			{
+				num = findindex.links[num].next[field];
+			}
+		}
+
+		for ( ; num >= 0 && num < globals.num_edicts;
+			num = findindex.links[num].next[field])
+		{
+			from = &g_edicts[num];
+
+			if (!from->inuse)
+			{
+				continue;
+			}
+
+			s = *(char **)((byte *)from + fieldofs);
+
+			if (s && !Q_stricmp(s, match))
+			{
+				return from;
+			}
+		}
+
+		return NULL;
+	}
+
 	if (!from)
 	{
 		from = g_edicts;
@@ -107,16 +484,34 @@ G_Find(edict_t *from, int fieldofs, const char *match)
 	return NULL;
 }
 
-/*
- * Returns entities that have origins
- * within a spherical area
- */
-edict_t *
-findradius(edict_t *from, const vec3_t org, float rad)
+static qboolean
+G_InRadius(const edict_t *ent, const vec3_t org, float rad)
 {
 	vec3_t eorg;
 	int j;
 
+	if (!ent->inuse)
+	{
+		return false;
+	}
+
+	if (ent->solid == SOLID_NOT)
+	{
+		return false;
+	}
+
+	for (j = 0; j < 3; j++)
+	{
+		eorg[j] = org[j] - (ent->s.origin[j] +
+				   (ent->mins[j] + ent->maxs[j]) * 0.5);
+	}
+
+	return VectorLengthSquared(eorg) <= rad * rad;
+}
+
+static edict_t *
+G_FindRadiusLinear(edict_t *from, const vec3_t org, float rad)
+{
 	if (!from)
 	{
 		from = g_edicts;
@@ -128,31 +523,174 @@ findradius(edict_t *from, const vec3_t org, float rad)
 
 	for ( ; from < &g_edicts[globals.num_edicts]; from++)
 	{
-		if (!from->inuse)
+		if (G_InRadius(from, org, rad))
 		{
-			continue;
+			return from;
 		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Entities of the last sphere findradius() asked the
+ * server for. Callers walk a sphere with repeated calls,
+ * the list is used for all of them until an entity is
+ * linked or unlinked.
+ */
+static struct
+{
+	qboolean valid;
+	vec3_t org;
+	float rad;
+	int framenum;
+	int linkcount;
+	int count;
+	int last;	/* index of the last entity returned */
+	qboolean linear;	/* holds too many entities */
+	edict_t *list[MAX_EDICTS];
+} radiuslist;
 
-		if (from->solid == SOLID_NOT)
+/*
+ * Asks the server for the entities around org. Entities
+ * never linked into the world are taken from the lists
+ * kept for G_Find(): the unlinked ones of the last check
+ * and the ones initialized since.
+ */
+static edict_t *
+G_FindRadiusArea(edict_t *from, const vec3_t org, float rad)
+{
+	edict_t *best = NULL;
+	int i, lo, hi, start, maxcount;
+
+	if (!G_FindIndexReady())
+	{
+		return G_FindRadiusLinear(from, org, rad);
+	}
+
+	if (!radiuslist.valid || (radiuslist.rad != rad) ||
+		!VectorCompare(radiuslist.org, org) ||
+		(radiuslist.framenum != level.framenum) ||
+		(radiuslist.linkcount != gi.LinkCount()))
+	{
+		/* once a good part of all entities is in the sphere,
+		   walking all of them is cheaper than the area */
+		maxcount = globals.num_edicts / 4 + 1;
+
+		radiuslist.count = gi.SphereEdicts(org, rad, radiuslist.list,
+				maxcount, AREA_SOLID | AREA_TRIGGERS);
+		radiuslist.linear = radiuslist.count == maxcount;
+		radiuslist.valid = true;
+
+		VectorCopy(org, radiuslist.org);
+		radiuslist.rad = rad;
+		radiuslist.framenum = level.framenum;
+		radiuslist.linkcount = gi.LinkCount();
+		radiuslist.last = -1;
+	}
+
+	if (radiuslist.linear)
+	{
+		return G_FindRadiusLinear(from, org, rad);
+	}
+
+	start = from ? (from - g_edicts) + 1 : 0;
+
+	/* the list is ordered, skip to start */
+	lo = 0;
+	hi = radiuslist.count;
+
+	if (from && (radiuslist.last >= 0) &&
+		(radiuslist.list[radiuslist.last] == from))
+	{
+		/* usually from is the last match */
+		lo = radiuslist.last + 1;
+	}
+
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+
+		if (radiuslist.list[mid] - g_edicts < start)
 		{
-			continue;
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
 		}
+	}
 
-		for (j = 0; j < 3; j++)
+	/* the first match is the next one */
+	for (i = lo; i < radiuslist.count; i++)
+	{
+		edict_t *ent = radiuslist.list[i];
+
+		if ((ent - g_edicts < globals.num_edicts) &&
+			G_InRadius(ent, org, rad))
 		{
-			eorg[j] = org[j] - (from->s.origin[j] +
-					   (from->mins[j] + from->maxs[j]) * 0.5);
+			best = ent;
+			radiuslist.last = i;
+			break;
 		}
+	}
+
+	/* the world is never linked */
+	if ((start == 0) && G_InRadius(g_edicts, org, rad))
+	{
+		return g_edicts;
+	}
 
-		if (VectorLengthSquared(eorg) > rad * rad)
+	for (i = 0; i < findindex.numunlinked + findindex.numdirty; i++)
+	{
+		int num;
+
+		num = (i < findindex.numunlinked) ? findindex.unlinked[i] :
+			findindex.dirty[i - findindex.numunlinked];
+
+		if ((num < start) || (num >= globals.num_edicts) ||
+			(best && (num >= best - g_edicts)))
 		{
 			continue;
 		}
 
-		return from;
+		if (G_InRadius(&g_edicts[num], org, rad))
+		{
+			best = &g_edicts[num];
+		}
 	}
 
-	return NULL;
+	return best;
+}
+
+/*
+ * Returns entities that have origins
+ * within a spherical area
+ */
+edict_t *
+findradius(edict_t *from, const vec3_t org, float rad)
+{
+	edict_t *ent, *check;
+
+	ent = G_FindRadiusArea(from, org, rad);
+
+	if (!g_checkfindradius || !g_checkfindradius->value)
+	{
+		return ent;
+	}
+
+	check = G_FindRadiusLinear(from, org, rad);
+
+	if (ent != check)
+	{
+		gi.dprintf("%s: got %d (%s) instead of %d (%s) at %s radius %.0f\n",
+			__func__, ent ? (int)(ent - g_edicts) : -1,
+			ent ? ent->classname : "none",
+			check ? (int)(check - g_edicts) : -1,
+			check ? check->classname : "none", vtos(org), rad);
+	}
+
+	return check;
 }
 
 /*
@@ -661,6 +1199,8 @@ G_InitEdict(edict_t *e)
 	e->gravityVector[2] = -1.0;
 
 	VectorSet(e->rrs.scale, 1.0, 1.0, 1.0);
+
+	G_FindIndexDirty(e);
 }
 
 /*
@@ -761,6 +1301,8 @@ G_FreeEdict(edict_t *ed)
 	ed->classname = "freed";
 	ed->freetime = level.time;
 	ed->inuse = false;
+
+	G_UpdateFindIndex(ed);
 }
 
 void
@@ -36,7 +36,8 @@
  */
 
 #define GAME_API_R97_VERSION 3
-#define GAME_API_VERSION 4
+#define GAME_API_V4_VERSION 4 /* without SphereEdicts and LinkCount */
+#define GAME_API_VERSION 5
 
 /* edict->svflags */
 #define SVF_NOCLIENT 0x00000001             /* don't send entity to clients, even if it has effects */
@@ -221,6 +222,18 @@ typedef struct
 
 	const char* (*LocalizationMessage)(const char *message, int *sound_index);
 	const char* (*LocalizationUIMessage)(const char *message, const char *default_message);
+
+	/* like BoxEdicts, but for the edicts touching a sphere,
+	   ordered by edict number. areatypes may combine AREA_SOLID
+	   and AREA_TRIGGERS. Solid edicts unlinked since the last
+	   frame are included. maxcount is returned if list is full
+	   or the sphere covers a large part of the world. */
+	int (*SphereEdicts)(const vec3_t origin, float radius, edict_t **list,
+			int maxcount, int areatypes);
+
+	/* changes whenever an edict is linked or unlinked, a list
+	   from SphereEdicts is current while it stays the same */
+	int (*LinkCount)(void);
 } game_import_t;
 
 /* functions exported by the game subsystem */
@@ -776,6 +776,7 @@ extern cvar_t *aimfix;
 extern cvar_t *g_machinegun_norecoil;
 extern cvar_t *g_quick_weap;
 extern cvar_t *g_swap_speed;
+extern cvar_t *g_checkfindradius;
 extern cvar_t *g_itemsbobeffect;
 extern cvar_t *g_start_items;
 extern cvar_t *ai_model_scale;
@@ -885,6 +886,9 @@ qboolean KillBox(edict_t *ent);
 void G_ProjectSource(const vec3_t point, const vec3_t distance, const vec3_t forward,
 		const vec3_t right, vec3_t result);
 edict_t *G_Find(edict_t *from, int fieldofs, const char *match);
+void G_ClearFindIndex(void);
+void G_SyncFindIndex(void);
+void G_UpdateFindIndex(edict_t *ent);
 edict_t *findradius(edict_t *from, const vec3_t org, float rad);
 edict_t *G_PickTarget(const char *targetname);
 void G_UseTargets(edict_t *ent, edict_t *activator);
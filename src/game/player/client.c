@@ -91,6 +91,7 @@ SP_FixCoopSpots(edict_t *self)
 			if ((!self->targetname) || (Q_stricmp(self->targetname, spot->targetname) != 0))
 			{
 				self->targetname = spot->targetname;
+				G_UpdateFindIndex(self);
 			}
 
 			return;
@@ -2527,6 +2528,7 @@ PutClientInServer(edict_t *ent)
 	ent->svflags &= ~SVF_NOCLIENT;
 	/* Turn off prediction */
 	ent->client->ps.pmove.pm_flags &= ~PMF_NO_PREDICTION;
+	G_UpdateFindIndex(ent);
 
 	VectorCopy(mins, ent->mins);
 	VectorCopy(maxs, ent->maxs);
@@ -3086,6 +3088,7 @@ ClientDisconnect(edict_t *ent)
 	ent->inuse = false;
 	ent->classname = "disconnected";
 	ent->client->pers.connected = false;
+	G_UpdateFindIndex(ent);
 
 	playernum = ent - g_edicts - 1;
 	gi.configstring(CS_PLAYERSKINS + playernum, "");
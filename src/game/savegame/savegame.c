@@ -385,6 +385,7 @@ InitGame(void)
 	sv_gravity = gi.cvar("sv_gravity", "800", 0);
 	sv_stopspeed = gi.cvar("sv_stopspeed", "100", 0);
 	g_showlogic = gi.cvar("g_showlogic", "0", 0);
+	g_checkfindradius = gi.cvar("g_checkfindradius", "0", 0);
 	huntercam = gi.cvar("huntercam", "1", CVAR_SERVERINFO|CVAR_LATCH);
 	strong_mines = gi.cvar("strong_mines", "0", 0);
 	randomrespawn = gi.cvar("randomrespawn", "0", 0);
@@ -1476,6 +1477,7 @@ ReadLevel(const char *filename)
 	/* wipe all the entities */
 	memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
 	globals.num_edicts = maxclients->value + 1;
+	G_ClearFindIndex();
 
 	/* check edict size */
 	sg_fread(&i, sizeof(i), f);
@@ -1540,6 +1542,8 @@ ReadLevel(const char *filename)
 		ent->client->pers.connected = false;
 	}
 
+	G_SyncFindIndex();
+
 	/* do any load time things at this point */
 	for (i = 0; i < globals.num_edicts; i++)
 	{
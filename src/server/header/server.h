@@ -53,6 +53,8 @@
 #define CL_EDICT(cl) EDICT_NUM(1 + ((cl) - svs.clients))
 #define CLNUM_EDICT(i) EDICT_NUM(i + 1)
 #define NUM_FOR_EDICT(e) (((byte *)(e) - (byte *)ge->edicts) / ge->edict_size)
+/* scratch space of SV_CollectClientEntities() */
+#define SV_ENTMARKS_SIZE (((ge->max_edicts + 7) >> 3) * 2)
 
 typedef enum
 {
@@ -112,6 +114,17 @@ typedef struct
 	int senttime;                           /* for ping calculations */
 } client_frame_t;
 
+/* What a client sees, used to build its frames */
+typedef struct
+{
+	vec3_t org;
+	int clientarea;
+	const byte *fatpvs;
+	size_t fatpvs_size;
+	const byte *clientphs;
+	size_t phs_size;
+} client_view_t;
+
 typedef struct client_s
 {
 	client_state_t state;
@@ -214,11 +227,15 @@ extern cvar_t *sv_airaccelerate;            /* don't reload level state when ree
 extern cvar_t *sv_enforcetime;
 extern cvar_t *sv_downloadserver;			/* Download server. */
 extern cvar_t *sv_language;			/* Localization. */
+extern cvar_t *sv_areatree;
+extern cvar_t *sv_areastats;
 
 extern client_t *sv_client;
 extern edict_t *sv_player;
 
 void SV_DropClient(client_t *drop);
+void SV_ClientHashChanged(void);
+void SV_FreeClientHash(void);
 
 int SV_ModelIndex(const char *name);
 int SV_SoundIndex(const char *name);
@@ -229,6 +246,7 @@ void SV_WriteClientdataToMessage(client_t *client, sizebuf_t *msg);
 
 void SV_ExecuteUserCommand(char *s);
 void SV_InitOperatorCommands(void);
+void SV_TickStats_f(void);
 
 void SV_SendServerinfo(client_t *client);
 void SV_UserinfoChanged(client_t *cl);
@@ -269,8 +287,27 @@ char *SV_StatusString(void);
 void SV_ConnectionlessPacket(void);
 
 void SV_WriteFrameToClient(client_t *client, sizebuf_t *msg);
+client_frame_t *SV_ClientDeltaFrame(client_t *client, int *lastframe);
 void SV_RecordDemoMessage(void);
 void SV_BuildClientFrame(client_t *client);
+qboolean SV_BuildClientView(client_t *client, client_view_t *view);
+void SV_FixEntityNumbers(void);
+void SV_BuildEntityIndex(void);
+void SV_InvalidateEntityIndex(void);
+void SV_FreeEntityIndex(void);
+void SV_ClearFatPVSCache(void);
+int SV_CollectClientEntities(const client_t *client, const client_view_t *view,
+		int *list, byte *marks);
+void SV_StoreClientEntities(client_t *client, const int *list, int count,
+		int first);
+
+/* sv_workers.c */
+typedef void (*sv_job_t)(int item, void *data);
+
+void SV_WorkersInit(void);
+void SV_WorkersShutdown(void);
+int SV_NumWorkers(void);
+void SV_WorkersRun(sv_job_t job, void *data, int count);
 
 extern game_export_t *ge;
 
@@ -290,6 +327,10 @@ void SV_Savegame_f(void);
 
 /* high level object sorting to reduce interaction tests */
 void SV_ClearWorld(void);
+void SV_ClearUnlinkedEdicts(void);
+int SV_LinkCount(void);
+void SV_FreeAreaTree(void);
+void SV_AreaStats(void);
 
 /* called after the world model has been loaded, before linking any entities */
 void SV_UnlinkEdict(edict_t *ent);
@@ -305,6 +346,15 @@ void SV_LinkEdict(edict_t *ent);
 int SV_AreaEdicts(const vec3_t mins, const vec3_t maxs, edict_t **list,
 		int maxcount, int areatype);
 
+int SV_SphereEdicts(const vec3_t origin, float radius, edict_t **list,
+		int maxcount, int areatypes);
+
+/* visits the edicts touching the box until false is returned */
+typedef qboolean (*sv_areavisit_t)(edict_t *ent, void *data);
+
+void SV_AreaEdictsVisit(const vec3_t mins, const vec3_t maxs, int areatype,
+		sv_areavisit_t visit, void *data);
+
 int SV_PointContents(const vec3_t p);
 
 trace_t SV_Trace(const vec3_t start, const vec3_t mins, const vec3_t maxs,
@@ -698,6 +698,107 @@ SV_ServerCommand_f(void)
 	ge->ServerCommand();
 }
 
+/*
+ * Sends connectionless packets from the client socket to
+ * our own server port and times how fast they are read
+ * back. Meant to compare the receive paths (net_mmsg).
+ * It reads the live server socket, so it refuses to run
+ * while clients are connected.
+ */
+static void
+SV_FloodTest_f(void)
+{
+	static byte data[256];
+	int count, sent, received, chunk, i;
+	long long start, usec;
+	netadr_t adr;
+	sizebuf_t msg;
+	byte msgbuf[MAX_MSGLEN];
+
+	if (Cmd_Argc() != 2)
+	{
+		Com_Printf("usage: floodtest <packets>\n");
+		return;
+	}
+
+	count = (int)strtol(Cmd_Argv(1), NULL, 10);
+
+	if (count <= 0)
+	{
+		return;
+	}
+
+	if (svs.clients)
+	{
+		client_t *cl;
+
+		for (i = 0, cl = svs.clients; i < maxclients->value; i++, cl++)
+		{
+			if (cl->state >= cs_connected)
+			{
+				Com_Printf("%s: Not possible with clients connected.\n",
+						__func__);
+				return;
+			}
+		}
+	}
+
+	if (!NET_StringToAdr("127.0.0.1", &adr))
+	{
+		Com_Printf("%s: Couldn't resolve the loopback address\n", __func__);
+		return;
+	}
+
+	adr.port = BigShort((short)Cvar_VariableValue("port"));
+
+	/* connectionless header, nothing answers to it */
+	memset(data, 0, sizeof(data));
+	*(int *)data = -1;
+	Q_strlcpy((char *)data + 4, "floodtest", sizeof(data) - 4);
+
+	SZ_Init(&msg, msgbuf, sizeof(msgbuf));
+
+	sent = 0;
+	received = 0;
+	usec = 0;
+
+	/* small chunks, the socket buffer must not overflow */
+	while (sent < count)
+	{
+		chunk = Q_min(64, count - sent);
+
+		for (i = 0; i < chunk; i++)
+		{
+			NET_SendPacket(NS_CLIENT, sizeof(data), data, adr);
+		}
+
+		sent += chunk;
+
+		/* give the packets time to arrive */
+		NET_Sleep(1);
+
+		start = Sys_Microseconds();
+
+		for (i = 0; i < chunk; i++)
+		{
+			netadr_t from;
+
+			if (!NET_GetPacket(NS_SERVER, &from, &msg))
+			{
+				break;
+			}
+
+			received++;
+		}
+
+		usec += Sys_Microseconds() - start;
+	}
+
+	Com_Printf("floodtest: %i of %i packets read in %.3f ms, %.0f packets/s\n",
+			received, sent, usec / 1000.0,
+			usec ? (received * 1000000.0 / usec) : 0.0);
+}
+
 static void
 SV_Gamemode_f(void)
 {
@@ -800,6 +901,8 @@ SV_InitOperatorCommands(void)
 	Cmd_AddCommand("load", SV_Loadgame_f);
 
 	Cmd_AddCommand("killserver", SV_KillServer_f);
+	Cmd_AddCommand("floodtest", SV_FloodTest_f);
+	Cmd_AddCommand("sv_tickstats", SV_TickStats_f);
 
 	Cmd_AddCommand("sv", SV_ServerCommand_f);
 }
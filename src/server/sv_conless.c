@@ -309,6 +309,7 @@ gotnewcl:
 	}
 
 	Netchan_Setup(NS_SERVER, &newcl->netchan, adr, qport);
+	SV_ClientHashChanged();
 
 	newcl->state = cs_connected;
 
@@ -432,6 +433,10 @@ SV_ConnectionlessPacket(void)
 	{
 		SVC_RemoteCommand();
 	}
+	else if (!strcmp(c, "floodtest"))
+	{
+		/* left over from the floodtest command */
+	}
 	else
 	{
 		Com_Printf("bad connectionless packet from %s:\n%s\n",
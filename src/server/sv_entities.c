@@ -448,34 +448,42 @@ SV_WritePlayerstateToClient(client_frame_t *from, client_frame_t *to,
 	}
 }
 
-void
-SV_WriteFrameToClient(client_t *client, sizebuf_t *msg)
+/*
+ * Returns the frame the client's next frame is delta'd
+ * from or NULL, if everything has to be sent.
+ */
+client_frame_t *
+SV_ClientDeltaFrame(client_t *client, int *lastframe)
 {
-	client_frame_t *frame, *oldframe;
-	int lastframe;
-
-	/* this is the frame we are creating */
-	frame = &client->frames[sv.framenum & UPDATE_MASK];
-
 	if (client->lastframe <= 0)
 	{
 		/* client is asking for a retransmit */
-		oldframe = NULL;
-		lastframe = -1;
+		*lastframe = -1;
+		return NULL;
 	}
 	else if (sv.framenum - client->lastframe >= (UPDATE_BACKUP - 3))
 	{
 		/* client hasn't gotten a good message through in a long time */
-		oldframe = NULL;
-		lastframe = -1;
-	}
-	else
-	{
-		/* we have a valid message to delta from */
-		oldframe = &client->frames[client->lastframe & UPDATE_MASK];
-		lastframe = client->lastframe;
+		*lastframe = -1;
+		return NULL;
 	}
 
+	/* we have a valid message to delta from */
+	*lastframe = client->lastframe;
+	return &client->frames[client->lastframe & UPDATE_MASK];
+}
+
+void
+SV_WriteFrameToClient(client_t *client, sizebuf_t *msg)
+{
+	client_frame_t *frame, *oldframe;
+	int lastframe;
+
+	/* this is the frame we are creating */
+	frame = &client->frames[sv.framenum & UPDATE_MASK];
+
+	oldframe = SV_ClientDeltaFrame(client, &lastframe);
+
 	MSG_WriteByte(msg, svc_frame);
 	MSG_WriteLong(msg, sv.framenum);
 	MSG_WriteLong(msg, lastframe); /* what we are delta'ing from */
@@ -493,21 +501,107 @@ SV_WriteFrameToClient(client_t *client, sizebuf_t *msg)
 	SV_EmitPacketEntities(oldframe, frame, msg, client->protocol);
 }
 
+/*
+ * Recently built fat PVS, keyed by the sorted set of
+ * clusters they were built from. Clients standing still
+ * or close to each other share the same entry.
+ */
+#define FATPVS_CACHE_SIZE 32
+#define FATPVS_MAX_LEAFS 64
+
+typedef struct
+{
+	int numclusters;
+	int clusters[FATPVS_MAX_LEAFS];
+	unsigned lastused;
+	size_t size;
+	byte *bits;
+} fatpvs_t;
+
+static fatpvs_t fatpvs_cache[FATPVS_CACHE_SIZE];
+static unsigned fatpvs_clock;
+static size_t fatpvs_rowsize;
+
+void
+SV_ClearFatPVSCache(void)
+{
+	int i;
+
+	for (i = 0; i < FATPVS_CACHE_SIZE; i++)
+	{
+		free(fatpvs_cache[i].bits);
+	}
+
+	memset(fatpvs_cache, 0, sizeof(fatpvs_cache));
+	fatpvs_rowsize = 0;
+}
+
+/*
+ * Returns the cache entry for the clusters, the least
+ * recently used one is filled in if there's none.
+ */
+static fatpvs_t *
+SV_FatPVSEntry(const int *clusters, int numclusters, size_t rowsize,
+	qboolean *hit)
+{
+	fatpvs_t *entry, *lru;
+	int i;
+
+	/* rows have a new size after a map change */
+	if (rowsize != fatpvs_rowsize)
+	{
+		SV_ClearFatPVSCache();
+		fatpvs_rowsize = rowsize;
+	}
+
+	lru = &fatpvs_cache[0];
+
+	for (i = 0; i < FATPVS_CACHE_SIZE; i++)
+	{
+		entry = &fatpvs_cache[i];
+
+		if (entry->bits && (entry->numclusters == numclusters) &&
+			!memcmp(entry->clusters, clusters, numclusters * sizeof(int)))
+		{
+			entry->lastused = ++fatpvs_clock;
+			*hit = true;
+			return entry;
+		}
+
+		if (entry->lastused < lru->lastused)
+		{
+			lru = entry;
+		}
+	}
+
+	if (!lru->bits)
+	{
+		/* rows are a multiple of 8 bytes */
+		lru->bits = malloc(rowsize);
+		YQ2_COM_CHECK_OOM(lru->bits, "malloc()", rowsize)
+	}
+
+	lru->numclusters = 0;
+	lru->lastused = ++fatpvs_clock;
+	*hit = false;
+
+	return lru;
+}
+
 /*
  * The client will interpolate the view position,
  * so we can't use a single PVS point
  */
-static byte *
+static const byte *
 SV_FatPVS(vec3_t org, size_t *fatpvs_size)
 {
-	size_t pvs_size;
-	const byte *src, *pvs_buf;
-	// DG: used to be called "longs" and long was used which isn't really correct on 64bit
-	int32_t numInt32s;
+	int leafs[FATPVS_MAX_LEAFS], clusters[FATPVS_MAX_LEAFS];
+	int i, j, count, numclusters;
+	size_t pvs_size, numWords;
+	const byte *pvs_buf;
 	vec3_t mins, maxs;
-	int i, j, count;
-	int leafs[64];
-	byte *fatpvs;
+	fatpvs_t *entry;
+	qboolean hit;
 
 	for (i = 0; i < 3; i++)
 	{
@@ -515,85 +609,97 @@ SV_FatPVS(vec3_t org, size_t *fatpvs_size)
 		maxs[i] = org[i] + 8;
 	}
 
-	count = CM_BoxLeafnums(mins, maxs, leafs, 64, NULL);
-
-	fatpvs = CM_ClusterPTS(fatpvs_size);
+	count = CM_BoxLeafnums(mins, maxs, leafs, FATPVS_MAX_LEAFS, NULL);
 
 	if (count < 1)
 	{
 		Com_Error(ERR_FATAL, "%s: count < 1", __func__);
-		return fatpvs;
+		return NULL;
 	}
 
-	numInt32s = (CM_NumClusters() + 31) >> 5;
+	/* convert leafs to a sorted set of clusters */
+	numclusters = 0;
 
-	/* convert leafs to clusters */
 	for (i = 0; i < count; i++)
 	{
-		leafs[i] = CM_LeafCluster(leafs[i]);
-	}
+		int cluster;
 
-	*fatpvs_size = Q_min(numInt32s << 2, *fatpvs_size);
-	pvs_buf = CM_ClusterPVS(leafs[0], &pvs_size);
-	pvs_size = Q_min(pvs_size, *fatpvs_size);
-	memcpy(fatpvs, pvs_buf, pvs_size);
+		cluster = CM_LeafCluster(leafs[i]);
 
-	/* or in all the other leaf bits */
-	for (i = 1; i < count; i++)
-	{
-		size_t src_size;
-
-		for (j = 0; j < i; j++)
+		for (j = numclusters; j > 0 && clusters[j - 1] > cluster; j--)
 		{
-			if (leafs[i] == leafs[j])
-			{
-				break;
-			}
+			clusters[j] = clusters[j - 1];
 		}
 
-		if (j != i)
+		if (j > 0 && clusters[j - 1] == cluster)
 		{
-			continue; /* already have the cluster we want */
+			/* already have the cluster we want */
+			memmove(clusters + j, clusters + j + 1,
+				(numclusters - j) * sizeof(int));
+			continue;
 		}
 
-		src = CM_ClusterPVS(leafs[i], &src_size);
+		clusters[j] = cluster;
+		numclusters++;
+	}
+
+	pvs_buf = CM_ClusterPVS(clusters[0], &pvs_size);
+
+	entry = SV_FatPVSEntry(clusters, numclusters, pvs_size, &hit);
+
+	if (hit)
+	{
+		*fatpvs_size = entry->size;
+		return entry->bits;
+	}
 
-		src_size = Q_min(src_size, pvs_size);
+	entry->size = Q_min(((CM_NumClusters() + 31) >> 5) << 2, pvs_size);
+	memcpy(entry->bits, pvs_buf, pvs_size);
 
-		for (j = 0; j < Q_min(numInt32s, src_size / 4); j++)
+	/* or in all the other cluster bits, rows are
+	   8 byte aligned and a multiple of 8 bytes */
+	numWords = (entry->size + 7) >> 3;
+
+	for (i = 1; i < numclusters; i++)
+	{
+		const uint64_t *src;
+		uint64_t *dst;
+
+		src = (const uint64_t *)CM_ClusterPVS(clusters[i], &pvs_size);
+		dst = (uint64_t *)entry->bits;
+
+		for (j = 0; j < numWords; j++)
 		{
-			((int32_t *)fatpvs)[j] |= ((int32_t *)src)[j];
+			dst[j] |= src[j];
 		}
 	}
 
-	return fatpvs;
+	memcpy(entry->clusters, clusters, numclusters * sizeof(int));
+	entry->numclusters = numclusters;
+
+	*fatpvs_size = entry->size;
+	return entry->bits;
 }
 
 /*
- * Decides which entities are going to be visible to the client, and
- * copies off the playerstat and areabits.
+ * Sets up the frame we are creating and finds out what the
+ * client sees. The PVS and PHS of the view point into buffers
+ * of the collision code, valid until the next call.
  */
-void
-SV_BuildClientFrame(client_t *client)
+qboolean
+SV_BuildClientView(client_t *client, client_view_t *view)
 {
-	int e, i;
-	vec3_t org;
-	edict_t *ent;
 	edict_t *clent;
 	client_frame_t *frame;
-	int l;
-	int clientarea, clientcluster;
+	int i;
+	int clientcluster;
 	int leafnum;
-	const byte *clientphs;
-	const byte *bitvector, *fatpvs;
-	size_t phs_size;
-	size_t fatpvs_size;
 
 	clent = CL_EDICT(client);
 
 	if (!clent->client)
 	{
-		return; /* not in game yet */
+		return false; /* not in game yet */
 	}
 
 	/* this is the frame we are creating */
@@ -606,7 +712,7 @@ SV_BuildClientFrame(client_t *client)
 		/* find the client's PVS */
 		for (i = 0; i < 3; i++)
 		{
-			org[i] = clent->client->ps.pmove.origin[i] * 0.125 +
+			view->org[i] = clent->client->ps.pmove.origin[i] * 0.125 +
 					 clent->client->ps.viewoffset[i];
 		}
 		/* store origin in 28.3 format */
@@ -617,142 +723,559 @@ SV_BuildClientFrame(client_t *client)
 		/* find the client's PVS */
 		for (i = 0; i < 3; i++)
 		{
-			org[i] = clent->s.origin[i] +
+			view->org[i] = clent->s.origin[i] +
 					 clent->client->ps.viewoffset[i];
 			/* store origin in 28.3 format */
 			frame->origin[i] = clent->s.origin[i] * 8;
 		}
 	}
 
-	leafnum = CM_PointLeafnum(org);
-	clientarea = CM_LeafArea(leafnum);
+	leafnum = CM_PointLeafnum(view->org);
+	view->clientarea = CM_LeafArea(leafnum);
 	clientcluster = CM_LeafCluster(leafnum);
 
 	/* calculate the visible areas */
-	frame->areabytes = CM_WriteAreaBits(frame->areabits, clientarea);
+	frame->areabytes = CM_WriteAreaBits(frame->areabits, view->clientarea);
 
 	/* grab the current player_state_t */
 	frame->ps = clent->client->ps;
 
-	fatpvs = SV_FatPVS(org, &fatpvs_size);
-	clientphs = CM_ClusterPHS(clientcluster, &phs_size);
+	view->fatpvs = SV_FatPVS(view->org, &view->fatpvs_size);
+	view->clientphs = CM_ClusterPHS(clientcluster, &view->phs_size);
+
+	return true;
+}
+
+/*
+ * Returns true if the entity is sent to clients
+ * that can see it.
+ */
+static qboolean
+SV_EntityIsSent(const edict_t *ent)
+{
+	/* ignore ents without visible models */
+	if (ent->svflags & SVF_NOCLIENT)
+	{
+		return false;
+	}
+
+	/* ignore ents without visible models unless they have an effect */
+	if (!ent->s.modelindex && !ent->s.effects &&
+		!ent->s.sound && !ent->s.event &&
+		!(ent->s.renderfx & RF_CASTSHADOW))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Returns true if the entity is sent to the client
+ * with the given view. With inpvs set, the entity is
+ * known to touch a cluster of the view's fat PVS.
+ * Doesn't modify anything.
+ */
+static qboolean
+SV_EntityVisible(const client_view_t *view, const edict_t *clent,
+	const edict_t *ent, qboolean inpvs)
+{
+	const byte *bitvector;
+	int i, l;
+
+	if (!SV_EntityIsSent(ent))
+	{
+		return false;
+	}
+
+	/* ignore if not touching a PV leaf */
+	if (ent == clent)
+	{
+		return true;
+	}
+
+	/* check area */
+	if (!CM_AreasConnected(view->clientarea, ent->areanum))
+	{
+		/* doors can legally straddle two areas,
+		   so we may need to check another one */
+		if (!ent->areanum2 ||
+			!CM_AreasConnected(view->clientarea, ent->areanum2))
+		{
+			return false; /* blocked by a door */
+		}
+	}
+
+	/* beams just check one point for PHS */
+	if (ent->s.renderfx & RF_BEAM || (ent->s.renderfx & RF_CASTSHADOW))
+	{
+		l = ent->clusternums[0];
+
+		if (((l >> 3) >= view->phs_size) ||
+			!(view->clientphs[l >> 3] & (1 << (l & 7))))
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+	bitvector = view->fatpvs;
+
+	if (inpvs)
+	{
+		/* already checked by the caller */
+	}
+	else if (ent->num_clusters == -1)
+	{
+		/* too many leafs for individual check, go by headnode */
+		if (!CM_HeadnodeVisible(ent->headnode, bitvector))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		/* check individual leafs */
+		for (i = 0; i < ent->num_clusters; i++)
+		{
+			l = ent->clusternums[i];
+
+			if (((l >> 3) < view->fatpvs_size) && bitvector[l >> 3] & (1 << (l & 7)))
+			{
+				break;
+			}
+		}
+
+		if (i == ent->num_clusters)
+		{
+			return false; /* not visible */
+		}
+	}
 
-	/* build up the list of visible entities */
-	frame->num_entities = 0;
-	frame->first_entity = svs.next_client_entities;
+	if (!ent->s.modelindex && !(ent->s.renderfx & RF_CASTSHADOW))
+	{
+		/* don't send sounds if they
+		   will be attenuated away */
+		vec3_t delta;
+
+		VectorSubtract(view->org, ent->s.origin, delta);
+
+		if (VectorLengthSquared(delta) > 400.0f * 400.0f)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Copies the entity state into the given slot
+ * of the circular client_entities array.
+ */
+static void
+SV_StoreClientEntity(const edict_t *clent, edict_t *ent, int e, int slot)
+{
+	entity_xstate_t *state;
+
+	state = &svs.client_entities[slot % svs.num_client_entities];
+
+	if (ent->s.number != e)
+	{
+		Com_DPrintf("FIXING ENT->S.NUMBER!!!\n");
+		ent->s.number = e;
+	}
+
+	SV_GetEntityState(ent, state);
+
+	/* don't mark players missiles as solid */
+	if (ent->owner == clent)
+	{
+		state->solid = 0;
+	}
+}
+
+/*
+ * Inverted index from clusters to the entities touching them,
+ * built once per server frame. Entities that can't be found
+ * through the fat PVS (beams, entities checked by headnode)
+ * are kept in a list and tested one by one.
+ */
+typedef struct
+{
+	qboolean valid;
+	int numclusters;
+	int *clusterfirst;     /* numclusters + 1 offsets into clusterents */
+	int maxclusters;
+	int *clusterents;
+	int maxclusterents;
+	int *checkents;
+	int numcheckents;
+	int maxcheckents;
+
+	/* scratch space of SV_BuildClientFrame() */
+	int *framelist;
+	byte *framemarks;
+	int maxedicts;
+} sv_entindex_t;
+
+static sv_entindex_t sv_entindex;
+
+static void *
+SV_EntityIndexRealloc(void *ptr, int *max, int num, size_t size)
+{
+	if (ptr && (*max >= num))
+	{
+		return ptr;
+	}
+
+	*max = num + (num >> 1) + 16;
+	ptr = realloc(ptr, *max * size);
+	YQ2_COM_CHECK_OOM(ptr, "realloc()", *max * size)
+
+	return ptr;
+}
+
+/*
+ * Returns true if the entity can be found through
+ * the clusters it touches.
+ */
+static qboolean
+SV_EntityIndexed(const edict_t *ent, int numclusters)
+{
+	int i;
+
+	if ((ent->s.renderfx & RF_BEAM) || (ent->s.renderfx & RF_CASTSHADOW) ||
+		(ent->num_clusters == -1))
+	{
+		return false;
+	}
+
+	for (i = 0; i < ent->num_clusters; i++)
+	{
+		if ((ent->clusternums[i] < 0) || (ent->clusternums[i] >= numclusters))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void
+SV_FreeEntityIndex(void)
+{
+	free(sv_entindex.clusterfirst);
+	free(sv_entindex.clusterents);
+	free(sv_entindex.checkents);
+	free(sv_entindex.framelist);
+	free(sv_entindex.framemarks);
+
+	memset(&sv_entindex, 0, sizeof(sv_entindex));
+}
+
+/*
+ * Marks the index as outdated, entities may
+ * change before it's used the next time.
+ */
+void
+SV_InvalidateEntityIndex(void)
+{
+	sv_entindex.valid = false;
+}
+
+/*
+ * Builds the cluster to entity index of this server
+ * frame, unless it's still valid.
+ */
+void
+SV_BuildEntityIndex(void)
+{
+	int e, i, numclusters, numents;
+	int *first;
+
+	if (sv_entindex.valid || !ge || !ge->edicts)
+	{
+		return;
+	}
+
+	numclusters = CM_NumClusters();
+
+	sv_entindex.clusterfirst = SV_EntityIndexRealloc(sv_entindex.clusterfirst,
+		&sv_entindex.maxclusters, numclusters + 1, sizeof(int));
+	sv_entindex.checkents = SV_EntityIndexRealloc(sv_entindex.checkents,
+		&sv_entindex.maxcheckents, ge->num_edicts, sizeof(int));
+
+	if (!sv_entindex.clusterfirst || !sv_entindex.checkents)
+	{
+		/* unaware about YQ2_ATTR_NORETURN_FUNCPTR? */
+		return;
+	}
+
+	first = sv_entindex.clusterfirst;
+	memset(first, 0, (numclusters + 1) * sizeof(int));
+	sv_entindex.numcheckents = 0;
+
+	/* count the entities per cluster */
+	numents = 0;
 
 	for (e = 1; e < ge->num_edicts; e++)
 	{
-		entity_xstate_t *state;
+		const edict_t *ent;
 
 		ent = EDICT_NUM(e);
 
-		/* ignore ents without visible models */
-		if (ent->svflags & SVF_NOCLIENT)
+		if (!SV_EntityIsSent(ent))
 		{
 			continue;
 		}
 
-		/* ignore ents without visible models unless they have an effect */
-		if (!ent->s.modelindex && !ent->s.effects &&
-			!ent->s.sound && !ent->s.event &&
-			!(ent->s.renderfx & RF_CASTSHADOW))
+		if (!SV_EntityIndexed(ent, numclusters))
 		{
+			sv_entindex.checkents[sv_entindex.numcheckents++] = e;
 			continue;
 		}
 
-		/* ignore if not touching a PV leaf */
-		if (ent != clent)
+		for (i = 0; i < ent->num_clusters; i++)
 		{
-			/* check area */
-			if (!CM_AreasConnected(clientarea, ent->areanum))
+			first[ent->clusternums[i] + 1]++;
+		}
+
+		numents += ent->num_clusters;
+	}
+
+	for (i = 0; i < numclusters; i++)
+	{
+		first[i + 1] += first[i];
+	}
+
+	sv_entindex.clusterents = SV_EntityIndexRealloc(sv_entindex.clusterents,
+		&sv_entindex.maxclusterents, numents, sizeof(int));
+
+	if (!sv_entindex.clusterents)
+	{
+		/* unaware about YQ2_ATTR_NORETURN_FUNCPTR? */
+		return;
+	}
+
+	/* fill in the entities, first[] is moved to
+	   the end of each cluster and back again */
+	for (e = 1; e < ge->num_edicts; e++)
+	{
+		const edict_t *ent;
+
+		ent = EDICT_NUM(e);
+
+		if (!SV_EntityIsSent(ent) || !SV_EntityIndexed(ent, numclusters))
+		{
+			continue;
+		}
+
+		for (i = 0; i < ent->num_clusters; i++)
+		{
+			sv_entindex.clusterents[first[ent->clusternums[i]]++] = e;
+		}
+	}
+
+	for (i = numclusters; i > 0; i--)
+	{
+		first[i] = first[i - 1];
+	}
+
+	first[0] = 0;
+
+	sv_entindex.numclusters = numclusters;
+	sv_entindex.valid = true;
+}
+
+/*
+ * Decides which entities are going to be visible to the client, and
+ * copies off the playerstat and areabits.
+ */
+void
+SV_BuildClientFrame(client_t *client)
+{
+	client_view_t view;
+	int count;
+
+	if (!SV_BuildClientView(client, &view))
+	{
+		return;
+	}
+
+	SV_BuildEntityIndex();
+
+	if (sv_entindex.maxedicts != ge->max_edicts)
+	{
+		sv_entindex.maxedicts = ge->max_edicts;
+
+		free(sv_entindex.framelist);
+		free(sv_entindex.framemarks);
+
+		sv_entindex.framelist = malloc(ge->max_edicts * sizeof(int));
+		sv_entindex.framemarks = malloc(SV_ENTMARKS_SIZE);
+
+		YQ2_COM_CHECK_OOM(sv_entindex.framelist, "malloc()",
+			ge->max_edicts * sizeof(int))
+		YQ2_COM_CHECK_OOM(sv_entindex.framemarks, "malloc()",
+			SV_ENTMARKS_SIZE)
+	}
+
+	count = SV_CollectClientEntities(client, &view,
+		sv_entindex.framelist, sv_entindex.framemarks);
+
+	SV_StoreClientEntities(client, sv_entindex.framelist, count,
+		svs.next_client_entities);
+
+	svs.next_client_entities += count;
+}
+
+/*
+ * Fixes the numbers of all entities which might be sent
+ * to a client, so SV_StoreClientEntities() doesn't have
+ * to while running on a worker.
+ */
+void
+SV_FixEntityNumbers(void)
+{
+	int e;
+
+	for (e = 1; e < ge->num_edicts; e++)
+	{
+		edict_t *ent;
+
+		ent = EDICT_NUM(e);
+
+		if ((ent->s.number != e) && SV_EntityIsSent(ent))
+		{
+			Com_DPrintf("FIXING ENT->S.NUMBER!!!\n");
+			ent->s.number = e;
+		}
+	}
+}
+
+#define SV_MARKED(marks, e) ((marks)[(e) >> 3] & (1 << ((e) & 7)))
+#define SV_MARK(marks, e) ((marks)[(e) >> 3] |= (1 << ((e) & 7)))
+
+/*
+ * Collects the numbers of the entities visible to the client
+ * in ascending order. The candidates are taken from the index
+ * built by SV_BuildEntityIndex(), so the cost depends on what
+ * the client sees. list must have room for ge->num_edicts
+ * entries and marks for SV_ENTMARKS_SIZE bytes. Safe to run
+ * on a worker, if the view buffers are owned by the caller.
+ */
+int
+SV_CollectClientEntities(const client_t *client, const client_view_t *view,
+	int *list, byte *marks)
+{
+	const int *first, *ents;
+	const edict_t *clent;
+	byte *seen, *visible;
+	int c, e, i, count, numbits;
+
+	clent = CL_EDICT(client);
+	first = sv_entindex.clusterfirst;
+	ents = sv_entindex.clusterents;
+
+	seen = marks;
+	visible = marks + SV_ENTMARKS_SIZE / 2;
+	memset(seen, 0, (ge->num_edicts + 7) >> 3);
+	memset(visible, 0, (ge->num_edicts + 7) >> 3);
+
+	/* the client always sees itself */
+	if (SV_EntityVisible(view, clent, clent, false))
+	{
+		SV_MARK(visible, NUM_FOR_EDICT(clent));
+	}
+
+	for (i = 0; i < sv_entindex.numcheckents; i++)
+	{
+		e = sv_entindex.checkents[i];
+
+		if (SV_EntityVisible(view, clent, EDICT_NUM(e), false))
+		{
+			SV_MARK(visible, e);
+		}
+	}
+
+	/* entities in the clusters of the fat PVS */
+	numbits = Q_min(view->fatpvs_size * 8, sv_entindex.numclusters);
+
+	for (c = 0; c < numbits; c++)
+	{
+		if (!view->fatpvs[c >> 3])
+		{
+			c |= 7; /* skip the whole byte */
+			continue;
+		}
+
+		if (!(view->fatpvs[c >> 3] & (1 << (c & 7))))
+		{
+			continue;
+		}
+
+		for (i = first[c]; i < first[c + 1]; i++)
+		{
+			e = ents[i];
+
+			if (SV_MARKED(seen, e))
 			{
-				/* doors can legally straddle two areas,
-				   so we may need to check another one */
-				if (!ent->areanum2 ||
-					!CM_AreasConnected(clientarea, ent->areanum2))
-				{
-					continue; /* blocked by a door */
-				}
+				continue;
 			}
 
-			/* beams just check one point for PHS */
-			if (ent->s.renderfx & RF_BEAM || (ent->s.renderfx & RF_CASTSHADOW))
-			{
-				l = ent->clusternums[0];
+			SV_MARK(seen, e);
 
-				if (((l >> 3) >= phs_size) || !(clientphs[l >> 3] & (1 << (l & 7))))
-				{
-					continue;
-				}
-			}
-			else
+			if (SV_EntityVisible(view, clent, EDICT_NUM(e), true))
 			{
-				bitvector = fatpvs;
-
-				if (ent->num_clusters == -1)
-				{
-					/* too many leafs for individual check, go by headnode */
-					if (!CM_HeadnodeVisible(ent->headnode, bitvector))
-					{
-						continue;
-					}
-				}
-				else
-				{
-					/* check individual leafs */
-					for (i = 0; i < ent->num_clusters; i++)
-					{
-						l = ent->clusternums[i];
-
-						if (((l >> 3) < fatpvs_size) && bitvector[l >> 3] & (1 << (l & 7)))
-						{
-							break;
-						}
-					}
-
-					if (i == ent->num_clusters)
-					{
-						continue; /* not visible */
-					}
-				}
-
-				if (!ent->s.modelindex && !(ent->s.renderfx & RF_CASTSHADOW))
-				{
-					/* don't send sounds if they
-					   will be attenuated away */
-					vec3_t delta;
-
-					VectorSubtract(org, ent->s.origin, delta);
-
-					if (VectorLengthSquared(delta) > 400.0f * 400.0f)
-					{
-						continue;
-					}
-				}
+				SV_MARK(visible, e);
 			}
 		}
+	}
 
-		/* add it to the circular client_entities array */
-		state = &svs.client_entities[svs.next_client_entities %
-				svs.num_client_entities];
+	count = 0;
 
-		if (ent->s.number != e)
+	for (i = 0; i < (ge->num_edicts + 7) >> 3; i++)
+	{
+		if (!visible[i])
 		{
-			Com_DPrintf("FIXING ENT->S.NUMBER!!!\n");
-			ent->s.number = e;
+			continue;
 		}
 
-		SV_GetEntityState(ent, state);
-
-		/* don't mark players missiles as solid */
-		if (ent->owner == clent)
+		for (e = i << 3; e < (i + 1) << 3; e++)
 		{
-			state->solid = 0;
+			if (SV_MARKED(visible, e))
+			{
+				list[count++] = e;
+			}
 		}
+	}
 
-		svs.next_client_entities++;
-		frame->num_entities++;
+	return count;
+}
+
+/*
+ * Stores the collected entities in the frame we are creating,
+ * starting at slot first of the circular client_entities array.
+ */
+void
+SV_StoreClientEntities(client_t *client, const int *list, int count,
+	int first)
+{
+	client_frame_t *frame;
+	edict_t *clent;
+	int i;
+
+	clent = CL_EDICT(client);
+	frame = &client->frames[sv.framenum & UPDATE_MASK];
+
+	frame->num_entities = count;
+	frame->first_entity = first;
+
+	for (i = 0; i < count; i++)
+	{
+		SV_StoreClientEntity(clent, EDICT_NUM(list[i]), list[i], first + i);
 	}
 }
 
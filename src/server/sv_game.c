@@ -634,6 +634,8 @@ SV_InitGameProgs(void)
 	import.LocalizationMessage = PF_LocalizationMessage;
 	import.LocalizationUIMessage = SV_LocalizationUIMessage;
 	import.TagRealloc = Z_TagRealloc;
+	import.SphereEdicts = SV_SphereEdicts;
+	import.LinkCount = SV_LinkCount;
 
 	ge = (game_export_t *)Sys_GetGameAPI(&import);
 
@@ -644,6 +646,7 @@ SV_InitGameProgs(void)
 	}
 
 	if (ge->apiversion != GAME_API_VERSION &&
+		ge->apiversion != GAME_API_V4_VERSION &&
 		ge->apiversion != GAME_API_R97_VERSION)
 	{
 		int version;
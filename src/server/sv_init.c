@@ -347,6 +347,9 @@ SV_SpawnServer(char *server, char *spawnpoint, server_state_t serverstate,
 				false, &checksum);
 	}
 
+	/* cached fat PVS belong to the old map */
+	SV_ClearFatPVSCache();
+
 	Com_sprintf(sv.configstrings[CS_MAPCHECKSUM],
 			sizeof(sv.configstrings[CS_MAPCHECKSUM]),
 			"%i", checksum);
@@ -555,6 +558,7 @@ SV_InitGame(void)
 	svs.gamemode = gamemode;
 	svs.spawncount = randk();
 	svs.clients = Z_Malloc(sizeof(client_t) * maxclients->value);
+	SV_ClientHashChanged();
 	svs.num_client_entities = maxclients->value * UPDATE_BACKUP * MAX_PACKET_ENTITIES;
 	svs.client_entities = Z_Malloc( sizeof(entity_xstate_t) * svs.num_client_entities);
 
@@ -55,6 +55,8 @@ cvar_t *public_server; /* should heartbeats be sent */
 cvar_t *sv_entfile; /* External entity files. */
 cvar_t *sv_downloadserver; /* Download server. */
 cvar_t *sv_language; /* Server message language. */
+cvar_t *sv_areatree; /* bounding box tree instead of areanodes */
+cvar_t *sv_areastats; /* print the cost of edict queries */
 
 /*
  * Called when the player is totally leaving the server, either willingly
@@ -193,10 +195,187 @@ SV_GiveMsec(void)
 	}
 }
 
+/* Clients by their base address and qport, so packets
+   don't need to be compared with all client slots. Open
+   addressing, the entries are client numbers or -1. */
+static int *client_hash;
+static int client_hashsize;
+static qboolean client_hashdirty;
+
+static unsigned
+SV_ClientHashKey(const netadr_t *adr, int qport)
+{
+	const byte *data;
+	unsigned hash;
+	int i, len;
+
+	switch (adr->type)
+	{
+		case NA_IP:
+			data = adr->ip;
+			len = 4;
+			break;
+		case NA_IP6:
+			data = adr->ip;
+			len = 16;
+			break;
+		case NA_IPX:
+			data = adr->ipx;
+			len = 10;
+			break;
+		default:
+			data = NULL;
+			len = 0;
+			break;
+	}
+
+	/* FNV-1a */
+	hash = 2166136261u ^ adr->type;
+
+	for (i = 0; i < len; i++)
+	{
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+
+	hash = (hash ^ (qport & 0xff)) * 16777619u;
+	hash = (hash ^ (qport >> 8)) * 16777619u;
+
+	return hash;
+}
+
+/*
+ * Has to be called after a client slot got a new
+ * address, the hash is rebuilt before the next lookup.
+ */
+void
+SV_ClientHashChanged(void)
+{
+	client_hashdirty = true;
+}
+
+void
+SV_FreeClientHash(void)
+{
+	free(client_hash);
+	client_hash = NULL;
+	client_hashsize = 0;
+}
+
+static void
+SV_BuildClientHash(void)
+{
+	int i, size;
+
+	/* at most half full */
+	for (size = 16; size < maxclients->value * 2; size <<= 1)
+	{
+	}
+
+	if (size != client_hashsize)
+	{
+		int *tmp;
+
+		tmp = realloc(client_hash, size * sizeof(*tmp));
+		YQ2_COM_CHECK_OOM(tmp, "realloc()", size * sizeof(*tmp))
+		if (!tmp)
+		{
+			/* unaware about YQ2_ATTR_NORETURN_FUNCPTR? */
+			return;
+		}
+
+		client_hash = tmp;
+		client_hashsize = size;
+	}
+
+	for (i = 0; i < client_hashsize; i++)
+	{
+		client_hash[i] = -1;
+	}
+
+	for (i = 0; i < maxclients->value; i++)
+	{
+		const client_t *cl;
+		unsigned slot;
+
+		cl = &svs.clients[i];
+
+		if (cl->state == cs_free)
+		{
+			continue;
+		}
+
+		slot = SV_ClientHashKey(&cl->netchan.remote_address,
+				cl->netchan.qport) & (client_hashsize - 1);
+
+		while (client_hash[slot] != -1)
+		{
+			slot = (slot + 1) & (client_hashsize - 1);
+		}
+
+		client_hash[slot] = i;
+	}
+
+	client_hashdirty = false;
+}
+
+/*
+ * Returns the client the packet is from, the one in the
+ * lowest slot if several match, like the linear search did.
+ */
+static client_t *
+SV_FindPacketClient(netadr_t from, int qport)
+{
+	client_t *found;
+	unsigned slot;
+
+	if (client_hashdirty || !client_hash)
+	{
+		SV_BuildClientHash();
+
+		if (!client_hash)
+		{
+			return NULL;
+		}
+	}
+
+	found = NULL;
+	slot = SV_ClientHashKey(&from, qport) & (client_hashsize - 1);
+
+	while (client_hash[slot] != -1)
+	{
+		client_t *cl;
+
+		cl = &svs.clients[client_hash[slot]];
+		slot = (slot + 1) & (client_hashsize - 1);
+
+		/* slots freed since the hash was built */
+		if (cl->state == cs_free)
+		{
+			continue;
+		}
+
+		if (!NET_CompareBaseAdr(from, cl->netchan.remote_address))
+		{
+			continue;
+		}
+
+		if (cl->netchan.qport != qport)
+		{
+			continue;
+		}
+
+		if (!found || (cl < found))
+		{
+			found = cl;
+		}
+	}
+
+	return found;
+}
+
 static void
 SV_ReadPackets(void)
 {
-	int i;
 	client_t *cl;
 	int qport;
 
@@ -217,49 +396,31 @@ SV_ReadPackets(void)
 		qport = MSG_ReadShort(&net_message) & 0xffff;
 
 		/* check for packets from connected clients */
-		for (i = 0, cl = svs.clients; i < maxclients->value; i++, cl++)
-		{
-			if (cl->state == cs_free)
-			{
-				continue;
-			}
+		cl = SV_FindPacketClient(net_from, qport);
 
-			if (!NET_CompareBaseAdr(net_from, cl->netchan.remote_address))
-			{
-				continue;
-			}
+		if (!cl)
+		{
+			continue;
+		}
 
-			if (cl->netchan.qport != qport)
-			{
-				continue;
-			}
+		if (cl->netchan.remote_address.port != net_from.port)
+		{
+			Com_Printf("%s: fixing up a translated port\n", __func__);
+			cl->netchan.remote_address.port = net_from.port;
+		}
 
-			if (cl->netchan.remote_address.port != net_from.port)
+		if (Netchan_Process(&cl->netchan, &net_message))
+		{
+			/* this is a valid, sequenced packet, so process it */
+			if (cl->state != cs_zombie)
 			{
-				Com_Printf("%s: fixing up a translated port\n", __func__);
-				cl->netchan.remote_address.port = net_from.port;
-			}
+				cl->lastmessage = svs.realtime; /* don't timeout */
 
-			if (Netchan_Process(&cl->netchan, &net_message))
-			{
-				/* this is a valid, sequenced packet, so process it */
-				if (cl->state != cs_zombie)
+				if (!(sv.demofile && (sv.state == ss_demo)))
 				{
-					cl->lastmessage = svs.realtime; /* don't timeout */
-
-					if (!(sv.demofile && (sv.state == ss_demo)))
-					{
-						SV_ExecuteClientMessage(cl);
-					}
+					SV_ExecuteClientMessage(cl);
 				}
 			}
-
-			break;
-		}
-
-		if (i != maxclients->value)
-		{
-			continue;
 		}
 	}
 }
@@ -326,6 +487,8 @@ SV_PrepWorldFrame(void)
 		/* events only last for a single message */
 		ent->s.event = 0;
 	}
+
+	SV_InvalidateEntityIndex();
 }
 
 static void
@@ -348,6 +511,7 @@ SV_RunGameFrame(void)
 	/* don't run if paused */
 	if (!sv_paused->value || (maxclients->value > 1))
 	{
+		SV_ClearUnlinkedEdicts();
 		ge->RunFrame();
 
 		/* never get more than one tic behind */
@@ -362,6 +526,12 @@ SV_RunGameFrame(void)
 		}
 	}
 
+	/* everything has moved, find out who
+	   can be seen from where */
+	SV_BuildEntityIndex();
+
+	SV_AreaStats();
+
 #ifndef DEDICATED_ONLY
 	if (host_speeds->value)
 	{
@@ -386,10 +556,139 @@ SV_Optimizations(void)
 	return cv ? ((int)cv->value & OPTIMIZE_MASK_ALL) : 0;
 }
 
+/* Frame time not yet added to svs.realtime, so that
+   the frames start at the exact millisecond. */
+static int frame_usec;
+
+/* When svs.realtime was last advanced. */
+static long long frame_start;
+
+/* Upper limits of the tick jitter buckets in usec. */
+static const int tickstats_limits[] = {
+	100, 250, 500, 1000, 2000, 5000, 10000, 0x7fffffff
+};
+
+/* What the server did since the last sv_tickstats. */
+static struct
+{
+	long long start;
+	long long game;
+	long long net;
+	long long idle;
+	int ticks;
+	int jitter[ARRLEN(tickstats_limits)];
+	int maxjitter;
+} tickstats;
+
+static void
+SV_TickJitter(int usec)
+{
+	int i;
+
+	for (i = 0; usec >= tickstats_limits[i]; i++)
+	{
+	}
+
+	tickstats.jitter[i]++;
+	tickstats.maxjitter = Q_max(tickstats.maxjitter, usec);
+	tickstats.ticks++;
+}
+
+/*
+ * Prints how late the game frames started, where the
+ * time went and resets the statistics.
+ */
+void
+SV_TickStats_f(void)
+{
+	long long total;
+	int i, lower;
+
+	total = Sys_Microseconds() - tickstats.start;
+
+	if (!tickstats.start || (total <= 0))
+	{
+		Com_Printf("No server running.\n");
+		return;
+	}
+
+	Com_Printf("%i ticks in %.1f s, started late by:\n",
+			tickstats.ticks, total / 1000000.0);
+
+	for (i = 0, lower = 0; i < ARRLEN(tickstats_limits); i++)
+	{
+		if (tickstats_limits[i] == 0x7fffffff)
+		{
+			Com_Printf("  >= %5i us: %6i\n", lower, tickstats.jitter[i]);
+		}
+		else
+		{
+			Com_Printf("   < %5i us: %6i\n", tickstats_limits[i],
+					tickstats.jitter[i]);
+		}
+
+		lower = tickstats_limits[i];
+	}
+
+	Com_Printf("max %i us\n", tickstats.maxjitter);
+	Com_Printf("game %.1f%%, network %.1f%%, idle %.1f%%\n",
+			tickstats.game * 100.0 / total, tickstats.net * 100.0 / total,
+			tickstats.idle * 100.0 / total);
+
+	memset(&tickstats, 0, sizeof(tickstats));
+	tickstats.start = Sys_Microseconds();
+}
+
+/*
+ * Returns the usec from now until the next game frame
+ * is due, -1 if the server isn't running.
+ */
+int
+SV_NextFrame(void)
+{
+	int usec;
+
+	if (!svs.initialized)
+	{
+		return -1;
+	}
+
+	if (sv_timedemo->value || (svs.realtime >= sv.time))
+	{
+		return 0;
+	}
+
+	/* the frame itself took some time */
+	usec = Q_min(sv.time - svs.realtime, 100) * 1000 - frame_usec -
+		(int)(Sys_Microseconds() - frame_start);
+
+	return Q_max(usec, 0);
+}
+
+/*
+ * Sleeps until the given time passed, stdin is ready or,
+ * if network is set, a packet arrived.
+ */
+void
+SV_Sleep(int usec, qboolean network)
+{
+	long long start;
+
+	if (usec <= 0)
+	{
+		return;
+	}
+
+	start = Sys_Microseconds();
+	NET_SleepUsec(usec, network);
+	tickstats.idle += Sys_Microseconds() - start;
+}
+
 void
 SV_Frame(int usec)
 {
 	int opt_sendrate;
+	long long start;
 
 #ifndef DEDICATED_ONLY
 	time_before_game = time_after_game = 0;
@@ -401,7 +700,16 @@ SV_Frame(int usec)
 		return;
 	}
 
+	frame_start = Sys_Microseconds();
+
+	if (!tickstats.start)
+	{
+		tickstats.start = frame_start;
+	}
+
+	usec += frame_usec;
 	svs.realtime += usec / 1000;
+	frame_usec = usec % 1000;
 
 	/* keep the random time dependent */
 	randk();
@@ -410,7 +718,9 @@ SV_Frame(int usec)
 	SV_CheckTimeouts();
 
 	/* get packets from clients */
+	start = Sys_Microseconds();
 	SV_ReadPackets();
+	tickstats.net += Sys_Microseconds() - start;
 
 	/* send messages more often to new clients getting ready for spawning in
 	   speeds up the process of sending configstrings, entty deltas, etc.
@@ -436,10 +746,18 @@ SV_Frame(int usec)
 			svs.realtime = sv.time - 100;
 		}
 
+#ifndef DEDICATED_ONLY
 		NET_Sleep(sv.time - svs.realtime);
+#endif
+		/* q2ded sleeps in the main loop, see SV_NextFrame() */
 		return;
 	}
 
+	if (!sv_timedemo->value)
+	{
+		SV_TickJitter((svs.realtime - sv.time) * 1000 + frame_usec);
+	}
+
 	/* update ping based on the last known frame from all clients */
 	SV_CalcPings();
 
@@ -447,9 +765,13 @@ SV_Frame(int usec)
 	SV_GiveMsec();
 
 	/* let everything in the world think and move */
+	start = Sys_Microseconds();
 	SV_RunGameFrame();
+	tickstats.game += Sys_Microseconds() - start;
 
 	/* send messages back to the clients that had packets read this frame */
+	start = Sys_Microseconds();
+	NET_BeginSendBatch(NS_SERVER);
 	SV_SendClientMessages();
 
 	/* if not optimizing, send all messages here */
@@ -458,6 +780,9 @@ SV_Frame(int usec)
 		SV_SendPrepClientMessages();
 	}
 
+	NET_EndSendBatch(NS_SERVER);
+	tickstats.net += Sys_Microseconds() - start;
+
 	/* save the entire world state if recording a serverdemo */
 	SV_RecordDemoMessage();
 
@@ -604,6 +929,7 @@ void
 SV_Init(void)
 {
 	SV_SendInitBuffers();
+	SV_WorkersInit();
 	SV_InitOperatorCommands();
 
 	sv_optimize_sp_loadtime = Cvar_Get("sv_optimize_sp_loadtime", "31", 0);
@@ -634,6 +960,8 @@ SV_Init(void)
 	allow_download_maps = Cvar_Get("allow_download_maps", "1", CVAR_ARCHIVE);
 	sv_downloadserver = Cvar_Get("sv_downloadserver", "", 0);
 	sv_language = Cvar_Get("language", "english", CVAR_ARCHIVE);
+	sv_areatree = Cvar_Get("sv_areatree", "0", CVAR_ARCHIVE);
+	sv_areastats = Cvar_Get("sv_areastats", "0", 0);
 
 	sv_noreload = Cvar_Get("sv_noreload", "0", 0);
 
@@ -762,5 +1090,10 @@ SV_Shutdown(const char *finalmsg, qboolean reconnect)
 
 	memset(&svs, 0, sizeof(svs));
 
+	SV_WorkersShutdown();
 	SV_SendFreeBuffers();
+	SV_FreeEntityIndex();
+	SV_ClearFatPVSCache();
+	SV_FreeAreaTree();
+	SV_FreeClientHash();
 }
@@ -486,6 +486,55 @@ SV_SendInitBuffers(void)
 	SV_SendReallocBuffers(&size);
 }
 
+/* Per client state of frames built by the workers */
+typedef struct
+{
+	client_t *client;
+	qboolean inview;       /* view and entities are valid */
+	client_view_t view;
+	byte *fatpvs;
+	byte *phs;
+	size_t vis_size;
+	int *entities;
+	byte *entmarks;
+	int num_entities;
+	int first_entity;
+	int surpressCount;     /* before SV_WriteFrameToClient() */
+	sizebuf_t msg;
+	byte *msg_buf;
+	int msg_buf_size;
+} sv_clientwork_t;
+
+typedef struct
+{
+	sv_clientwork_t *work;
+	qboolean parallel_store; /* entity slots don't overlap */
+} sv_sendjob_t;
+
+static sv_clientwork_t *clientwork = NULL;
+static int clientwork_num = 0;
+static int clientwork_edicts = 0;
+
+static void
+SV_SendFreeWork(void)
+{
+	int i;
+
+	for (i = 0; i < clientwork_num; i++)
+	{
+		free(clientwork[i].fatpvs);
+		free(clientwork[i].phs);
+		free(clientwork[i].entities);
+		free(clientwork[i].entmarks);
+		free(clientwork[i].msg_buf);
+	}
+
+	free(clientwork);
+	clientwork = NULL;
+	clientwork_num = 0;
+	clientwork_edicts = 0;
+}
+
 void
 SV_SendFreeBuffers(void)
 {
@@ -495,27 +544,182 @@ SV_SendFreeBuffers(void)
 		msgbuff_cache = NULL;
 	}
 	msgbuff_size = 0;
+
+	SV_SendFreeWork();
+}
+
+static void *
+SV_SendReallocWork(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size);
+	YQ2_COM_CHECK_OOM(ptr, "realloc()", size)
+
+	return ptr;
 }
 
+/*
+ * Makes sure there's work state for every client with
+ * room for all current edicts and a full message.
+ */
 static qboolean
-SV_SendClientDatagram(client_t *client)
+SV_SendPrepareWork(int msg_buf_size)
 {
-	int msg_buf_size;
-	byte *msg_buf;
-	sizebuf_t msg;
+	int i, num;
 
-	msg_buf_size = MAX_MSGLEN;
-	msg_buf = SV_SendReallocBuffers(&msg_buf_size);
+	num = maxclients->value;
 
-	SV_BuildClientFrame(client);
+	if (clientwork_num != num)
+	{
+		SV_SendFreeWork();
 
-	SZ_Init(&msg, msg_buf, msg_buf_size);
-	msg.allowoverflow = true;
+		clientwork = calloc(num, sizeof(*clientwork));
+		YQ2_COM_CHECK_OOM(clientwork, "calloc()", num * sizeof(*clientwork))
+		if (!clientwork)
+		{
+			/* unaware about YQ2_ATTR_NORETURN_FUNCPTR? */
+			return false;
+		}
 
-	/* send over all the relevant entity_state_t
-	   and the player_state_t */
-	SV_WriteFrameToClient(client, &msg);
+		clientwork_num = num;
+	}
+
+	for (i = 0; i < clientwork_num; i++)
+	{
+		sv_clientwork_t *w;
+
+		w = &clientwork[i];
+
+		if ((clientwork_edicts != ge->max_edicts) || !w->entities)
+		{
+			w->entities = SV_SendReallocWork(w->entities,
+				ge->max_edicts * sizeof(int));
+			w->entmarks = SV_SendReallocWork(w->entmarks,
+				SV_ENTMARKS_SIZE);
+
+			if (!w->entities || !w->entmarks)
+			{
+				return false;
+			}
+		}
+
+		/* msg has extra room, so it never overflows
+		   on a worker, see SV_SendClientDatagrams() */
+		if (w->msg_buf_size < msg_buf_size + MAX_MSGLEN)
+		{
+			w->msg_buf_size = msg_buf_size + MAX_MSGLEN;
+			w->msg_buf = SV_SendReallocWork(w->msg_buf, w->msg_buf_size);
+
+			if (!w->msg_buf)
+			{
+				return false;
+			}
+		}
+	}
+
+	clientwork_edicts = ge->max_edicts;
+
+	return true;
+}
+
+/*
+ * Copies the view's PVS and PHS out of the buffers of
+ * the collision code, which are shared by all clients.
+ */
+static qboolean
+SV_SendCopyView(sv_clientwork_t *w)
+{
+	size_t size;
+
+	size = Q_max(w->view.fatpvs_size, w->view.phs_size);
+
+	if (w->vis_size < size)
+	{
+		w->fatpvs = SV_SendReallocWork(w->fatpvs, size);
+		w->phs = SV_SendReallocWork(w->phs, size);
+
+		if (!w->fatpvs || !w->phs)
+		{
+			return false;
+		}
+
+		w->vis_size = size;
+	}
+
+	if (w->view.fatpvs_size)
+	{
+		memcpy(w->fatpvs, w->view.fatpvs, w->view.fatpvs_size);
+	}
+
+	if (w->view.phs_size)
+	{
+		memcpy(w->phs, w->view.clientphs, w->view.phs_size);
+	}
+
+	w->view.fatpvs = w->fatpvs;
+	w->view.clientphs = w->phs;
+
+	return true;
+}
 
+static void
+SV_SendCollectJob(int item, void *data)
+{
+	sv_clientwork_t *w;
+
+	w = &((sv_sendjob_t *)data)->work[item];
+
+	if (w->inview)
+	{
+		w->num_entities = SV_CollectClientEntities(w->client,
+			&w->view, w->entities, w->entmarks);
+	}
+}
+
+static void
+SV_SendEncode(sv_clientwork_t *w)
+{
+	if (w->inview)
+	{
+		SV_StoreClientEntities(w->client, w->entities,
+			w->num_entities, w->first_entity);
+	}
+
+	w->surpressCount = w->client->surpressCount;
+
+	SZ_Init(&w->msg, w->msg_buf, w->msg_buf_size);
+	w->msg.allowoverflow = true;
+
+	SV_WriteFrameToClient(w->client, &w->msg);
+}
+
+static void
+SV_SendEncodeJob(int item, void *data)
+{
+	SV_SendEncode(&((sv_sendjob_t *)data)->work[item]);
+}
+
+/*
+ * Returns true if the entities of the frame are overwritten
+ * by the new slots start to end of this server frame.
+ */
+static qboolean
+SV_SendFrameOverwritten(const client_frame_t *frame, int start, int end)
+{
+	int first;
+
+	if (!frame || !frame->num_entities)
+	{
+		return false;
+	}
+
+	first = frame->first_entity + svs.num_client_entities;
+
+	return (first < end) && (first + frame->num_entities > start);
+}
+
+static void
+SV_SendClientDatagramTail(client_t *client, sizebuf_t *msg)
+{
 	/* copy the accumulated multicast datagram
 	   for this client out to the message
 	   it is necessary for this to be after the WriteEntities
@@ -526,23 +730,45 @@ SV_SendClientDatagram(client_t *client)
 	}
 	else
 	{
-		SZ_Write(&msg, client->datagram.data, client->datagram.cursize);
+		SZ_Write(msg, client->datagram.data, client->datagram.cursize);
 	}
 
 	SZ_Clear(&client->datagram);
 
-	if (msg.overflowed)
+	if (msg->overflowed)
 	{
 		/* must have room left for the packet header */
 		Com_Printf("WARNING: msg overflowed for %s\n", client->name);
-		SZ_Clear(&msg);
+		SZ_Clear(msg);
 	}
 
 	/* send the datagram */
-	Netchan_Transmit(&client->netchan, msg.cursize, msg.data);
+	Netchan_Transmit(&client->netchan, msg->cursize, msg->data);
 
 	/* record the size for rate estimation */
-	client->message_size[sv.framenum % RATE_MESSAGES] = msg.cursize;
+	client->message_size[sv.framenum % RATE_MESSAGES] = msg->cursize;
+}
+
+static qboolean
+SV_SendClientDatagram(client_t *client)
+{
+	int msg_buf_size;
+	byte *msg_buf;
+	sizebuf_t msg;
+
+	msg_buf_size = MAX_MSGLEN;
+	msg_buf = SV_SendReallocBuffers(&msg_buf_size);
+
+	SV_BuildClientFrame(client);
+
+	SZ_Init(&msg, msg_buf, msg_buf_size);
+	msg.allowoverflow = true;
+
+	/* send over all the relevant entity_state_t
+	   and the player_state_t */
+	SV_WriteFrameToClient(client, &msg);
+
+	SV_SendClientDatagramTail(client, &msg);
 
 	return true;
 }
@@ -642,9 +868,158 @@ SV_SendDisconnect(client_t *c)
 	SV_BroadcastPrintf(PRINT_HIGH, "%s overflowed\n", c->name);
 	SV_DropClient(c);
 
+	/* the game may have changed entities */
+	SV_InvalidateEntityIndex();
+
 	Netchan_Transmit(&c->netchan, 0, NULL);
 }
 
+/*
+ * Builds and encodes the frames of all spawned clients on the
+ * workers, sending stays on the main thread. The result is the
+ * same as sending them one after the other with
+ * SV_SendClientDatagram(). Returns false if the frame has
+ * to be sent the serial way.
+ */
+static qboolean
+SV_SendClientDatagrams(void)
+{
+	int i, num, start, end, msg_buf_size;
+	sv_sendjob_t job;
+	byte *msg_buf;
+	client_t *c;
+
+	/* dropping clients calls into the game, which
+	   changes what the following clients see */
+	for (i = 0, c = svs.clients; i < maxclients->value; i++, c++)
+	{
+		if ((c->state != cs_free) && c->netchan.message.overflowed)
+		{
+			return false;
+		}
+	}
+
+	msg_buf_size = MAX_MSGLEN;
+	msg_buf = SV_SendReallocBuffers(&msg_buf_size);
+
+	if (!msg_buf || !SV_SendPrepareWork(msg_buf_size))
+	{
+		return false;
+	}
+
+	/* the collision code isn't thread safe, so the
+	   views are built here */
+	num = 0;
+
+	for (i = 0, c = svs.clients; i < maxclients->value; i++, c++)
+	{
+		sv_clientwork_t *w;
+
+		/* don't overrun bandwidth */
+		if ((c->state != cs_spawned) || SV_RateDrop(c))
+		{
+			continue;
+		}
+
+		w = &clientwork[num++];
+		w->client = c;
+		w->num_entities = 0;
+		w->inview = SV_BuildClientView(c, &w->view);
+
+		if (w->inview && !SV_SendCopyView(w))
+		{
+			return false;
+		}
+	}
+
+	if (!num)
+	{
+		return true;
+	}
+
+	job.work = clientwork;
+
+	SV_FixEntityNumbers();
+	SV_BuildEntityIndex();
+	SV_WorkersRun(SV_SendCollectJob, &job, num);
+
+	/* hand out the entity slots in client order */
+	start = svs.next_client_entities;
+
+	for (i = 0; i < num; i++)
+	{
+		if (clientwork[i].inview)
+		{
+			clientwork[i].first_entity = svs.next_client_entities;
+			svs.next_client_entities += clientwork[i].num_entities;
+		}
+	}
+
+	end = svs.next_client_entities;
+
+	/* frames delta'd from must survive until all clients
+	   are encoded, otherwise stick to the serial order */
+	job.parallel_store = true;
+
+	for (i = 0; i < num; i++)
+	{
+		client_frame_t *oldframe;
+		int lastframe;
+
+		c = clientwork[i].client;
+		oldframe = SV_ClientDeltaFrame(c, &lastframe);
+
+		if (SV_SendFrameOverwritten(oldframe, start, end) ||
+			(!clientwork[i].inview &&
+			 SV_SendFrameOverwritten(&c->frames[sv.framenum & UPDATE_MASK],
+				start, end)))
+		{
+			job.parallel_store = false;
+			break;
+		}
+	}
+
+	if (job.parallel_store)
+	{
+		SV_WorkersRun(SV_SendEncodeJob, &job, num);
+	}
+	else
+	{
+		for (i = 0; i < num; i++)
+		{
+			SV_SendEncode(&clientwork[i]);
+		}
+	}
+
+	for (i = 0; i < num; i++)
+	{
+		sv_clientwork_t *w;
+		sizebuf_t msg;
+
+		w = &clientwork[i];
+
+		SZ_Init(&msg, msg_buf, msg_buf_size);
+		msg.allowoverflow = true;
+
+		/* the frame would have overflowed the serial way
+		   (or even a worker's larger buffer) */
+		if (!w->msg.overflowed && (w->msg.cursize <= msg_buf_size))
+		{
+			SZ_Write(&msg, w->msg.data, w->msg.cursize);
+		}
+		else
+		{
+			/* encode again to overflow like the serial way */
+			w->client->surpressCount = w->surpressCount;
+			SV_WriteFrameToClient(w->client, &msg);
+		}
+
+		SV_SendClientDatagramTail(w->client, &msg);
+	}
+
+	return true;
+}
+
 void
 SV_SendClientMessages(void)
 {
@@ -669,6 +1044,12 @@ SV_SendClientMessages(void)
 	else
 	{
 		msglen = 0;
+
+		if (SV_NumWorkers() && (sv.state == ss_game) &&
+			SV_SendClientDatagrams())
+		{
+			return;
+		}
 	}
 
 	/* send a message to each spawned client */
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Worker pool of the dedicated server. Jobs are split in items,
+ * which are picked up by the workers and the main thread until
+ * all are done. Only available in q2ded on non Windows systems,
+ * everywhere else the jobs run on the main thread.
+ *
+ * =======================================================================
+ */
+
+#include "header/server.h"
+
+#define SV_MAX_WORKERS 32
+
+#if defined(DEDICATED_ONLY) && !defined(_WIN32)
+#define SV_WORKERS_THREADED
+#include <pthread.h>
+#endif
+
+static cvar_t *sv_threads;
+
+#ifdef SV_WORKERS_THREADED
+
+static pthread_t workers[SV_MAX_WORKERS];
+static int numworkers;
+
+static pthread_mutex_t work_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t work_done = PTHREAD_COND_INITIALIZER;
+
+static sv_job_t work_job;
+static void *work_data;
+static int work_count;
+static int work_next;
+static int work_pending;
+static int work_generation;
+static qboolean work_quit;
+
+/*
+ * Runs items of the current job until none is left.
+ * Must be called with work_lock held.
+ */
+static void
+SV_WorkersDrain(void)
+{
+	while (work_next < work_count)
+	{
+		int item;
+
+		item = work_next++;
+
+		pthread_mutex_unlock(&work_lock);
+		work_job(item, work_data);
+		pthread_mutex_lock(&work_lock);
+
+		if (!--work_pending)
+		{
+			pthread_cond_broadcast(&work_done);
+		}
+	}
+}
+
+static void *
+SV_WorkerThread(void *arg)
+{
+	int generation;
+
+	pthread_mutex_lock(&work_lock);
+	generation = work_generation;
+
+	while (1)
+	{
+		while (!work_quit && (generation == work_generation))
+		{
+			pthread_cond_wait(&work_start, &work_lock);
+		}
+
+		if (work_quit)
+		{
+			break;
+		}
+
+		generation = work_generation;
+		SV_WorkersDrain();
+	}
+
+	pthread_mutex_unlock(&work_lock);
+
+	return NULL;
+}
+
+static void
+SV_WorkersStop(void)
+{
+	int i;
+
+	if (!numworkers)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&work_lock);
+	work_quit = true;
+	pthread_cond_broadcast(&work_start);
+	pthread_mutex_unlock(&work_lock);
+
+	for (i = 0; i < numworkers; i++)
+	{
+		pthread_join(workers[i], NULL);
+	}
+
+	numworkers = 0;
+	work_quit = false;
+}
+
+static void
+SV_WorkersStart(int count)
+{
+	int i;
+
+	count = Q_min(count, SV_MAX_WORKERS);
+
+	for (i = 0; i < count; i++)
+	{
+		if (pthread_create(&workers[i], NULL, SV_WorkerThread, NULL))
+		{
+			Com_Printf("%s: Couldn't create worker %d\n", __func__, i);
+			break;
+		}
+
+		numworkers++;
+	}
+
+	if (numworkers)
+	{
+		Com_Printf("Started %d server worker threads\n", numworkers);
+	}
+}
+
+#endif
+
+void
+SV_WorkersInit(void)
+{
+	sv_threads = Cvar_Get("sv_threads", "0", CVAR_ARCHIVE);
+	sv_threads->modified = true;
+}
+
+void
+SV_WorkersShutdown(void)
+{
+#ifdef SV_WORKERS_THREADED
+	SV_WorkersStop();
+#endif
+
+	if (sv_threads)
+	{
+		sv_threads->modified = true;
+	}
+}
+
+/*
+ * Returns the number of worker threads, zero if jobs
+ * are run by the main thread only. (Re)starts the
+ * workers after sv_threads was changed.
+ */
+int
+SV_NumWorkers(void)
+{
+#ifdef SV_WORKERS_THREADED
+	if (sv_threads && sv_threads->modified)
+	{
+		sv_threads->modified = false;
+
+		SV_WorkersStop();
+		SV_WorkersStart((int)sv_threads->value);
+	}
+
+	return numworkers;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Calls job for the items 0 to count - 1 and returns
+ * once all of them are done. The main thread takes
+ * part in the work. Items must not depend on each
+ * other and must not call into non thread safe code,
+ * e.g. Com_Printf().
+ */
+void
+SV_WorkersRun(sv_job_t job, void *data, int count)
+{
+	int i;
+
+#ifdef SV_WORKERS_THREADED
+	if (numworkers && (count > 1))
+	{
+		pthread_mutex_lock(&work_lock);
+
+		work_job = job;
+		work_data = data;
+		work_count = count;
+		work_next = 0;
+		work_pending = count;
+		work_generation++;
+		pthread_cond_broadcast(&work_start);
+
+		SV_WorkersDrain();
+
+		while (work_pending)
+		{
+			pthread_cond_wait(&work_done, &work_lock);
+		}
+
+		pthread_mutex_unlock(&work_lock);
+
+		return;
+	}
+#endif
+
+	for (i = 0; i < count; i++)
+	{
+		job(i, data);
+	}
+}
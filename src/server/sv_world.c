@@ -45,10 +45,71 @@ typedef struct areanode_s
 static areanode_t sv_areanodes[AREA_NODES];
 static int sv_numareanodes;
 
-static const float *area_mins, *area_maxs;
-static edict_t **area_list;
-static int area_count, area_maxcount;
-static int area_type;
+/* edicts unlinked since the last game frame, the
+   game doesn't see them go when it looks around */
+static int sv_unlinked[MAX_EDICTS];
+static qboolean sv_unlinkedmark[MAX_EDICTS];
+static int sv_numunlinked;
+
+/* bumped whenever an edict is linked or unlinked */
+static int sv_linkcount;
+
+/* a query of the edicts touching a box */
+typedef struct
+{
+	const float *mins, *maxs;
+	int type;
+	sv_areavisit_t visit;
+	void *data;
+	int found;
+} areaquery_t;
+
+/* Dynamic bounding box tree, used instead of the areanodes
+   if sv_areatree is set. Leafs are the boxes of the edicts,
+   grown by a margin so small moves don't change the tree.
+   The tree is kept balanced like an AVL tree. */
+#define AABB_NULL -1
+#define AABB_MARGIN 16
+#define AABB_STACK 256
+
+typedef struct
+{
+	vec3_t mins, maxs;
+	int parent; /* next free node if not used */
+	int children[2]; /* AABB_NULL for leafs */
+	int height; /* 0 for leafs, -1 if free */
+	int ent; /* edict number of leafs */
+} aabbnode_t;
+
+typedef struct
+{
+	aabbnode_t *nodes;
+	int numnodes, maxnodes;
+	int root;
+	int freelist;
+} aabbtree_t;
+
+typedef struct
+{
+	int tree; /* AREA_SOLID or AREA_TRIGGERS, 0 if not in a tree */
+	int leaf;
+	int areanode; /* areanode the edict would be linked to */
+	uint64_t seq; /* when it would have been appended there */
+} aabbent_t;
+
+static qboolean sv_useareatree;
+static aabbtree_t sv_areatrees[2];
+static aabbent_t *sv_areatreeents;
+static int sv_numareatreeents;
+static link_t sv_areatreelinks; /* all edicts in a tree */
+static uint64_t sv_areatreeseq;
+
+/* edicts found by a tree query, sorted into areanode order */
+static int sv_areatreehits[MAX_EDICTS];
+
+/* query cost, reported by sv_areastats */
+static int area_queries, area_nodes, area_tests, area_found;
+static int area_statstime;
 
 static int SV_HullForEntity(edict_t *ent);
 
@@ -75,6 +136,449 @@ InsertLinkBefore(link_t *l, link_t *before)
 	l->next->prev = l;
 }
 
+static float
+SV_AABBArea(const vec3_t mins, const vec3_t maxs)
+{
+	vec3_t size;
+
+	VectorSubtract(maxs, mins, size);
+
+	return size[0] * size[1] + size[1] * size[2] + size[2] * size[0];
+}
+
+static float
+SV_AABBUnionArea(const aabbnode_t *a, const aabbnode_t *b)
+{
+	vec3_t mins, maxs;
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		mins[i] = Q_min(a->mins[i], b->mins[i]);
+		maxs[i] = Q_max(a->maxs[i], b->maxs[i]);
+	}
+
+	return SV_AABBArea(mins, maxs);
+}
+
+static void
+SV_AABBClear(aabbtree_t *tree)
+{
+	int i;
+
+	for (i = 0; i < tree->maxnodes; i++)
+	{
+		tree->nodes[i].parent = (i + 1 < tree->maxnodes) ? i + 1 : AABB_NULL;
+		tree->nodes[i].height = -1;
+	}
+
+	tree->freelist = tree->maxnodes ? 0 : AABB_NULL;
+	tree->numnodes = 0;
+	tree->root = AABB_NULL;
+}
+
+static int
+SV_AABBAllocNode(aabbtree_t *tree)
+{
+	aabbnode_t *node;
+	int n;
+
+	if (tree->freelist == AABB_NULL)
+	{
+		aabbnode_t *tmp;
+		int i, maxnodes;
+
+		maxnodes = tree->maxnodes ? tree->maxnodes * 2 : 256;
+
+		tmp = realloc(tree->nodes, maxnodes * sizeof(*tmp));
+		YQ2_COM_CHECK_OOM(tmp, "realloc()", maxnodes * sizeof(*tmp))
+		if (!tmp)
+		{
+			/* unaware about YQ2_ATTR_NORETURN_FUNCPTR? */
+			return AABB_NULL;
+		}
+
+		for (i = tree->maxnodes; i < maxnodes; i++)
+		{
+			tmp[i].parent = (i + 1 < maxnodes) ? i + 1 : AABB_NULL;
+			tmp[i].height = -1;
+		}
+
+		tree->freelist = tree->maxnodes;
+		tree->nodes = tmp;
+		tree->maxnodes = maxnodes;
+	}
+
+	n = tree->freelist;
+	node = &tree->nodes[n];
+	tree->freelist = node->parent;
+
+	node->parent = AABB_NULL;
+	node->children[0] = node->children[1] = AABB_NULL;
+	node->height = 0;
+	node->ent = 0;
+	tree->numnodes++;
+
+	return n;
+}
+
+static void
+SV_AABBFreeNode(aabbtree_t *tree, int n)
+{
+	tree->nodes[n].parent = tree->freelist;
+	tree->nodes[n].height = -1;
+	tree->freelist = n;
+	tree->numnodes--;
+}
+
+/*
+ * Sets the box and height of an inner node from its children
+ */
+static void
+SV_AABBRefit(aabbtree_t *tree, int n)
+{
+	aabbnode_t *node, *c0, *c1;
+	int i;
+
+	node = &tree->nodes[n];
+	c0 = &tree->nodes[node->children[0]];
+	c1 = &tree->nodes[node->children[1]];
+
+	for (i = 0; i < 3; i++)
+	{
+		node->mins[i] = Q_min(c0->mins[i], c1->mins[i]);
+		node->maxs[i] = Q_max(c0->maxs[i], c1->maxs[i]);
+	}
+
+	node->height = 1 + Q_max(c0->height, c1->height);
+}
+
+/*
+ * Rotates the higher child of node a up if the children
+ * of a are unbalanced, returns the new root of the subtree.
+ */
+static int
+SV_AABBBalance(aabbtree_t *tree, int a)
+{
+	aabbnode_t *nodes;
+	int b, c, up, f, g, balance, side;
+
+	nodes = tree->nodes;
+
+	if ((nodes[a].height < 2))
+	{
+		return a;
+	}
+
+	b = nodes[a].children[0];
+	c = nodes[a].children[1];
+	balance = nodes[c].height - nodes[b].height;
+
+	if ((balance >= -1) && (balance <= 1))
+	{
+		return a;
+	}
+
+	/* up is the higher child, rotated up in place of a */
+	side = (balance > 1) ? 1 : 0;
+	up = nodes[a].children[side];
+	f = nodes[up].children[0];
+	g = nodes[up].children[1];
+
+	nodes[up].children[0] = a;
+	nodes[up].parent = nodes[a].parent;
+	nodes[a].parent = up;
+
+	if (nodes[up].parent != AABB_NULL)
+	{
+		aabbnode_t *parent;
+
+		parent = &nodes[nodes[up].parent];
+		parent->children[(parent->children[0] == a) ? 0 : 1] = up;
+	}
+	else
+	{
+		tree->root = up;
+	}
+
+	/* the higher grandchild stays with up */
+	if (nodes[f].height > nodes[g].height)
+	{
+		nodes[up].children[1] = f;
+		nodes[a].children[side] = g;
+		nodes[g].parent = a;
+	}
+	else
+	{
+		nodes[up].children[1] = g;
+		nodes[a].children[side] = f;
+		nodes[f].parent = a;
+	}
+
+	SV_AABBRefit(tree, a);
+	SV_AABBRefit(tree, up);
+
+	return up;
+}
+
+/*
+ * Refits and balances all nodes from n up to the root
+ */
+static void
+SV_AABBFixUpwards(aabbtree_t *tree, int n)
+{
+	while (n != AABB_NULL)
+	{
+		n = SV_AABBBalance(tree, n);
+		SV_AABBRefit(tree, n);
+		n = tree->nodes[n].parent;
+	}
+}
+
+static void
+SV_AABBInsertLeaf(aabbtree_t *tree, int leaf)
+{
+	int n, sibling, oldparent, newparent;
+	aabbnode_t *nodes;
+
+	if (tree->root == AABB_NULL)
+	{
+		tree->root = leaf;
+		tree->nodes[leaf].parent = AABB_NULL;
+		return;
+	}
+
+	/* find the best sibling, the one whose box
+	   grows the least by adding the leaf */
+	nodes = tree->nodes;
+	n = tree->root;
+
+	while (nodes[n].children[0] != AABB_NULL)
+	{
+		float area, combined, cost, inherit, childcost[2];
+		int i;
+
+		area = SV_AABBArea(nodes[n].mins, nodes[n].maxs);
+		combined = SV_AABBUnionArea(&nodes[n], &nodes[leaf]);
+
+		/* cost of a new parent for this node and the leaf */
+		cost = 2 * combined;
+
+		/* minimum cost of pushing the leaf further down */
+		inherit = 2 * (combined - area);
+
+		for (i = 0; i < 2; i++)
+		{
+			const aabbnode_t *child;
+
+			child = &nodes[nodes[n].children[i]];
+			childcost[i] = SV_AABBUnionArea(child, &nodes[leaf]) + inherit;
+
+			if (child->children[0] != AABB_NULL)
+			{
+				childcost[i] -= SV_AABBArea(child->mins, child->maxs);
+			}
+		}
+
+		if ((cost < childcost[0]) && (cost < childcost[1]))
+		{
+			break;
+		}
+
+		n = nodes[n].children[(childcost[0] < childcost[1]) ? 0 : 1];
+	}
+
+	sibling = n;
+
+	newparent = SV_AABBAllocNode(tree);
+	if (newparent == AABB_NULL)
+	{
+		return;
+	}
+
+	/* nodes may have been reallocated */
+	nodes = tree->nodes;
+	oldparent = nodes[sibling].parent;
+
+	nodes[newparent].parent = oldparent;
+	nodes[newparent].children[0] = sibling;
+	nodes[newparent].children[1] = leaf;
+	nodes[sibling].parent = newparent;
+	nodes[leaf].parent = newparent;
+
+	if (oldparent != AABB_NULL)
+	{
+		aabbnode_t *parent;
+
+		parent = &nodes[oldparent];
+		parent->children[(parent->children[0] == sibling) ? 0 : 1] = newparent;
+	}
+	else
+	{
+		tree->root = newparent;
+	}
+
+	SV_AABBFixUpwards(tree, newparent);
+}
+
+static void
+SV_AABBRemoveLeaf(aabbtree_t *tree, int leaf)
+{
+	int parent, grandparent, sibling;
+	aabbnode_t *nodes;
+
+	if (leaf == tree->root)
+	{
+		tree->root = AABB_NULL;
+		return;
+	}
+
+	nodes = tree->nodes;
+	parent = nodes[leaf].parent;
+	grandparent = nodes[parent].parent;
+	sibling = nodes[parent].children[(nodes[parent].children[0] == leaf) ? 1 : 0];
+
+	nodes[sibling].parent = grandparent;
+	SV_AABBFreeNode(tree, parent);
+
+	if (grandparent != AABB_NULL)
+	{
+		aabbnode_t *gp;
+
+		gp = &nodes[grandparent];
+		gp->children[(gp->children[0] == parent) ? 0 : 1] = sibling;
+
+		SV_AABBFixUpwards(tree, grandparent);
+	}
+	else
+	{
+		tree->root = sibling;
+	}
+}
+
+/*
+ * Takes the edict out of its tree, if it's in one
+ */
+static void
+SV_AreaTreeRemove(const edict_t *ent)
+{
+	aabbent_t *aent;
+	aabbtree_t *tree;
+	int num;
+
+	num = NUM_FOR_EDICT(ent);
+
+	if ((num < 0) || (num >= sv_numareatreeents))
+	{
+		return;
+	}
+
+	aent = &sv_areatreeents[num];
+
+	if (!aent->tree)
+	{
+		return;
+	}
+
+	tree = &sv_areatrees[aent->tree - 1];
+	SV_AABBRemoveLeaf(tree, aent->leaf);
+	SV_AABBFreeNode(tree, aent->leaf);
+
+	aent->tree = 0;
+	aent->leaf = AABB_NULL;
+}
+
+/*
+ * Inserts the edict into the tree of its solid type, or
+ * moves it in there. Nothing changes as long as the new
+ * box is still inside the grown box of the leaf. The
+ * areanode and a new sequence number are always taken,
+ * they give the order SV_AreaEdicts_r would return.
+ */
+static void
+SV_AreaTreeMove(const edict_t *ent, int type, int areanode)
+{
+	aabbtree_t *tree;
+	aabbent_t *aent;
+	aabbnode_t *node;
+	int num, leaf, i;
+
+	num = NUM_FOR_EDICT(ent);
+
+	if (num < 0)
+	{
+		return;
+	}
+
+	if (num >= sv_numareatreeents)
+	{
+		aabbent_t *tmp;
+		int count;
+
+		count = Q_max(num + 1, ge->max_edicts);
+
+		tmp = realloc(sv_areatreeents, count * sizeof(*tmp));
+		YQ2_COM_CHECK_OOM(tmp, "realloc()", count * sizeof(*tmp))
+		if (!tmp)
+		{
+			/* unaware about YQ2_ATTR_NORETURN_FUNCPTR? */
+			return;
+		}
+
+		for (i = sv_numareatreeents; i < count; i++)
+		{
+			tmp[i].tree = 0;
+			tmp[i].leaf = AABB_NULL;
+		}
+
+		sv_areatreeents = tmp;
+		sv_numareatreeents = count;
+	}
+
+	aent = &sv_areatreeents[num];
+	aent->areanode = areanode;
+	aent->seq = sv_areatreeseq++;
+
+	if (aent->tree == type)
+	{
+		node = &sv_areatrees[type - 1].nodes[aent->leaf];
+
+		if ((ent->absmin[0] >= node->mins[0]) &&
+			(ent->absmin[1] >= node->mins[1]) &&
+			(ent->absmin[2] >= node->mins[2]) &&
+			(ent->absmax[0] <= node->maxs[0]) &&
+			(ent->absmax[1] <= node->maxs[1]) &&
+			(ent->absmax[2] <= node->maxs[2]))
+		{
+			return; /* still inside */
+		}
+	}
+
+	SV_AreaTreeRemove(ent);
+
+	tree = &sv_areatrees[type - 1];
+	leaf = SV_AABBAllocNode(tree);
+
+	if (leaf == AABB_NULL)
+	{
+		return;
+	}
+
+	node = &tree->nodes[leaf];
+	node->ent = num;
+
+	for (i = 0; i < 3; i++)
+	{
+		node->mins[i] = ent->absmin[i] - AABB_MARGIN;
+		node->maxs[i] = ent->absmax[i] + AABB_MARGIN;
+	}
+
+	SV_AABBInsertLeaf(tree, leaf);
+
+	aent->tree = type;
+	aent->leaf = leaf;
+}
+
 /*
  * Builds a uniformly subdivided tree for the given world size
  */
@@ -126,17 +630,65 @@ SV_CreateAreaNode(int depth, vec3_t mins, vec3_t maxs)
 void
 SV_ClearWorld(void)
 {
+	int i;
+
 	memset(sv_areanodes, 0, sizeof(sv_areanodes));
 	sv_numareanodes = 0;
+
+	sv_useareatree = sv_areatree && sv_areatree->value;
+
+	SV_AABBClear(&sv_areatrees[0]);
+	SV_AABBClear(&sv_areatrees[1]);
+	ClearLink(&sv_areatreelinks);
+	sv_areatreeseq = 0;
+
+	for (i = 0; i < sv_numareatreeents; i++)
+	{
+		sv_areatreeents[i].tree = 0;
+		sv_areatreeents[i].leaf = AABB_NULL;
+	}
+
 	if (sv.models[1])
 	{
 		SV_CreateAreaNode(0, sv.models[1]->mins, sv.models[1]->maxs);
 	}
+
+	SV_ClearUnlinkedEdicts();
+	sv_linkcount++;
+}
+
+/*
+ * Lets the game tell whether a list of edicts it
+ * got from the area structures is still current.
+ */
+int
+SV_LinkCount(void)
+{
+	return sv_linkcount;
+}
+
+/*
+ * Forgets the edicts unlinked so far,
+ * called before each game frame.
+ */
+void
+SV_ClearUnlinkedEdicts(void)
+{
+	int i;
+
+	for (i = 0; i < sv_numunlinked; i++)
+	{
+		sv_unlinkedmark[sv_unlinked[i]] = false;
+	}
+
+	sv_numunlinked = 0;
 }
 
 void
 SV_UnlinkEdict(edict_t *ent)
 {
+	int num;
+
 	if (!ent->area.prev)
 	{
 		return; /* not linked in anywhere */
@@ -144,6 +696,20 @@ SV_UnlinkEdict(edict_t *ent)
 
 	RemoveLink(&ent->area);
 	ent->area.prev = ent->area.next = NULL;
+	sv_linkcount++;
+
+	num = NUM_FOR_EDICT(ent);
+
+	if ((num >= 0) && (num < MAX_EDICTS) && !sv_unlinkedmark[num])
+	{
+		sv_unlinkedmark[num] = true;
+		sv_unlinked[sv_numunlinked++] = num;
+	}
+
+	if (sv_useareatree)
+	{
+		SV_AreaTreeRemove(ent);
+	}
 }
 
 void
@@ -154,9 +720,14 @@ SV_LinkEdict(edict_t *ent)
 	int clusters[MAX_TOTAL_ENT_LEAFS];
 	int num_leafs, topnode, i;
 
+	sv_linkcount++;
+
 	if (ent->area.prev)
 	{
-		SV_UnlinkEdict(ent); /* unlink from old position */
+		/* unlink from old position, a leaf of the
+		   area tree is moved once the new one is known */
+		RemoveLink(&ent->area);
+		ent->area.prev = ent->area.next = NULL;
 	}
 
 	if (ent == ge->edicts)
@@ -166,6 +737,11 @@ SV_LinkEdict(edict_t *ent)
 
 	if (!ent->inuse)
 	{
+		if (sv_useareatree)
+		{
+			SV_AreaTreeRemove(ent);
+		}
+
 		return;
 	}
 
@@ -286,239 +862,638 @@ SV_LinkEdict(edict_t *ent)
 	num_leafs = CM_BoxLeafnums(ent->absmin, ent->absmax,
 			leafs, MAX_TOTAL_ENT_LEAFS, &topnode);
 
-	/* set areas */
-	for (i = 0; i < num_leafs; i++)
+	/* set areas */
+	for (i = 0; i < num_leafs; i++)
+	{
+		int area;
+
+		clusters[i] = CM_LeafCluster(leafs[i]);
+		area = CM_LeafArea(leafs[i]);
+
+		if (area)
+		{
+			/* doors may legally straggle two areas,
+			   but nothing should evern need more than that */
+			if (ent->areanum && (ent->areanum != area))
+			{
+				if (ent->areanum2 && (ent->areanum2 != area) &&
+					(sv.state == ss_loading))
+				{
+					Com_DPrintf("Object touching 3 areas at %f %f %f\n",
+							ent->absmin[0], ent->absmin[1], ent->absmin[2]);
+				}
+
+				ent->areanum2 = area;
+			}
+			else
+			{
+				ent->areanum = area;
+			}
+		}
+	}
+
+	if (num_leafs >= MAX_TOTAL_ENT_LEAFS)
+	{
+		/* assume we missed some leafs, and mark by headnode */
+		ent->num_clusters = -1;
+		ent->headnode = topnode;
+	}
+	else
+	{
+		int j;
+
+		ent->num_clusters = 0;
+
+		for (i = 0; i < num_leafs; i++)
+		{
+			if (clusters[i] == -1)
+			{
+				continue; /* not a visible leaf */
+			}
+
+			for (j = 0; j < i; j++)
+			{
+				if (clusters[j] == clusters[i])
+				{
+					break;
+				}
+			}
+
+			if (j == i)
+			{
+				if (ent->num_clusters == MAX_ENT_CLUSTERS)
+				{
+					/* assume we missed some leafs, and mark by headnode */
+					ent->num_clusters = -1;
+					ent->headnode = topnode;
+					break;
+				}
+
+				ent->clusternums[ent->num_clusters++] = clusters[i];
+			}
+		}
+	}
+
+	/* if first time, make sure old_origin is valid */
+	if (!ent->linkcount)
+	{
+		VectorCopy(ent->s.origin, ent->s.old_origin);
+	}
+
+	ent->linkcount++;
+
+	if (ent->solid == SOLID_NOT)
+	{
+		if (sv_useareatree)
+		{
+			SV_AreaTreeRemove(ent);
+		}
+
+		return;
+	}
+
+	/* find the first node that the ent's box crosses */
+	node = sv_areanodes;
+
+	while (1)
+	{
+		if (node->axis == -1)
+		{
+			break;
+		}
+
+		if (ent->absmin[node->axis] > node->dist)
+		{
+			node = node->children[0];
+		}
+		else if (ent->absmax[node->axis] < node->dist)
+		{
+			node = node->children[1];
+		}
+		else
+		{
+			break; /* crosses the node */
+		}
+	}
+
+	if (sv_useareatree)
+	{
+		SV_AreaTreeMove(ent, (ent->solid == SOLID_TRIGGER) ?
+			AREA_TRIGGERS : AREA_SOLID, (int)(node - sv_areanodes));
+		InsertLinkBefore(&ent->area, &sv_areatreelinks);
+		return;
+	}
+
+	/* link it in */
+	if (ent->solid == SOLID_TRIGGER)
+	{
+		InsertLinkBefore(&ent->area, &node->trigger_edicts);
+	}
+	else
+	{
+		InsertLinkBefore(&ent->area, &node->solid_edicts);
+	}
+}
+
+/*
+ * Returns true if the edict touches the box of the query
+ */
+static qboolean
+SV_AreaTouches(const areaquery_t *query, const edict_t *check)
+{
+	if (check->solid == SOLID_NOT)
+	{
+		return false; /* deactivated */
+	}
+
+	area_tests++;
+
+	if ((check->absmin[0] > query->maxs[0]) ||
+		(check->absmin[1] > query->maxs[1]) ||
+		(check->absmin[2] > query->maxs[2]) ||
+		(check->absmax[0] < query->mins[0]) ||
+		(check->absmax[1] < query->mins[1]) ||
+		(check->absmax[2] < query->mins[2]))
+	{
+		return false; /* not touching */
+	}
+
+	return true;
+}
+
+/*
+ * Returns false if the visitor stopped the query
+ */
+static qboolean
+SV_AreaEdicts_r(areanode_t *node, areaquery_t *query)
+{
+	link_t *l, *next, *start;
+	edict_t *check;
+
+	area_nodes++;
+
+	/* touch linked edicts */
+	if (query->type == AREA_SOLID)
+	{
+		start = &node->solid_edicts;
+	}
+	else
+	{
+		start = &node->trigger_edicts;
+	}
+
+	for (l = start->next; l != start; l = next)
+	{
+		next = l->next;
+		check = (EDICT_FROM_AREA(l));
+
+		if (!SV_AreaTouches(query, check))
+		{
+			continue;
+		}
+
+		query->found++;
+
+		if (!query->visit(check, query->data))
+		{
+			return false;
+		}
+	}
+
+	if (node->axis == -1)
+	{
+		return true; /* terminal node */
+	}
+
+	/* recurse down both sides */
+	if (query->maxs[node->axis] > node->dist)
+	{
+		if (!SV_AreaEdicts_r(node->children[0], query))
+		{
+			return false;
+		}
+	}
+
+	if (query->mins[node->axis] < node->dist)
+	{
+		return SV_AreaEdicts_r(node->children[1], query);
+	}
+
+	return true;
+}
+
+/*
+ * Orders edicts like the walk of the areanodes: nodes in
+ * preorder, which is their index, then the order in which
+ * they were appended to the node.
+ */
+static int
+SV_AreaTreeCompare(const void *a, const void *b)
+{
+	const aabbent_t *ea = &sv_areatreeents[*(const int *)a];
+	const aabbent_t *eb = &sv_areatreeents[*(const int *)b];
+
+	if (ea->areanode != eb->areanode)
+	{
+		return (ea->areanode < eb->areanode) ? -1 : 1;
+	}
+
+	if (ea->seq != eb->seq)
+	{
+		return (ea->seq < eb->seq) ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Collects the edicts touching the box and visits them
+ * in the same order as SV_AreaEdicts_r, so triggers are
+ * touched and traces are clipped as with the areanodes.
+ */
+static void
+SV_AreaTreeEdicts(const aabbtree_t *tree, areaquery_t *query)
+{
+	int stack[AABB_STACK];
+	int depth, numhits, i;
+
+	if (tree->root == AABB_NULL)
+	{
+		return;
+	}
+
+	depth = 0;
+	numhits = 0;
+	stack[depth++] = tree->root;
+
+	while (depth)
+	{
+		const aabbnode_t *node;
+		edict_t *check;
+
+		node = &tree->nodes[stack[--depth]];
+		area_nodes++;
+
+		if ((node->mins[0] > query->maxs[0]) ||
+			(node->mins[1] > query->maxs[1]) ||
+			(node->mins[2] > query->maxs[2]) ||
+			(node->maxs[0] < query->mins[0]) ||
+			(node->maxs[1] < query->mins[1]) ||
+			(node->maxs[2] < query->mins[2]))
+		{
+			continue;
+		}
+
+		if (node->children[0] != AABB_NULL)
+		{
+			if (depth + 2 > AABB_STACK)
+			{
+				Com_Printf("%s: stack overflow\n", __func__);
+				break;
+			}
+
+			/* pushed in reverse to visit the first child first */
+			stack[depth++] = node->children[1];
+			stack[depth++] = node->children[0];
+			continue;
+		}
+
+		check = EDICT_NUM(node->ent);
+
+		if (!SV_AreaTouches(query, check) || (numhits == MAX_EDICTS))
+		{
+			continue;
+		}
+
+		sv_areatreehits[numhits++] = node->ent;
+	}
+
+	if (numhits > 1)
 	{
-		int area;
+		qsort(sv_areatreehits, numhits, sizeof(sv_areatreehits[0]),
+			SV_AreaTreeCompare);
+	}
 
-		clusters[i] = CM_LeafCluster(leafs[i]);
-		area = CM_LeafArea(leafs[i]);
+	for (i = 0; i < numhits; i++)
+	{
+		query->found++;
 
-		if (area)
+		if (!query->visit(EDICT_NUM(sv_areatreehits[i]), query->data))
 		{
-			/* doors may legally straggle two areas,
-			   but nothing should evern need more than that */
-			if (ent->areanum && (ent->areanum != area))
-			{
-				if (ent->areanum2 && (ent->areanum2 != area) &&
-					(sv.state == ss_loading))
-				{
-					Com_DPrintf("Object touching 3 areas at %f %f %f\n",
-							ent->absmin[0], ent->absmin[1], ent->absmin[2]);
-				}
-
-				ent->areanum2 = area;
-			}
-			else
-			{
-				ent->areanum = area;
-			}
+			return;
 		}
 	}
+}
 
-	if (num_leafs >= MAX_TOTAL_ENT_LEAFS)
+/*
+ * Prints the cost of the edict queries every sv_areastats
+ * seconds, to compare the area tree with the areanodes.
+ */
+void
+SV_AreaStats(void)
+{
+	int now;
+
+	if (!sv_areastats || (sv_areastats->value <= 0))
 	{
-		/* assume we missed some leafs, and mark by headnode */
-		ent->num_clusters = -1;
-		ent->headnode = topnode;
+		area_queries = 0;
+		area_statstime = 0;
+		return;
 	}
-	else
+
+	now = Sys_Milliseconds();
+
+	if (!area_statstime)
 	{
-		int j;
+		area_statstime = now;
+	}
 
-		ent->num_clusters = 0;
+	if ((now - area_statstime) < sv_areastats->value * 1000)
+	{
+		return;
+	}
 
-		for (i = 0; i < num_leafs; i++)
-		{
-			if (clusters[i] == -1)
-			{
-				continue; /* not a visible leaf */
-			}
+	if (area_queries)
+	{
+		Com_Printf("%s: %d queries, %.1f nodes, %.1f edicts tested, "
+			"%.1f found per query, %d tree nodes\n",
+			sv_useareatree ? "area tree" : "areanodes", area_queries,
+			(float)area_nodes / area_queries, (float)area_tests / area_queries,
+			(float)area_found / area_queries,
+			sv_areatrees[0].numnodes + sv_areatrees[1].numnodes);
+	}
 
-			for (j = 0; j < i; j++)
-			{
-				if (clusters[j] == clusters[i])
-				{
-					break;
-				}
-			}
+	area_queries = area_nodes = area_tests = area_found = 0;
+	area_statstime = now;
+}
 
-			if (j == i)
-			{
-				if (ent->num_clusters == MAX_ENT_CLUSTERS)
-				{
-					/* assume we missed some leafs, and mark by headnode */
-					ent->num_clusters = -1;
-					ent->headnode = topnode;
-					break;
-				}
+/*
+ * Calls visit for all edicts of the area type touching
+ * the box, until it returns false. The visitor must not
+ * link or unlink edicts or start another query.
+ */
+void
+SV_AreaEdictsVisit(const vec3_t mins, const vec3_t maxs, int areatype,
+		sv_areavisit_t visit, void *data)
+{
+	areaquery_t query;
 
-				ent->clusternums[ent->num_clusters++] = clusters[i];
-			}
-		}
+	query.mins = mins;
+	query.maxs = maxs;
+	query.type = areatype;
+	query.visit = visit;
+	query.data = data;
+	query.found = 0;
+
+	if (sv_useareatree)
+	{
+		SV_AreaTreeEdicts(&sv_areatrees[(areatype == AREA_SOLID) ? 0 : 1],
+			&query);
+	}
+	else
+	{
+		SV_AreaEdicts_r(sv_areanodes, &query);
 	}
 
-	/* if first time, make sure old_origin is valid */
-	if (!ent->linkcount)
+	area_queries++;
+	area_found += query.found;
+}
+
+typedef struct
+{
+	edict_t **list;
+	int count, maxcount;
+} arealist_t;
+
+static qboolean
+SV_AreaListVisit(edict_t *ent, void *data)
+{
+	arealist_t *arealist = data;
+
+	if (arealist->count == arealist->maxcount)
 	{
-		VectorCopy(ent->s.origin, ent->s.old_origin);
+		Com_Printf("SV_AreaEdicts: MAXCOUNT\n");
+		return false;
 	}
 
-	ent->linkcount++;
+	arealist->list[arealist->count++] = ent;
 
-	if (ent->solid == SOLID_NOT)
+	return true;
+}
+
+int
+SV_AreaEdicts(const vec3_t mins, const vec3_t maxs, edict_t **list,
+		int maxcount, int areatype)
+{
+	arealist_t arealist;
+
+	arealist.list = list;
+	arealist.count = 0;
+	arealist.maxcount = maxcount;
+
+	SV_AreaEdictsVisit(mins, maxs, areatype, SV_AreaListVisit, &arealist);
+
+	return arealist.count;
+}
+
+/* spheres whose box covers more than 1/SPHERE_MAXAREAFRAC
+   of the world aren't searched, walking all edicts is cheaper */
+#define SPHERE_MAXAREAFRAC 4
+
+/* the edicts found in a sphere are marked by number,
+   which gives them in order without sorting */
+typedef struct
+{
+	const float *origin;
+	float radius;
+	unsigned marks[(MAX_EDICTS + 31) / 32];
+	int count, maxcount;
+} spherelist_t;
+
+static void
+SV_SphereListMark(spherelist_t *sphere, const edict_t *ent)
+{
+	int num;
+
+	num = NUM_FOR_EDICT(ent);
+
+	if ((num < 0) || (num >= MAX_EDICTS) ||
+		(sphere->marks[num >> 5] & (1u << (num & 31))))
 	{
 		return;
 	}
 
-	/* find the first node that the ent's box crosses */
-	node = sv_areanodes;
+	sphere->marks[num >> 5] |= 1u << (num & 31);
+	sphere->count++;
+}
 
-	while (1)
+static qboolean
+SV_SphereListVisit(edict_t *ent, void *data)
+{
+	spherelist_t *sphere = data;
+	float dist = 0;
+	int i;
+
+	/* distance to the box */
+	for (i = 0; i < 3; i++)
 	{
-		if (node->axis == -1)
-		{
-			break;
-		}
+		float d = 0;
 
-		if (ent->absmin[node->axis] > node->dist)
-		{
-			node = node->children[0];
-		}
-		else if (ent->absmax[node->axis] < node->dist)
+		if (sphere->origin[i] < ent->absmin[i])
 		{
-			node = node->children[1];
+			d = ent->absmin[i] - sphere->origin[i];
 		}
-		else
+		else if (sphere->origin[i] > ent->absmax[i])
 		{
-			break; /* crosses the node */
+			d = sphere->origin[i] - ent->absmax[i];
 		}
+
+		dist += d * d;
 	}
 
-	/* link it in */
-	if (ent->solid == SOLID_TRIGGER)
+	if (dist > sphere->radius * sphere->radius)
 	{
-		InsertLinkBefore(&ent->area, &node->trigger_edicts);
+		return true;
 	}
-	else
+
+	if (sphere->count == sphere->maxcount)
 	{
-		InsertLinkBefore(&ent->area, &node->solid_edicts);
+		return false;
 	}
+
+	SV_SphereListMark(sphere, ent);
+
+	return true;
 }
 
-static void
-SV_AreaEdicts_r(areanode_t *node)
+/*
+ * Fills list with the edicts of the area types whose
+ * boxes touch the sphere, ordered by edict number.
+ * Solid edicts unlinked since the last game frame are
+ * added as well, they may be linked again any moment.
+ * Returns maxcount if the list is too short or the
+ * sphere covers a large part of the world.
+ */
+int
+SV_SphereEdicts(const vec3_t origin, float radius, edict_t **list,
+		int maxcount, int areatypes)
 {
-	link_t *l, *next, *start;
-	edict_t *check;
+	static spherelist_t sphere;
+	vec3_t mins, maxs;
+	int i, j, count;
 
-	/* touch linked edicts */
-	if (area_type == AREA_SOLID)
+	for (i = 0; i < 3; i++)
 	{
-		start = &node->solid_edicts;
+		mins[i] = origin[i] - radius;
+		maxs[i] = origin[i] + radius;
 	}
-	else
+
+	if (sv.models[1] && (radius > 0))
 	{
-		start = &node->trigger_edicts;
+		float worldarea, spherearea;
+
+		/* the areas would be visited almost completely */
+		worldarea = (sv.models[1]->maxs[0] - sv.models[1]->mins[0]) *
+			(sv.models[1]->maxs[1] - sv.models[1]->mins[1]);
+		spherearea = 4 * radius * radius;
+
+		if (spherearea * SPHERE_MAXAREAFRAC > worldarea)
+		{
+			return maxcount;
+		}
 	}
 
-	for (l = start->next; l != start; l = next)
+	sphere.origin = origin;
+	sphere.radius = radius;
+	sphere.count = 0;
+	sphere.maxcount = maxcount;
+	memset(sphere.marks, 0, sizeof(sphere.marks));
+
+	if (areatypes & AREA_SOLID)
 	{
-		next = l->next;
-		check = (EDICT_FROM_AREA(l));
+		SV_AreaEdictsVisit(mins, maxs, AREA_SOLID, SV_SphereListVisit, &sphere);
+	}
+
+	if ((areatypes & AREA_TRIGGERS) && (sphere.count < maxcount))
+	{
+		SV_AreaEdictsVisit(mins, maxs, AREA_TRIGGERS, SV_SphereListVisit, &sphere);
+	}
+
+	for (i = 0; i < sv_numunlinked; i++)
+	{
+		edict_t *ent;
 
-		if (check->solid == SOLID_NOT)
+		if (sv_unlinked[i] >= ge->num_edicts)
 		{
-			continue; /* deactivated */
+			continue;
 		}
 
-		if ((check->absmin[0] > area_maxs[0]) ||
-			(check->absmin[1] > area_maxs[1]) ||
-			(check->absmin[2] > area_maxs[2]) ||
-			(check->absmax[0] < area_mins[0]) ||
-			(check->absmax[1] < area_mins[1]) ||
-			(check->absmax[2] < area_mins[2]))
+		ent = EDICT_NUM(sv_unlinked[i]);
+
+		if (!ent->inuse || ent->area.prev || (ent->solid == SOLID_NOT))
 		{
-			continue; /* not touching */
+			continue;
 		}
 
-		if (area_count == area_maxcount)
+		if (sphere.count == maxcount)
 		{
-			Com_Printf("SV_AreaEdicts: MAXCOUNT\n");
-			return;
+			break;
 		}
 
-		area_list[area_count] = check;
-		area_count++;
+		SV_SphereListMark(&sphere, ent);
 	}
 
-	if (node->axis == -1)
-	{
-		return; /* terminal node */
-	}
+	count = 0;
 
-	/* recurse down both sides */
-	if (area_maxs[node->axis] > node->dist)
+	for (i = 0; (i < (int)ARRLEN(sphere.marks)) && (count < sphere.count); i++)
 	{
-		SV_AreaEdicts_r(node->children[0]);
-	}
+		unsigned bits = sphere.marks[i];
 
-	if (area_mins[node->axis] < node->dist)
-	{
-		SV_AreaEdicts_r(node->children[1]);
+		for (j = 0; bits; j++, bits >>= 1)
+		{
+			if (bits & 1)
+			{
+				list[count++] = EDICT_NUM((i << 5) + j);
+			}
+		}
 	}
+
+	return count;
 }
 
-int
-SV_AreaEdicts(const vec3_t mins, const vec3_t maxs, edict_t **list,
-		int maxcount, int areatype)
+typedef struct
 {
-	area_mins = mins;
-	area_maxs = maxs;
-	area_list = list;
-	area_maxcount = maxcount;
-	area_type = areatype;
-	area_count = 0;
+	const float *point;
+	int contents;
+} pointcontents_t;
 
-	SV_AreaEdicts_r(sv_areanodes);
+static qboolean
+SV_PointContentsVisit(edict_t *hit, void *data)
+{
+	pointcontents_t *pc = data;
+	int headnode;
 
-	area_mins = 0;
-	area_maxs = 0;
-	area_list = 0;
-	area_maxcount = 0;
-	area_type = 0;
+	/* might intersect, so do an exact clip */
+	headnode = SV_HullForEntity(hit);
+	pc->contents |= CM_TransformedPointContents(pc->point, headnode,
+			hit->s.origin, hit->s.angles);
 
-	return area_count;
+	return true;
 }
 
 int
 SV_PointContents(const vec3_t p)
 {
-	edict_t *touch[MAX_EDICTS];
-	int i, num, contents;
+	pointcontents_t pc;
 
 	/* get base contents from world */
-	contents = CM_PointContents(p, sv.models[1]->headnode);
+	pc.point = p;
+	pc.contents = CM_PointContents(p, sv.models[1]->headnode);
 
 	/* or in contents from all the other entities */
-	num = SV_AreaEdicts(p, p, touch, MAX_EDICTS, AREA_SOLID);
-
-	for (i = 0; i < num; i++)
-	{
-		edict_t *hit;
-		int headnode, c2;
-
-		hit = touch[i];
-
-		/* might intersect, so do an exact clip */
-		headnode = SV_HullForEntity(hit);
-		c2 = CM_TransformedPointContents(p, headnode,
-				hit->s.origin, hit->s.angles);
-
-		contents |= c2;
-	}
+	SV_AreaEdictsVisit(p, p, AREA_SOLID, SV_PointContentsVisit, &pc);
 
-	return contents;
+	return pc.contents;
 }
 
 typedef struct
@@ -563,96 +1538,91 @@ SV_HullForEntity(edict_t *ent)
 	return CM_HeadnodeForBox(ent->mins, ent->maxs);
 }
 
-static void
-SV_ClipMoveToEntities(moveclip_t *clip)
+static qboolean
+SV_ClipMoveVisit(edict_t *touch, void *data)
 {
-	int i, num;
-	edict_t *touchlist[MAX_EDICTS], *touch;
+	moveclip_t *clip = data;
 	trace_t trace;
 	int headnode;
 	float *angles;
 
-	num = SV_AreaEdicts(clip->boxmins, clip->boxmaxs, touchlist,
-			MAX_EDICTS, AREA_SOLID);
-
-	/* be careful, it is possible to have an entity in this
-	   list removed before we get to it (killtriggered) */
-	for (i = 0; i < num; i++)
+	if (touch == clip->passedict)
 	{
-		touch = touchlist[i];
+		return true;
+	}
 
-		if (touch->solid == SOLID_NOT)
-		{
-			continue;
-		}
+	if (clip->trace.allsolid)
+	{
+		return false;
+	}
 
-		if (touch == clip->passedict)
+	if (clip->passedict)
+	{
+		if (touch->owner == clip->passedict)
 		{
-			continue;
+			return true; /* don't clip against own missiles */
 		}
 
-		if (clip->trace.allsolid)
+		if (clip->passedict->owner == touch)
 		{
-			return;
+			return true; /* don't clip against owner */
 		}
+	}
 
-		if (clip->passedict)
-		{
-			if (touch->owner == clip->passedict)
-			{
-				continue; /* don't clip against own missiles */
-			}
+	if (!(clip->contentmask & CONTENTS_DEADMONSTER) &&
+		(touch->svflags & SVF_DEADMONSTER))
+	{
+		return true;
+	}
 
-			if (clip->passedict->owner == touch)
-			{
-				continue; /* don't clip against owner */
-			}
-		}
+	/* might intersect, so do an exact clip */
+	headnode = SV_HullForEntity(touch);
+	angles = touch->s.angles;
 
-		if (!(clip->contentmask & CONTENTS_DEADMONSTER) &&
-			(touch->svflags & SVF_DEADMONSTER))
-		{
-			continue;
-		}
+	if (touch->solid != SOLID_BSP)
+	{
+		angles = vec3_origin; /* boxes don't rotate */
+	}
 
-		/* might intersect, so do an exact clip */
-		headnode = SV_HullForEntity(touch);
-		angles = touch->s.angles;
+	if (touch->svflags & SVF_MONSTER)
+	{
+		trace = CM_TransformedBoxTrace(clip->start, clip->end,
+				clip->mins2, clip->maxs2, headnode, clip->contentmask,
+				touch->s.origin, angles);
+	}
+	else
+	{
+		trace = CM_TransformedBoxTrace(clip->start, clip->end,
+				clip->mins, clip->maxs, headnode, clip->contentmask,
+				touch->s.origin, angles);
+	}
 
-		if (touch->solid != SOLID_BSP)
-		{
-			angles = vec3_origin; /* boxes don't rotate */
-		}
+	if (trace.allsolid || trace.startsolid ||
+		(trace.fraction < clip->trace.fraction))
+	{
+		trace.ent = touch;
 
-		if (touch->svflags & SVF_MONSTER)
+		if (clip->trace.startsolid)
 		{
-			trace = CM_TransformedBoxTrace(clip->start, clip->end,
-					clip->mins2, clip->maxs2, headnode, clip->contentmask,
-					touch->s.origin, angles);
+			clip->trace = trace;
+			clip->trace.startsolid = true;
 		}
 		else
 		{
-			trace = CM_TransformedBoxTrace(clip->start, clip->end,
-					clip->mins, clip->maxs, headnode, clip->contentmask,
-					touch->s.origin, angles);
+			clip->trace = trace;
 		}
+	}
 
-		if (trace.allsolid || trace.startsolid ||
-			(trace.fraction < clip->trace.fraction))
-		{
-			trace.ent = touch;
+	return !clip->trace.allsolid;
+}
 
-			if (clip->trace.startsolid)
-			{
-				clip->trace = trace;
-				clip->trace.startsolid = true;
-			}
-			else
-			{
-				clip->trace = trace;
-			}
-		}
-	}
+static void
+SV_ClipMoveToEntities(moveclip_t *clip)
+{
+	/* the edicts are clipped while the area is walked,
+	   so it can stop once the move is all in solid */
+	SV_AreaEdictsVisit(clip->boxmins, clip->boxmaxs, AREA_SOLID,
+			SV_ClipMoveVisit, clip);
 }
 
 static void
@@ -727,3 +1697,20 @@ SV_Trace(const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t
 	return clip.trace;
 }
 
+void
+SV_FreeAreaTree(void)
+{
+	int i;
+
+	for (i = 0; i < 2; i++)
+	{
+		free(sv_areatrees[i].nodes);
+	}
+
+	memset(sv_areatrees, 0, sizeof(sv_areatrees));
+
+	free(sv_areatreeents);
+	sv_areatreeents = NULL;
+	sv_numareatreeents = 0;
+	sv_useareatree = false;
+}